@@ -163,6 +163,9 @@ int main(int argc, char *argv[]) {
 			}
 			for (const std::string &path : paths)
 				payload.push_back(path);
+		} else if (cmd == LPOP || cmd == LTIER) {
+			while (optind < argc)
+				payload.push_back(argv[optind++]); // checked by autotierfs
 		} else if (cmd == STATUS) {
 			std::stringstream ss;
 			ss << std::boolalpha << json << std::endl;
@@ -21,12 +21,17 @@
 
 #include "alert.hpp"
 #include "conflicts.hpp"
+#include "kernelCache.hpp"
 #include "metadata.hpp"
 #include "openFiles.hpp"
+#include "requestCounts.hpp"
 #include "version.hpp"
 
+#include <algorithm>
 #include <iomanip>
+#include <limits>
 #include <sstream>
+#include <stdexcept>
 
 extern "C" {
 #include <grp.h>
@@ -85,6 +90,7 @@ void TierEngineAdhoc::process_adhoc_requests(void) {
 		try {
 			switch (work.cmd_) {
 				case ONESHOT:
+				case RESCAN:
 					process_oneshot(work);
 					break;
 				case PIN:
@@ -101,11 +107,14 @@ void TierEngineAdhoc::process_adhoc_requests(void) {
 					process_list_pins();
 					break;
 				case LPOP:
-					process_list_popularity();
+					process_list_popularity(work);
 					break;
 				case WHICHTIER:
 					process_which_tier(work);
 					break;
+				case LTIER:
+					process_list_tier(work);
+					break;
 				default:
 					Logging::log.warning("Received bad ad hoc command.");
 					payload.clear();
@@ -131,7 +140,9 @@ void TierEngineAdhoc::process_oneshot(const AdHoc &work) {
 	std::vector<std::string> payload;
 	if (!work.args_.empty()) {
 		payload.push_back("ERR");
-		std::string err_msg = "autotier oneshot takes no arguments. Offender(s):";
+		std::string err_msg = std::string("autotier ")
+							  + (work.cmd_ == RESCAN ? "rescan" : "oneshot")
+							  + " takes no arguments. Offender(s):";
 		for (const std::string &str : work.args_)
 			err_msg += " " + str;
 		payload.push_back(err_msg);
@@ -246,6 +257,9 @@ void TierEngineAdhoc::process_status(const AdHoc &work) {
 	std::vector<std::string> conflicts;
 	bool has_conflicts = check_conflicts(conflicts, run_path_);
 
+	std::vector<uint64_t> thread_requests;
+	uint64_t exited_thread_requests = RequestCounts::snapshot(thread_requests);
+
 	std::stringstream ss;
 	if (json) {
 		ss << 
@@ -271,7 +285,20 @@ void TierEngineAdhoc::process_status(const AdHoc &work) {
 					"\"quota_pretty\":\"" + tptr->quota().get_str() + "\","
 					"\"usage\":" + std::to_string(tptr->usage_bytes().get()) + ","
 					"\"usage_pretty\":\"" + tptr->usage_bytes().get_str() + "\","
-					"\"path\":\"" + tptr->path().string() + "\""
+					"\"path\":\"" + tptr->path().string() + "\","
+					"\"move_from\":{";
+			bool first = true;
+			for (const Tier &source : tiers_) {
+				if (&source == &(*tptr))
+					continue;
+				if (!first)
+					ss << ",";
+				first = false;
+				ss << "\"" + source.id() + "\":\"" + move_method_str(tptr->move_method(&source))
+						  + "\"";
+			}
+			ss <<
+				"}"
 				"}";
 			if (std::next(tptr) != tiers_.end())
 				ss << ",";
@@ -289,7 +316,20 @@ void TierEngineAdhoc::process_status(const AdHoc &work) {
 				ss << ",";
 		}
 		ss << "]"
-			  "}"
+			  "},"
+			  "\"fuse_threads\":{"
+			  "\"requests\":[";
+		for (std::vector<uint64_t>::iterator itr = thread_requests.begin();
+			 itr != thread_requests.end();
+			 ++itr) {
+			ss << *itr;
+			if (std::next(itr) != thread_requests.end())
+				ss << ",";
+		}
+		ss << "],"
+			  "\"exited_requests\":"
+		   << exited_thread_requests
+		   << "}"
 			  "}";
 	} else {
 		std::vector<std::string> names;
@@ -380,6 +420,17 @@ void TierEngineAdhoc::process_status(const AdHoc &work) {
 			ss << std::left << tptr->path().string();
 			ss << std::endl;
 		}
+		{
+			// Requests handled by each FUSE thread
+			ss << std::endl;
+			ss << "FUSE threads: " << thread_requests.size() << std::endl;
+			ss << "Requests per thread:";
+			for (uint64_t requests : thread_requests)
+				ss << " " << requests;
+			ss << std::endl;
+			if (exited_thread_requests)
+				ss << "Requests by exited threads: " << exited_thread_requests << std::endl;
+		}
 		if (has_conflicts) {
 			ss << "\n" << std::endl;
 			ss << "autotier encountered conflicting file paths between tiers:" << std::endl;
@@ -406,26 +457,93 @@ void TierEngineAdhoc::process_list_pins(void) {
 	payload.push_back("OK");
 	std::stringstream ss;
 	ss << "File : Tier Path" << std::endl;
-	rocksdb::Iterator *it = db_->NewIterator(rocksdb::ReadOptions());
-	for (it->SeekToFirst(); it->Valid(); it->Next()) {
-		Metadata f(it->value().ToString());
-		if (f.pinned())
-			ss << it->key().ToString() << " : " << f.tier_path() << std::endl;
-	}
+	Metadata::scan_pins(db_, [&ss](const std::string &path, const Metadata &f) {
+		ss << path << " : " << f.tier_path() << std::endl;
+	});
 	payload.push_back(ss.str());
 	socket_server_.send_data_async(payload);
 }
 
-void TierEngineAdhoc::process_list_popularity(void) {
+void TierEngineAdhoc::process_list_popularity(const AdHoc &work) {
 	std::vector<std::string> payload;
+	bool ascending = false;
+	double min = -std::numeric_limits<double>::infinity();
+	double max = std::numeric_limits<double>::infinity();
+	size_t limit = 0;
+	bool valid = work.args_.empty();
+	try {
+		if (work.args_.size() == 2 && (work.args_[0] == "top" || work.args_[0] == "bottom")) {
+			ascending = work.args_[0] == "bottom";
+			limit = std::stoul(work.args_[1]);
+			valid = limit > 0 && work.args_[1][0] != '-';
+		} else if (work.args_.size() == 3 && work.args_[0] == "range") {
+			min = std::stod(work.args_[1]);
+			max = std::stod(work.args_[2]);
+			valid = min <= max;
+		}
+	} catch (const std::logic_error &) {
+		valid = false;
+	}
+	if (!valid) {
+		payload.push_back("ERR");
+		payload.push_back(
+			"Usage: autotier list-popularity [top <N> | bottom <N> | range <min> <max>]");
+		socket_server_.send_data_async(payload);
+		return;
+	}
 	payload.push_back("OK");
 	std::stringstream ss;
 	ss << "File : Popularity (accesses per hour)" << std::endl;
-	rocksdb::Iterator *it = db_->NewIterator(rocksdb::ReadOptions());
-	for (it->SeekToFirst(); it->Valid(); it->Next()) {
-		Metadata f(it->value().ToString());
-		ss << it->key().ToString() << " : " << f.popularity() << std::endl;
+	Metadata::scan_popularity(
+		db_, ascending, min, max, limit, [&ss](const std::string &path, double popularity) {
+			ss << path << " : " << popularity << std::endl;
+		});
+	payload.push_back(ss.str());
+	socket_server_.send_data_async(payload);
+}
+
+void TierEngineAdhoc::process_list_tier(const AdHoc &work) {
+	std::vector<std::string> payload;
+	Tier *tptr = nullptr;
+	bool valid = !work.args_.empty() && work.args_.size() <= 2
+				 && (tptr = tier_lookup(work.args_.front())) != nullptr;
+	if (valid && work.args_.size() == 2)
+		valid = work.args_[1] == "size" || work.args_[1] == "popularity";
+	if (!valid) {
+		payload.push_back("ERR");
+		payload.push_back("Usage: autotier list-tier <\"tier name\"> [size | popularity]");
+		socket_server_.send_data_async(payload);
+		return;
 	}
+	struct Entry {
+		std::string path_;
+		uint64_t size_;
+		double popularity_;
+	};
+	std::vector<Entry> entries;
+	ffd::Bytes usage(0);
+	Metadata::scan_tier(
+		db_, tptr->path().string(), [&](const std::string &path, const Metadata &f, uint64_t size) {
+			entries.push_back(Entry{ path, size, f.popularity() });
+			usage += ffd::Bytes(size);
+		});
+	// index order is by key, only the files of this tier are sorted
+	if (work.args_.size() == 2 && work.args_[1] == "size") {
+		std::stable_sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) {
+			return a.size_ > b.size_;
+		});
+	} else if (work.args_.size() == 2) {
+		std::stable_sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) {
+			return a.popularity_ > b.popularity_;
+		});
+	}
+	payload.push_back("OK");
+	std::stringstream ss;
+	ss << "File : Size : Popularity (accesses per hour)" << std::endl;
+	for (const Entry &entry : entries)
+		ss << entry.path_ << " : " << ffd::Bytes(entry.size_).get_str() << " : "
+		   << entry.popularity_ << std::endl;
+	ss << "Total: " << usage.get_str() << " in " << entries.size() << " files" << std::endl;
 	payload.push_back(ss.str());
 	socket_server_.send_data_async(payload);
 }
@@ -493,6 +611,10 @@ void TierEngineAdhoc::execute_queued_work(void) {
 				oneshot_in_queue_ = false;
 				tier();
 				break;
+			case RESCAN:
+				rescan_requested_ = true;
+				tier();
+				break;
 			case PIN:
 				pin_files(work.args_);
 				break;
@@ -523,11 +645,11 @@ void TierEngineAdhoc::pin_files(const std::vector<std::string> &args) {
 			Logging::log.warning("File to be pinned was not in database: " + mounted_path.string());
 			continue;
 		}
-		f.pinned(true);
+		journal_.record(ChangeJournal::MODIFIED, relative_path.c_str());
 		fs::path old_path = f.tier_path() / relative_path;
 		fs::path new_path = tptr->path() / relative_path;
 		if (old_path == new_path) {
-			f.update(relative_path.string(), db_);
+			Metadata::set_pinned(relative_path.string(), db_, true);
 			return;
 		}
 		struct stat st;
@@ -540,14 +662,22 @@ void TierEngineAdhoc::pin_files(const std::vector<std::string> &args) {
 		times[0].tv_usec = st.st_atim.tv_nsec / 1000;
 		times[1].tv_sec = st.st_mtim.tv_sec;
 		times[1].tv_usec = st.st_mtim.tv_nsec / 1000;
-		if (tptr->move_file(old_path, new_path, config_.copy_buff_sz())) {
+		MoveMethod method = MoveMethod::BUFFERED;
+		for (const Tier &t : tiers_) {
+			if (t.path() == f.tier_path())
+				method = tptr->move_method(&t);
+		}
+		if (tptr->move_file(old_path, new_path, config_.copy_buff_sz(), method)) {
 			if (utimes(new_path.c_str(), times) == -1) {
 				int error = errno;
 				Logging::log.error("Failed to set utimes of " + new_path.string() + ": "
 								   + strerror(error));
 			}
-			f.tier_path(tptr->path().string());
-			f.update(relative_path.string(), db_);
+			Metadata::set_tier_path(
+				relative_path.string(), db_, tptr->path().string(), st.st_size, f.tier_path());
+			Metadata::set_pinned(relative_path.string(), db_, true);
+			path_cache_.invalidate(relative_path.c_str());
+			KernelCache::invalidate(relative_path.c_str());
 		}
 	}
 	if (!config_.strict_period())
@@ -562,8 +692,8 @@ void TierEngineAdhoc::unpin_files(const std::vector<std::string> &args) {
 			Logging::log.warning("File to be unpinned was not in database: " + mounted_path);
 			continue;
 		}
-		f.pinned(false);
-		f.update(relative_path.c_str(), db_);
+		Metadata::set_pinned(relative_path.string(), db_, false);
+		journal_.record(ChangeJournal::MODIFIED, relative_path.c_str());
 	}
 }
 
@@ -31,7 +31,11 @@ TierEngineBase::TierEngineBase(const fs::path &config_path, const ConfigOverride
 	, config_(config_path, std::ref(tiers_), config_overrides)
 	, run_path_(config_.run_path())
 	, sleep_cv_()
-	, db_(nullptr) {}
+	, db_(nullptr)
+	, journal_()
+	, rescan_requested_(false)
+	, access_cache_()
+	, path_cache_() {}
 
 TierEngineBase::~TierEngineBase(void) {}
 
@@ -95,6 +99,22 @@ void TierEngineBase::mount_point(const fs::path &mount_point) {
 	mount_point_ = mount_point;
 }
 
+ChangeJournal &TierEngineBase::get_journal(void) {
+	return journal_;
+}
+
+AccessCache &TierEngineBase::get_access_cache(void) {
+	return access_cache_;
+}
+
+PathCache &TierEngineBase::get_path_cache(void) {
+	return path_cache_;
+}
+
+const Config &TierEngineBase::get_config(void) const {
+	return config_;
+}
+
 bool TierEngineBase::tier(void) {
 	Logging::log.error("Virtual TierEngineBase::tier() called!");
 	exit(EXIT_FAILURE);
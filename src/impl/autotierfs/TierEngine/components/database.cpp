@@ -20,10 +20,12 @@
 #include "TierEngine/components/database.hpp"
 
 #include "alert.hpp"
+#include "metadata.hpp"
 #include "rocksDbHelpers.hpp"
 
 auto rocksdb_deleter = [](rocksdb::DB *db) {
 	Logging::log.message("Deleting db", Logger::DEBUG);
+	Metadata::close_column_families(db);
 	delete db;
 };
 
@@ -43,13 +45,24 @@ void TierEngineDatabase::open_db(void) {
 	std::string db_path = (run_path_ / "db").string();
 	rocksdb::Options options;
 	options.create_if_missing = true;
+	options.create_missing_column_families = true;
 	options.prefix_extractor.reset(l::NewPathSliceTransform());
 	rocksdb::Status status;
 	rocksdb::DB *db_ptr;
-	status = rocksdb::DB::Open(options, db_path, &db_ptr);
-	db_ = std::shared_ptr<rocksdb::DB>{ db_ptr, rocksdb_deleter };
+	std::vector<rocksdb::ColumnFamilyHandle *> handles;
+	status = rocksdb::DB::Open(
+		options, db_path, Metadata::column_families(options), &handles, &db_ptr);
 	if (!status.ok()) {
 		Logging::log.error("Failed to open RocksDB database: " + db_path);
 		exit(EXIT_FAILURE);
 	}
+	Metadata::open_column_families(handles);
+	db_ = std::shared_ptr<rocksdb::DB>{ db_ptr, rocksdb_deleter };
+	std::vector<std::string> tier_paths;
+	for (const Tier &tier : tiers_)
+		tier_paths.push_back(tier.path().string());
+	Metadata::load_tier_ids(db_, tier_paths);
+	Metadata::split_stats(db_);
+	Metadata::index_pins(db_);
+	Metadata::use_directory_keys(db_, config_.directory_keys());
 }
@@ -21,13 +21,22 @@
 
 #include "alert.hpp"
 #include "file.hpp"
+#include "radixSort.hpp"
 
+#include <boost/archive/binary_iarchive.hpp>
+#include <boost/archive/binary_oarchive.hpp>
+#include <boost/serialization/string.hpp>
+#include <boost/serialization/vector.hpp>
+#include <fstream>
 #include <regex>
 #include <thread>
+#include <unordered_set>
 
-#if __cplusplus >= 201703L
-#	include <execution>
-#endif
+extern "C" {
+#include <sys/stat.h>
+}
+
+#define FILE_TABLE_VERSION 4 ///< Bump when FileTable::serialize() changes
 
 TierEngineTiering::TierEngineTiering(const fs::path &config_path,
 									 const ConfigOverrides &config_overrides)
@@ -35,12 +44,48 @@ TierEngineTiering::TierEngineTiering(const fs::path &config_path,
 	, TierEngineDatabase(config_path, config_overrides)
 	, TierEngineSleep(config_path, config_overrides)
 	, TierEngineAdhoc(config_path, config_overrides)
-	, TierEngineMutex(config_path, config_overrides) {}
+	, TierEngineMutex(config_path, config_overrides)
+	, currently_tiering_(false)
+	, file_table_valid_(false)
+	, crawled_(false) {
+	if (tiers_.size() > FILE_TABLE_MAX_TIERS) {
+		Logging::log.error("More than " + std::to_string(FILE_TABLE_MAX_TIERS)
+						   + " tiers defined.");
+		exit(EXIT_FAILURE);
+	}
+	for (std::list<Tier>::iterator t = tiers_.begin(); t != tiers_.end(); ++t) {
+		t->parallel_copy(config_.parallel_copy_threshold(), config_.parallel_copy_threads());
+		tier_ptrs_.push_back(&(*t));
+	}
+	for (Tier *dest : tier_ptrs_) {
+		for (const Tier *source : tier_ptrs_) {
+			if (source != dest)
+				dest->probe_move_method(*source);
+		}
+	}
+	mover_pool_.reset(new MoverPool(tier_ptrs_,
+									config_.mover_threads(),
+									config_.copy_buff_sz(),
+									config_.copy_queue_depth(),
+									run_path_,
+									db_,
+									path_cache_));
+	if (config_.incremental_tiering()) {
+		journal_.open(run_path_ / "journal");
+	} else {
+		// stale journal or table would be missing changes made while disabled
+		boost::system::error_code ec;
+		fs::remove(run_path_ / "journal", ec);
+		fs::remove(run_path_ / "file_table", ec);
+	}
+}
 
 TierEngineTiering::~TierEngineTiering() {}
 
 void TierEngineTiering::begin(bool daemon_mode) {
 	Logging::log.message("autotier started.", Logger::log_level_t::NORMAL);
+	if (journal_.is_open())
+		file_table_valid_ = load_file_table();
 	bool tier_result;
 	if (config_.tier_period_s() < std::chrono::seconds(0)) {
 		last_tier_time_ = std::chrono::steady_clock::now();
@@ -70,7 +115,7 @@ bool TierEngineTiering::tier(void) {
 			return false;
 		}
 		currently_tiering_ = true;
-		launch_crawlers(&TierEngineTiering::emplace_file);
+		gather_files();
 		// one popularity calculation per loop
 		calc_popularity();
 		// mutex locked
@@ -79,51 +124,260 @@ bool TierEngineTiering::tier(void) {
 		move_files();
 		update_db();
 		Logging::log.message("Tiering complete.", Logger::log_level_t::DEBUG);
-		files_.clear();
+		if (!file_table_valid_)
+			files_.clear();
 		currently_tiering_ = false;
 		unlock_mutex();
 	}
 	return true;
 }
 
-void TierEngineTiering::launch_crawlers(void (TierEngineTiering::*function)(
-	fs::directory_entry &itr, Tier *tptr, std::atomic<ffd::Bytes::bytes_type> &usage)) {
+void TierEngineTiering::gather_files(void) {
+	// counts must reach the database before files are read from it
+	access_cache_.flush();
+	crawled_ = false;
+	if (file_table_valid_ && !rescan_requested_) {
+		std::vector<ChangeJournal::Entry> entries;
+		if (journal_.drain(entries)) {
+			apply_journal(entries);
+			return;
+		}
+		Logging::log.warning("Change journal is incomplete, crawling all tiers.");
+	}
+	rescan_requested_ = false;
+	crawled_ = true;
+	files_.clear();
+	// changes made while crawling are journaled and reapplied next cycle
+	journal_.clear();
+	launch_crawlers(&TierEngineTiering::emplace_file);
+	file_table_valid_ = journal_.is_open();
+}
+
+void TierEngineTiering::apply_journal(const std::vector<ChangeJournal::Entry> &entries) {
+	Logging::log.message("Applying " + std::to_string(entries.size()) + " journaled changes.",
+						 Logger::log_level_t::DEBUG);
+	if (entries.empty())
+		return;
+	auto starts_with = [](const std::string &str, const std::string &prefix) {
+		return str.compare(0, prefix.size(), prefix) == 0;
+	};
+	std::unordered_set<std::string> dirty;
+	for (const ChangeJournal::Entry &entry : entries) {
+		if (entry.op_ != ChangeJournal::RENAMED) {
+			dirty.insert(entry.path_);
+			continue;
+		}
+		// paths dirtied before the rename now live under the new name
+		std::string old_prefix = entry.path_ + "/";
+		std::string new_prefix = entry.new_path_ + "/";
+		std::vector<std::string> renamed;
+		for (std::unordered_set<std::string>::iterator itr = dirty.begin(); itr != dirty.end();) {
+			if (starts_with(*itr, old_prefix)) {
+				renamed.push_back(new_prefix + itr->substr(old_prefix.size()));
+				itr = dirty.erase(itr);
+			} else {
+				++itr;
+			}
+		}
+		dirty.insert(renamed.begin(), renamed.end());
+		files_.rename_dirs(entry.path_, entry.new_path_);
+	}
+	// group by directory so rows are matched on their interned directory and name
+	std::unordered_map<std::string, std::unordered_set<std::string>> dirty_names;
+	for (const std::string &relative_path : dirty) {
+		size_t slash = relative_path.rfind('/');
+		if (slash == std::string::npos)
+			dirty_names[""].insert(relative_path);
+		else
+			dirty_names[relative_path.substr(0, slash)].insert(relative_path.substr(slash + 1));
+	}
+	files_.erase_if([this, &dirty_names](FileTable::row_type row) {
+		std::unordered_map<std::string, std::unordered_set<std::string>>::const_iterator itr =
+			dirty_names.find(files_.dir(row));
+		return itr != dirty_names.end() && itr->second.count(files_.name(row)) != 0;
+	});
+	for (const std::string &relative_path : dirty) {
+		Metadata metadata(relative_path, db_, nullptr, true);
+		if (metadata.not_found())
+			continue;
+		Tier *tptr = tier_lookup(fs::path(metadata.tier_path()));
+		if (tptr == nullptr)
+			continue;
+		fs::path full_path = tptr->path() / relative_path;
+		struct stat st;
+		if (lstat(full_path.c_str(), &st) == -1 || S_ISDIR(st.st_mode) || S_ISLNK(st.st_mode))
+			continue;
+		uint8_t tier = tier_index(tptr);
+		if (tier == NO_TIER_INDEX) {
+			Logging::log.warning("Skipping " + relative_path + ", " + tptr->id()
+								 + " is not being tiered.");
+			continue;
+		}
+		files_.emplace_back(relative_path, tier, st, metadata);
+	}
+}
+
+void TierEngineTiering::save_file_table(void) {
+	if (!file_table_valid_)
+		return;
+	journal_.flush();
+	fs::path table_path = run_path_ / "file_table";
+	fs::path tmp_path = run_path_ / "file_table.tmp";
+	{
+		std::ofstream ofs(tmp_path.string(), std::ios::binary | std::ios::trunc);
+		if (!ofs) {
+			Logging::log.warning("Failed to open " + tmp_path.string()
+								 + ", next mount will crawl all tiers.");
+			return;
+		}
+		std::vector<std::string> tier_paths;
+		std::vector<ffd::Bytes::bytes_type> usage;
+		for (const Tier *tptr : tier_ptrs_) {
+			tier_paths.push_back(tptr->path().string());
+			usage.push_back(tptr->usage_bytes().get());
+		}
+		unsigned int version = FILE_TABLE_VERSION;
+		boost::archive::binary_oarchive oa(ofs);
+		oa << version;
+		oa << tier_paths;
+		oa << usage;
+		oa << files_;
+	}
+	boost::system::error_code ec;
+	fs::rename(tmp_path, table_path, ec);
+	if (ec)
+		Logging::log.warning("Failed to save file table: " + ec.message());
+	else
+		Logging::log.message("Saved " + std::to_string(files_.size()) + " files to file table.",
+							 Logger::log_level_t::DEBUG);
+}
+
+bool TierEngineTiering::load_file_table(void) {
+	fs::path table_path = run_path_ / "file_table";
+	std::ifstream ifs(table_path.string(), std::ios::binary);
+	if (!ifs)
+		return false;
+	bool valid = true;
+	std::vector<std::string> tier_paths;
+	std::vector<ffd::Bytes::bytes_type> usage;
+	try {
+		unsigned int version;
+		boost::archive::binary_iarchive ia(ifs);
+		ia >> version;
+		if (version != FILE_TABLE_VERSION)
+			throw std::runtime_error("version mismatch");
+		ia >> tier_paths;
+		ia >> usage;
+		ia >> files_;
+	} catch (const std::exception &e) {
+		Logging::log.warning(std::string("Failed to load file table: ") + e.what());
+		valid = false;
+	}
+	ifs.close();
+	boost::system::error_code ec;
+	fs::remove(table_path, ec);
+	// rows store tier indices, so tiers must be the same and in the same order
+	if (valid && (tier_paths.size() != tier_ptrs_.size() || usage.size() != tier_ptrs_.size()))
+		valid = false;
+	for (size_t i = 0; valid && i < tier_paths.size(); ++i) {
+		if (tier_ptrs_[i]->path().string() != tier_paths[i])
+			valid = false;
+	}
+	if (!valid) {
+		Logging::log.message("File table does not match tiers, crawling all tiers.",
+							 Logger::log_level_t::DEBUG);
+		files_.clear();
+		return false;
+	}
+	for (size_t i = 0; i < tier_ptrs_.size(); ++i)
+		tier_ptrs_[i]->usage(ffd::Bytes{ usage[i] });
+	Logging::log.message("Loaded " + std::to_string(files_.size()) + " files from file table.",
+						 Logger::log_level_t::DEBUG);
+	return true;
+}
+
+void TierEngineTiering::launch_crawlers(CrawlFunction function) {
 	Logging::log.message("Gathering files.", Logger::log_level_t::DEBUG);
-	// get ordered list of files in each tier
-	for (std::list<Tier>::iterator t = tiers_.begin(); t != tiers_.end(); ++t) {
-		std::atomic<ffd::Bytes::bytes_type> usage(0);
-		crawl(t->path(), &(*t), function, usage);
-		t->usage(ffd::Bytes{ usage });
+	size_t n_workers = config_.crawler_threads();
+	WorkStealingQueue<CrawlItem> queue(n_workers);
+	std::vector<CrawlBuffer> buffers(n_workers);
+	// seed each tier root into a different lane so workers start on separate tiers
+	size_t lane = 0;
+	for (std::list<Tier>::iterator t = tiers_.begin(); t != tiers_.end(); ++t)
+		queue.push(lane++, CrawlItem{ t->path(), &(*t) });
+	std::vector<std::thread> threads;
+	for (size_t worker = 0; worker < n_workers; ++worker) {
+		threads.emplace_back(&TierEngineTiering::crawl,
+							 this,
+							 worker,
+							 std::ref(queue),
+							 function,
+							 std::ref(buffers[worker]));
+	}
+	for (auto &thread : threads) {
+		thread.join();
 	}
+	size_t n_files = files_.size();
+	for (const CrawlBuffer &buffer : buffers)
+		n_files += buffer.files_.size();
+	files_.reserve(n_files);
+	std::unordered_map<Tier *, ffd::Bytes::bytes_type> usage;
+	for (CrawlBuffer &buffer : buffers) {
+		files_.append(std::move(buffer.files_));
+		for (const std::pair<Tier *const, ffd::Bytes::bytes_type> &tier_usage : buffer.usage_)
+			usage[tier_usage.first] += tier_usage.second;
+	}
+	for (std::list<Tier>::iterator t = tiers_.begin(); t != tiers_.end(); ++t)
+		t->usage(ffd::Bytes{ usage[&(*t)] });
 }
 
-void TierEngineTiering::crawl(
-	fs::path dir,
-	Tier *tptr,
-	void (TierEngineTiering::*function)(fs::directory_entry &itr,
-										Tier *tptr,
-										std::atomic<ffd::Bytes::bytes_type> &usage),
-	std::atomic<ffd::Bytes::bytes_type> &usage) {
-	// TODO: Replace this with multithreaded BFS
-	std::regex temp_file_re("\\.[^/]*\\.autotier\\.hide$");
-	for (fs::directory_iterator itr{ dir }; itr != fs::directory_iterator{}; *itr++) {
-		fs::file_status status = fs::symlink_status(*itr);
-		if (fs::is_directory(status)) {
-			crawl(*itr, tptr, function, usage);
-		} else if (!is_symlink(status) && !std::regex_match(itr->path().string(), temp_file_re)) {
-			(this->*function)(*itr, tptr, usage);
+void TierEngineTiering::crawl(size_t worker,
+							  WorkStealingQueue<CrawlItem> &queue,
+							  CrawlFunction function,
+							  CrawlBuffer &buffer) {
+	std::regex temp_file_re("^\\..*\\.autotier\\.hide$");
+	CrawlItem item;
+	while (queue.pop(worker, item)) {
+		try {
+			for (fs::directory_iterator itr{ item.dir_ }; itr != fs::directory_iterator{}; ++itr) {
+				fs::file_status status = itr->symlink_status();
+				if (fs::is_directory(status)) {
+					queue.push(worker, CrawlItem{ itr->path(), item.tptr_ });
+				} else if (!fs::is_symlink(status)
+						   && !std::regex_match(itr->path().filename().string(), temp_file_re)) {
+					try {
+						(this->*function)(*itr, item.tptr_, buffer);
+					} catch (const std::exception &e) {
+						// e.g. a corrupt record, one file must not end the crawler thread
+						Logging::log.warning("Skipping " + itr->path().string() + ": "
+											 + e.what());
+					}
+				}
+			}
+		} catch (const fs::filesystem_error &e) {
+			Logging::log.warning("Failed to crawl " + item.dir_.string() + ": " + e.what());
 		}
+		queue.task_done();
 	}
 }
 
-void TierEngineTiering::emplace_file(fs::directory_entry &file,
-									 Tier *tptr,
-									 std::atomic<ffd::Bytes::bytes_type> &usage) {
-	File f(file.path(), db_, tptr);
-	usage += f.size().get();
-	if (!f.is_pinned()) {
-		files_.emplace_back(std::move(f));
+void TierEngineTiering::emplace_file(fs::directory_entry &file, Tier *tptr, CrawlBuffer &buffer) {
+	const std::string &full_path = file.path().string();
+	size_t prefix = tptr->path().string().size();
+	while (prefix < full_path.size() && full_path[prefix] == '/')
+		++prefix;
+	std::string relative_path = full_path.substr(prefix);
+	uint8_t tier = tier_index(tptr);
+	if (tier == NO_TIER_INDEX) {
+		Logging::log.warning("Skipping " + relative_path + ", " + tptr->id()
+							 + " is not being tiered.");
+		return;
 	}
+	struct stat st;
+	if (lstat(full_path.c_str(), &st) == -1)
+		return;
+	buffer.usage_[tptr] += st.st_size;
+	buffer.files_.emplace_back(relative_path, tier, st, Metadata(relative_path, db_, tptr, true));
 }
 
 void TierEngineTiering::calc_popularity(void) {
@@ -135,71 +389,199 @@ void TierEngineTiering::calc_popularity(void) {
 		std::chrono::duration_cast<std::chrono::duration<double, std::ratio<1, 1>>>(period).count();
 	Logging::log.message("Real period for popularity calc: " + std::to_string(period_d),
 						 Logger::log_level_t::DEBUG);
-	for (std::vector<File>::iterator f = files_.begin(); f != files_.end(); ++f) {
-		f->calc_popularity(period_d);
-	}
+	files_.calc_popularity(period_d);
 }
 
 void TierEngineTiering::sort(void) {
 	Logging::log.message("Sorting files.", Logger::log_level_t::DEBUG);
-	std::sort(
-#if __cplusplus >= 201703L
-		std::execution::par,
-#endif
-		files_.begin(),
-		files_.end(),
-		[](const File &a, const File &b) {
-			double a_pop = a.popularity();
-			double b_pop = b.popularity();
-			if (a_pop == b_pop) {
-				struct timeval a_t = a.atime();
-				struct timeval b_t = b.atime();
-				if (a_t.tv_sec == b_t.tv_sec)
-					return a_t.tv_usec > b_t.tv_usec;
-				return a_t.tv_sec > b_t.tv_sec;
-			}
-			return a_pop > b_pop;
-		});
+	// inverted keys so ascending radix order is most popular, then most recent, first
+	std::vector<SortKey> keys(files_.size());
+	for (FileTable::row_type row = 0; row < keys.size(); ++row)
+		keys[row] =
+			SortKey{ ~double_key(files_.popularity(row)), ~int64_key(files_.atime(row)), row };
+	radix_sort(keys, std::thread::hardware_concurrency());
+	std::vector<FileTable::row_type> order(keys.size());
+	for (size_t i = 0; i < keys.size(); ++i)
+		order[i] = keys[i].row_;
+	std::vector<SortKey>().swap(keys);
+	files_.permute(order);
 }
 
 void TierEngineTiering::simulate_tier(void) {
 	Logging::log.message("Finding files' tiers.", Logger::log_level_t::DEBUG);
 	for (Tier &t : tiers_)
 		t.reset_sim();
-	for (std::vector<File>::iterator fitr = files_.begin(); fitr != files_.end(); ++fitr) {
-		ffd::Bytes file_size = fitr->size();
-		std::list<Tier>::iterator titr = tiers_.begin();
-		for (; titr != tiers_.end(); ++titr) {
-			if (!titr->full_test(file_size)) {
+	moving_files_.clear();
+	moving_rows_.clear();
+	std::vector<uint8_t> targets(files_.size());
+	// pinned files stay where they are, count them first
+	for (FileTable::row_type row = 0; row < files_.size(); ++row) {
+		targets[row] = files_.tier(row);
+		if (files_.pinned(row))
+			tier_ptrs_[files_.tier(row)]->add_file_size_sim(ffd::Bytes(placed_size(row)));
+	}
+	if (config_.minimal_movement())
+		plan_minimal_movement(targets);
+	else
+		plan_greedy(targets);
+	size_t n_tiers = tier_ptrs_.size();
+	std::vector<ffd::Bytes::bytes_type> planned_bytes(n_tiers * n_tiers, 0);
+	std::vector<size_t> planned_files(n_tiers * n_tiers, 0);
+	for (FileTable::row_type row = 0; row < files_.size(); ++row) {
+		if (targets[row] == files_.tier(row))
+			continue;
+		moving_rows_.push_back(row);
+		planned_bytes[files_.tier(row) * n_tiers + targets[row]] += placed_size(row);
+		planned_files[files_.tier(row) * n_tiers + targets[row]]++;
+	}
+	for (size_t from = 0; from < n_tiers; ++from) {
+		for (size_t to = 0; to < n_tiers; ++to) {
+			if (planned_files[from * n_tiers + to] == 0)
+				continue;
+			Logging::log.message("Planned move from " + tier_ptrs_[from]->id() + " to "
+									 + tier_ptrs_[to]->id() + ": "
+									 + Logging::log.format_bytes(planned_bytes[from * n_tiers + to])
+									 + " in " + std::to_string(planned_files[from * n_tiers + to])
+									 + " files.",
+								 Logger::log_level_t::NORMAL);
+		}
+	}
+	// File objects are only built for files that move, reserved so pointers stay valid
+	moving_files_.reserve(moving_rows_.size());
+	for (FileTable::row_type row : moving_rows_) {
+		moving_files_.emplace_back(files_.file(row, tier_ptrs_[files_.tier(row)]));
+		mover_pool_->enqueue(&moving_files_.back(), files_.tier(row), targets[row]);
+	}
+}
+
+void TierEngineTiering::plan_greedy(std::vector<uint8_t> &targets) {
+	for (FileTable::row_type row = 0; row < files_.size(); ++row) {
+		if (files_.pinned(row))
+			continue;
+		ffd::Bytes file_size(placed_size(row));
+		size_t t = 0;
+		for (; t < tier_ptrs_.size(); ++t) {
+			if (!tier_ptrs_[t]->full_test(file_size)) {
 				// file fits
-				titr->add_file_size_sim(file_size);
-				if (fitr->tier_ptr() != &(*titr))
-					titr->enqueue_file_ptr(&(*fitr));
+				tier_ptrs_[t]->add_file_size_sim(file_size);
+				targets[row] = t;
 				break;
 			}
 		}
-		if (titr == tiers_.end()) {
+		if (t == tier_ptrs_.size()) {
 			// could not find place for file
-			Logging::log.error("Could not fit file in any tiers: `" + fitr->full_path().string() + "`");
+			Logging::log.error("Could not fit file in any tiers: `"
+							   + (tier_ptrs_[files_.tier(row)]->path() / files_.relative_path(row))
+									 .string()
+							   + "`");
+		}
+	}
+}
+
+void TierEngineTiering::plan_minimal_movement(std::vector<uint8_t> &targets) {
+	size_t n_tiers = tier_ptrs_.size();
+	// greedy placement gives each file's ideal tier and where each tier boundary falls
+	std::vector<uint8_t> ideal(targets);
+	plan_greedy(ideal);
+	std::vector<ffd::Bytes::bytes_type> boundary(n_tiers, 0); ///< end of tier in sorted order
+	for (FileTable::row_type row = 0; row < files_.size(); ++row) {
+		if (!files_.pinned(row))
+			boundary[ideal[row]] += placed_size(row);
+	}
+	for (size_t t = 1; t < n_tiers; ++t)
+		boundary[t] += boundary[t - 1];
+	std::vector<ffd::Bytes::bytes_type> band(n_tiers);
+	for (size_t t = 0; t < n_tiers; ++t)
+		band[t] = tier_ptrs_[t]->capacity().get() / 100 * config_.hysteresis();
+
+	// only cross a boundary when clearly past it
+	ffd::Bytes::bytes_type position = 0;
+	for (FileTable::row_type row = 0; row < files_.size(); ++row) {
+		if (files_.pinned(row))
+			continue;
+		uint8_t current = files_.tier(row);
+		ffd::Bytes::bytes_type file_size = placed_size(row);
+		if (ideal[row] < current) {
+			ffd::Bytes::bytes_type top = boundary[current - 1];
+			if (position + file_size + band[current - 1] <= top)
+				targets[row] = ideal[row];
+		} else if (ideal[row] > current) {
+			if (position >= boundary[current] + band[current])
+				targets[row] = ideal[row];
+		}
+		position += file_size;
+	}
+
+	// files held back by the band can overfill a tier, demote its least popular files
+	for (Tier &t : tiers_)
+		t.reset_sim();
+	for (FileTable::row_type row = 0; row < files_.size(); ++row)
+		tier_ptrs_[targets[row]]->add_file_size_sim(ffd::Bytes(placed_size(row)));
+	for (size_t t = 0; t + 1 < n_tiers; ++t) {
+		for (FileTable::row_type row = files_.size(); row-- > 0;) {
+			if (!tier_ptrs_[t]->full_test(ffd::Bytes(0)))
+				break;
+			if (targets[row] != t || files_.pinned(row))
+				continue;
+			ffd::Bytes file_size(placed_size(row));
+			tier_ptrs_[t]->subtract_file_size_sim(file_size);
+			tier_ptrs_[t + 1]->add_file_size_sim(file_size);
+			targets[row] = t + 1;
 		}
 	}
+	if (tier_ptrs_.back()->full_test(ffd::Bytes(0)))
+		Logging::log.error("Planned placement leaves " + tier_ptrs_.back()->id() + " over quota.");
 }
 
 void TierEngineTiering::move_files(void) {
-	std::vector<std::thread> threads;
 	Logging::log.message("Moving files.", Logger::log_level_t::DEBUG);
-	for (std::list<Tier>::iterator titr = tiers_.begin(); titr != tiers_.end(); ++titr) {
-		threads.emplace_back(&Tier::transfer_files, titr, config_.copy_buff_sz(), run_path_, std::ref(db_));
-	}
-	for (auto &thread : threads) {
-		thread.join();
+	mover_pool_->wait();
+	for (size_t i = 0; i < moving_rows_.size(); ++i) {
+		const File &f = moving_files_[i];
+		FileTable::row_type row = moving_rows_[i];
+		std::string relative_path = f.relative_path().string();
+		uint8_t tier = tier_index(f.tier_ptr());
+		if (tier == NO_TIER_INDEX)
+			Logging::log.warning("Keeping last known tier of " + relative_path
+								 + ", it was moved to a tier not being tiered.");
+		else
+			files_.tier(row, tier);
+		if (relative_path != files_.relative_path(row)) // renamed after conflict
+			files_.rename(row, relative_path);
 	}
+	moving_files_.clear();
+	moving_rows_.clear();
 }
 
 void TierEngineTiering::update_db(void) {
-	for (File &f : files_) {
-		f.update_db(db_);
+	// after a crawl the index is rebuilt, else only rows that changed are written back
+	PopularityIndexWriter popularity_index(db_, !crawled_);
+	bool all = !popularity_index.incremental();
+	for (FileTable::row_type row = 0; row < files_.size(); ++row) {
+		if (!all && !files_.needs_write(row))
+			continue;
+		std::string relative_path = files_.relative_path(row);
+		if (!files_.pinned(row)) {
+			// merged so accesses counted and pins set while tiering are kept
+			if (all || files_.dirty(row))
+				Metadata::set_tier_path(relative_path,
+										db_,
+										tier_ptrs_[files_.tier(row)]->path().string(),
+										files_.file_size(row));
+			Metadata::set_popularity(
+				relative_path, db_, files_.popularity(row), files_.access_count(row));
+		}
+		if (all)
+			popularity_index.add(relative_path, files_.popularity(row));
+		else
+			popularity_index.update(
+				relative_path, files_.written_popularity(row), files_.popularity(row));
+		files_.written(row);
 	}
+	popularity_index.commit();
+	files_.reset_access_counts();
+	// files created behind autotier's back now have records
+	path_cache_.forget_missing();
 }
 
 void TierEngineTiering::stop(void) {
@@ -217,6 +599,18 @@ bool TierEngineTiering::strict_period(void) const {
 	return config_.strict_period();
 }
 
+uint8_t TierEngineTiering::tier_index(const Tier *tptr) const {
+	for (size_t i = 0; i < tier_ptrs_.size(); ++i) {
+		if (tier_ptrs_[i] == tptr)
+			return i;
+	}
+	return NO_TIER_INDEX;
+}
+
+uint64_t TierEngineTiering::placed_size(FileTable::row_type row) const {
+	return config_.place_by_allocated_size() ? files_.alloc_size(row) : files_.file_size(row);
+}
+
 void TierEngineTiering::exit(int status) {
 	Logging::log.message("Ensuring mutex is unlocked before exiting.", Logger::log_level_t::DEBUG);
 	unlock_mutex();
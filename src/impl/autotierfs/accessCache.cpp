@@ -0,0 +1,191 @@
+/*
+ *    Copyright (C) 2019-2021 Joshua Boudreau <jboudreau@45drives.com>
+ *
+ *    This file is part of autotier.
+ *
+ *    autotier is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    autotier is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with autotier.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "accessCache.hpp"
+
+#include "metadata.hpp"
+#include "rocksDbHelpers.hpp"
+
+#include <functional>
+#include <vector>
+
+AccessCache::AccessCache(void) : paths_(0), stop_flag_(false) {}
+
+AccessCache::~AccessCache(void) {
+	stop();
+}
+
+void AccessCache::start(std::shared_ptr<rocksdb::DB> db) {
+	std::lock_guard<std::mutex> lk(sleep_mt_);
+	if (flusher_.joinable())
+		return;
+	db_ = db;
+	stop_flag_ = false;
+	flusher_ = std::thread(&AccessCache::flush_loop, this);
+}
+
+void AccessCache::stop(void) {
+	{
+		std::lock_guard<std::mutex> lk(sleep_mt_);
+		if (!flusher_.joinable())
+			return;
+		stop_flag_ = true;
+		sleep_cv_.notify_one();
+	}
+	flusher_.join();
+	flush();
+}
+
+static const char *strip_slashes(const char *path) {
+	while (*path == '/')
+		++path;
+	return path;
+}
+
+void AccessCache::touch(const char *path) {
+	add(strip_slashes(path), 1);
+}
+
+void AccessCache::rename(const char *from, const char *to, bool directory) {
+	std::string from_key(strip_slashes(from));
+	std::string to_key(strip_slashes(to));
+	uintmax_t count = take(from_key);
+	if (count != 0)
+		add(to_key, count);
+	if (!directory)
+		return;
+	// directory renames are rare enough to look through every shard
+	std::string prefix = from_key + "/";
+	std::vector<std::pair<std::string, uintmax_t>> moved;
+	for (Shard &shard : shards_) {
+		std::lock_guard<std::mutex> lk(shard.mt_);
+		for (std::unordered_map<std::string, uintmax_t>::iterator itr = shard.counts_.begin();
+			 itr != shard.counts_.end();) {
+			if (itr->first.compare(0, prefix.size(), prefix) == 0) {
+				moved.emplace_back(to_key + itr->first.substr(from_key.size()), itr->second);
+				itr = shard.counts_.erase(itr);
+				--paths_;
+			} else {
+				++itr;
+			}
+		}
+		for (std::unordered_map<std::string, uintmax_t>::iterator itr = shard.flushing_.begin();
+			 itr != shard.flushing_.end();) {
+			if (itr->first.compare(0, prefix.size(), prefix) == 0) {
+				moved.emplace_back(to_key + itr->first.substr(from_key.size()), itr->second);
+				itr = shard.flushing_.erase(itr);
+			} else {
+				++itr;
+			}
+		}
+	}
+	for (std::pair<std::string, uintmax_t> &count : moved)
+		add(std::move(count.first), count.second);
+}
+
+void AccessCache::forget(const char *path) {
+	take(strip_slashes(path));
+}
+
+AccessCache::Shard &AccessCache::shard_of(const std::string &key) {
+	return shards_[std::hash<std::string>()(key) % ACCESS_CACHE_SHARDS];
+}
+
+uintmax_t AccessCache::take(const std::string &key) {
+	Shard &shard = shard_of(key);
+	uintmax_t count = 0;
+	std::lock_guard<std::mutex> lk(shard.mt_);
+	std::unordered_map<std::string, uintmax_t>::iterator itr = shard.counts_.find(key);
+	if (itr != shard.counts_.end()) {
+		count += itr->second;
+		shard.counts_.erase(itr);
+		--paths_;
+	}
+	// count swapped out by a running flush() but not merged yet
+	itr = shard.flushing_.find(key);
+	if (itr != shard.flushing_.end()) {
+		count += itr->second;
+		shard.flushing_.erase(itr);
+	}
+	return count;
+}
+
+void AccessCache::add(std::string key, uintmax_t count) {
+	Shard &shard = shard_of(key);
+	bool inserted;
+	{
+		std::lock_guard<std::mutex> lk(shard.mt_);
+		std::pair<std::unordered_map<std::string, uintmax_t>::iterator, bool> res =
+			shard.counts_.emplace(std::move(key), 0);
+		res.first->second += count;
+		inserted = res.second;
+	}
+	if (inserted && ++paths_ == ACCESS_CACHE_MAX_PATHS) {
+		std::lock_guard<std::mutex> lk(sleep_mt_);
+		sleep_cv_.notify_one();
+	}
+}
+
+void AccessCache::flush(void) {
+	if (!db_)
+		return;
+	std::lock_guard<std::mutex> flush_lk(flush_mt_);
+	std::vector<std::string> keys;
+	for (Shard &shard : shards_) {
+		{
+			std::lock_guard<std::mutex> lk(shard.mt_);
+			shard.flushing_.swap(shard.counts_);
+			paths_ -= shard.flushing_.size();
+			keys.reserve(shard.flushing_.size());
+			for (const std::pair<const std::string, uintmax_t> &count : shard.flushing_)
+				keys.push_back(count.first);
+		}
+		// rename() and unlink() move or drop the count under the same key lock, so the
+		// count is either merged before they run or taken out of flushing_ by them
+		for (const std::string &key : keys) {
+			l::rocksdb::KeyLock key_lk(key.c_str());
+			uintmax_t count;
+			{
+				std::lock_guard<std::mutex> lk(shard.mt_);
+				std::unordered_map<std::string, uintmax_t>::iterator itr =
+					shard.flushing_.find(key);
+				if (itr == shard.flushing_.end())
+					continue;
+				count = itr->second;
+				shard.flushing_.erase(itr);
+			}
+			Metadata::add_accesses(key, db_, count);
+		}
+		keys.clear();
+	}
+}
+
+void AccessCache::flush_loop(void) {
+	std::unique_lock<std::mutex> lk(sleep_mt_);
+	while (!stop_flag_) {
+		sleep_cv_.wait_for(lk, ACCESS_CACHE_FLUSH_PERIOD, [this]() {
+			return stop_flag_ || paths_ >= ACCESS_CACHE_MAX_PATHS;
+		});
+		if (stop_flag_)
+			break;
+		lk.unlock();
+		flush();
+		lk.lock();
+	}
+}
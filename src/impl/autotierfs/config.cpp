@@ -104,6 +104,32 @@ void Config::load_config(const fs::path &config_path,
 				(Logger::log_level_t)(log_level_tmp > 2 ? 2
 														: (log_level_tmp < 0 ? 0 : log_level_tmp));
 			copy_buff_sz_ = get<ffd::Bytes>("Copy Buffer Size", ffd::Bytes(1024 * 1024)).get();
+			std::string copy_engine = get<std::string>("Copy Engine", "buffered");
+			io_uring_copy_ = (copy_engine == "io_uring");
+			if (!io_uring_copy_ && copy_engine != "buffered")
+				Logging::log.warning("Invalid Copy Engine: " + copy_engine
+									 + ". Defaulting to buffered.");
+			copy_queue_depth_ = get<int>("Copy Queue Depth", 32);
+			if (copy_queue_depth_ <= 0) {
+				Logging::log.warning("Invalid number for Copy Queue Depth: "
+									 + std::to_string(copy_queue_depth_) + ". Defaulting to 32.");
+				copy_queue_depth_ = 32;
+			}
+			parallel_copy_threshold_ =
+				get<ffd::Bytes>("Parallel Copy Threshold", ffd::Bytes(1024 * 1024 * 1024)).get();
+			parallel_copy_threads_ = get<int>("Parallel Copy Threads", 1);
+			if (parallel_copy_threads_ <= 0) {
+				Logging::log.warning("Invalid number for Parallel Copy Threads: "
+									 + std::to_string(parallel_copy_threads_)
+									 + ". Defaulting to 1.");
+				parallel_copy_threads_ = 1;
+			}
+			mover_threads_ = get<int>("Mover Threads", 4);
+			if (mover_threads_ <= 0) {
+				Logging::log.warning("Invalid number for Mover Threads: "
+									 + std::to_string(mover_threads_) + ". Defaulting to 4.");
+				mover_threads_ = 4;
+			}
 			tier_period_s_ =
 				std::chrono::seconds(get<int64_t>("Tier Period", int64_t(TIER_PERIOD_DISBLED)));
 			strict_period_ = get<bool>("Strict Period", false);
@@ -113,6 +139,68 @@ void Config::load_config(const fs::path &config_path,
 									 + std::to_string(crawler_threads_) + ". Defaulting to 8.");
 				crawler_threads_ = 8;
 			}
+			incremental_tiering_ = get<bool>("Incremental Tiering", false);
+			place_by_allocated_size_ = get<bool>("Place By Allocated Size", false);
+			minimal_movement_ = get<bool>("Minimal Movement", false);
+			hysteresis_ = get<int>("Hysteresis", 5);
+			if (hysteresis_ < 0 || hysteresis_ > 100) {
+				Logging::log.warning("Invalid percentage for Hysteresis: "
+									 + std::to_string(hysteresis_) + ". Defaulting to 5.");
+				hysteresis_ = 5;
+			}
+			negative_timeout_ = get<int>("Negative Timeout", 0);
+			if (negative_timeout_ < 0) {
+				Logging::log.warning("Invalid number for Negative Timeout: "
+									 + std::to_string(negative_timeout_) + ". Defaulting to 0.");
+				negative_timeout_ = 0;
+			}
+			kernel_cache_timeout_ = get<int>("Kernel Cache Timeout", 0);
+			if (kernel_cache_timeout_ < 0) {
+				Logging::log.warning("Invalid number for Kernel Cache Timeout: "
+									 + std::to_string(kernel_cache_timeout_)
+									 + ". Defaulting to 0.");
+				kernel_cache_timeout_ = 0;
+			}
+			std::string metadata_keys = get<std::string>("Metadata Keys", "path");
+			directory_keys_ = (metadata_keys == "directory");
+			if (!directory_keys_ && metadata_keys != "path")
+				Logging::log.warning("Invalid Metadata Keys: " + metadata_keys
+									 + ". Defaulting to path.");
+			std::string fuse_api = get<std::string>("FUSE API", "high");
+			lowlevel_fuse_ = (fuse_api == "low");
+			if (!lowlevel_fuse_ && fuse_api != "high")
+				Logging::log.warning("Invalid FUSE API: " + fuse_api + ". Defaulting to high.");
+			fuse_threads_ = get<int>("FUSE Threads", DEFAULT_FUSE_THREADS);
+			if (fuse_threads_ <= 0) {
+				Logging::log.warning("Invalid number for FUSE Threads: "
+									 + std::to_string(fuse_threads_) + ". Defaulting to "
+									 + std::to_string(DEFAULT_FUSE_THREADS) + ".");
+				fuse_threads_ = DEFAULT_FUSE_THREADS;
+			}
+			fuse_idle_threads_ = get<int>("FUSE Idle Threads", DEFAULT_FUSE_THREADS);
+			if (fuse_idle_threads_ < 0) {
+				Logging::log.warning("Invalid number for FUSE Idle Threads: "
+									 + std::to_string(fuse_idle_threads_) + ". Defaulting to "
+									 + std::to_string(DEFAULT_FUSE_THREADS) + ".");
+				fuse_idle_threads_ = DEFAULT_FUSE_THREADS;
+			}
+			fuse_clone_fd_ = get<bool>("FUSE Clone FD", false);
+			passthrough_ = get<bool>("Passthrough", false);
+			keep_cache_popularity_ = get<int>("Keep Cache Popularity", 0);
+			if (keep_cache_popularity_ < 0) {
+				Logging::log.warning("Invalid number for Keep Cache Popularity: "
+									 + std::to_string(keep_cache_popularity_)
+									 + ". Defaulting to 0.");
+				keep_cache_popularity_ = 0;
+			}
+			direct_io_size_ = get<ffd::Bytes>("Direct IO Size", ffd::Bytes(0)).get();
+			direct_io_popularity_ = get<int>("Direct IO Popularity", 1);
+			if (direct_io_popularity_ < 0) {
+				Logging::log.warning("Invalid number for Direct IO Popularity: "
+									 + std::to_string(direct_io_popularity_)
+									 + ". Defaulting to 1.");
+				direct_io_popularity_ = 1;
+			}
 			run_path_ = get<std::string>("Run Path", "/var/lib/autotier");
 			break;
 		} catch (const std::out_of_range &e) {
@@ -126,9 +214,102 @@ void Config::load_config(const fs::path &config_path,
 		log_level_ =
 			(Logger::log_level_t)(log_level_tmp > 2 ? 2 : (log_level_tmp < 0 ? 0 : log_level_tmp));
 		copy_buff_sz_ = get<ffd::Bytes>("Copy Buffer Size", ffd::Bytes(1024 * 1024)).get();
+		std::string copy_engine = get<std::string>("Copy Engine", "buffered");
+		io_uring_copy_ = (copy_engine == "io_uring");
+		if (!io_uring_copy_ && copy_engine != "buffered")
+			Logging::log.warning("Invalid Copy Engine: " + copy_engine
+								 + ". Defaulting to buffered.");
+		copy_queue_depth_ = get<int>("Copy Queue Depth", 32);
+		if (copy_queue_depth_ <= 0) {
+			Logging::log.warning("Invalid number for Copy Queue Depth: "
+								 + std::to_string(copy_queue_depth_) + ". Defaulting to 32.");
+			copy_queue_depth_ = 32;
+		}
+		parallel_copy_threshold_ =
+			get<ffd::Bytes>("Parallel Copy Threshold", ffd::Bytes(1024 * 1024 * 1024)).get();
+		parallel_copy_threads_ = get<int>("Parallel Copy Threads", 1);
+		if (parallel_copy_threads_ <= 0) {
+			Logging::log.warning("Invalid number for Parallel Copy Threads: "
+								 + std::to_string(parallel_copy_threads_)
+								 + ". Defaulting to 1.");
+			parallel_copy_threads_ = 1;
+		}
+		mover_threads_ = get<int>("Mover Threads", 4);
+		if (mover_threads_ <= 0) {
+			Logging::log.warning("Invalid number for Mover Threads: "
+								 + std::to_string(mover_threads_) + ". Defaulting to 4.");
+			mover_threads_ = 4;
+		}
 		tier_period_s_ =
 			std::chrono::seconds(get<int64_t>("Tier Period", int64_t(TIER_PERIOD_DISBLED)));
 		strict_period_ = get<bool>("Strict Period", false);
+		crawler_threads_ = get<int>("Crawler Threads", 8);
+		if (crawler_threads_ <= 0) {
+			Logging::log.warning("Invalid number for Crawler Threads: "
+								 + std::to_string(crawler_threads_) + ". Defaulting to 8.");
+			crawler_threads_ = 8;
+		}
+		incremental_tiering_ = get<bool>("Incremental Tiering", false);
+		place_by_allocated_size_ = get<bool>("Place By Allocated Size", false);
+		minimal_movement_ = get<bool>("Minimal Movement", false);
+		hysteresis_ = get<int>("Hysteresis", 5);
+		if (hysteresis_ < 0 || hysteresis_ > 100) {
+			Logging::log.warning("Invalid percentage for Hysteresis: "
+								 + std::to_string(hysteresis_) + ". Defaulting to 5.");
+			hysteresis_ = 5;
+		}
+		negative_timeout_ = get<int>("Negative Timeout", 0);
+		if (negative_timeout_ < 0) {
+			Logging::log.warning("Invalid number for Negative Timeout: "
+								 + std::to_string(negative_timeout_) + ". Defaulting to 0.");
+			negative_timeout_ = 0;
+		}
+		kernel_cache_timeout_ = get<int>("Kernel Cache Timeout", 0);
+		if (kernel_cache_timeout_ < 0) {
+			Logging::log.warning("Invalid number for Kernel Cache Timeout: "
+								 + std::to_string(kernel_cache_timeout_) + ". Defaulting to 0.");
+			kernel_cache_timeout_ = 0;
+		}
+		std::string metadata_keys = get<std::string>("Metadata Keys", "path");
+		directory_keys_ = (metadata_keys == "directory");
+		if (!directory_keys_ && metadata_keys != "path")
+			Logging::log.warning("Invalid Metadata Keys: " + metadata_keys
+								 + ". Defaulting to path.");
+		std::string fuse_api = get<std::string>("FUSE API", "high");
+		lowlevel_fuse_ = (fuse_api == "low");
+		if (!lowlevel_fuse_ && fuse_api != "high")
+			Logging::log.warning("Invalid FUSE API: " + fuse_api + ". Defaulting to high.");
+		fuse_threads_ = get<int>("FUSE Threads", DEFAULT_FUSE_THREADS);
+		if (fuse_threads_ <= 0) {
+			Logging::log.warning("Invalid number for FUSE Threads: "
+								 + std::to_string(fuse_threads_) + ". Defaulting to "
+								 + std::to_string(DEFAULT_FUSE_THREADS) + ".");
+			fuse_threads_ = DEFAULT_FUSE_THREADS;
+		}
+		fuse_idle_threads_ = get<int>("FUSE Idle Threads", DEFAULT_FUSE_THREADS);
+		if (fuse_idle_threads_ < 0) {
+			Logging::log.warning("Invalid number for FUSE Idle Threads: "
+								 + std::to_string(fuse_idle_threads_) + ". Defaulting to "
+								 + std::to_string(DEFAULT_FUSE_THREADS) + ".");
+			fuse_idle_threads_ = DEFAULT_FUSE_THREADS;
+		}
+		fuse_clone_fd_ = get<bool>("FUSE Clone FD", false);
+		passthrough_ = get<bool>("Passthrough", false);
+		keep_cache_popularity_ = get<int>("Keep Cache Popularity", 0);
+		if (keep_cache_popularity_ < 0) {
+			Logging::log.warning("Invalid number for Keep Cache Popularity: "
+								 + std::to_string(keep_cache_popularity_)
+								 + ". Defaulting to 0.");
+			keep_cache_popularity_ = 0;
+		}
+		direct_io_size_ = get<ffd::Bytes>("Direct IO Size", ffd::Bytes(0)).get();
+		direct_io_popularity_ = get<int>("Direct IO Popularity", 1);
+		if (direct_io_popularity_ < 0) {
+			Logging::log.warning("Invalid number for Direct IO Popularity: "
+								 + std::to_string(direct_io_popularity_)
+								 + ". Defaulting to 1.");
+			direct_io_popularity_ = 1;
+		}
 		run_path_ = get<std::string>("Run Path", "/var/lib/autotier");
 	}
 
@@ -164,7 +345,15 @@ void Config::load_config(const fs::path &config_path,
 									 + ffd::Bytes(quota.get_max()).get_str() + ")",
 								 Logger::log_level_t::DEBUG);
 		}
+		int concurrent_moves = get<int>("Concurrent Moves", mover_threads_);
+		if (concurrent_moves <= 0) {
+			Logging::log.warning("Invalid number for Concurrent Moves in " + tier_name + ": "
+								 + std::to_string(concurrent_moves) + ". Defaulting to "
+								 + std::to_string(mover_threads_) + ".");
+			concurrent_moves = mover_threads_;
+		}
 		tiers.emplace_back(tier_name, tier_path, quota);
+		tiers.back().concurrent_moves(concurrent_moves);
 	}
 	Logging::log.message("Tier configs loaded.", Logger::log_level_t::DEBUG);
 
@@ -189,6 +378,22 @@ size_t Config::copy_buff_sz(void) const {
 	return copy_buff_sz_;
 }
 
+unsigned int Config::copy_queue_depth(void) const {
+	return io_uring_copy_ ? copy_queue_depth_ : 0;
+}
+
+uint64_t Config::parallel_copy_threshold(void) const {
+	return parallel_copy_threshold_;
+}
+
+int Config::parallel_copy_threads(void) const {
+	return parallel_copy_threads_;
+}
+
+int Config::mover_threads(void) const {
+	return mover_threads_;
+}
+
 std::chrono::seconds Config::tier_period_s(void) const {
 	return tier_period_s_;
 }
@@ -197,6 +402,70 @@ bool Config::strict_period(void) const {
 	return strict_period_;
 }
 
+int Config::crawler_threads(void) const {
+	return crawler_threads_;
+}
+
+bool Config::incremental_tiering(void) const {
+	return incremental_tiering_;
+}
+
+bool Config::minimal_movement(void) const {
+	return minimal_movement_;
+}
+
+int Config::hysteresis(void) const {
+	return hysteresis_;
+}
+
+bool Config::place_by_allocated_size(void) const {
+	return place_by_allocated_size_;
+}
+
+int Config::negative_timeout(void) const {
+	return negative_timeout_;
+}
+
+int Config::kernel_cache_timeout(void) const {
+	return kernel_cache_timeout_;
+}
+
+bool Config::directory_keys(void) const {
+	return directory_keys_;
+}
+
+bool Config::lowlevel_fuse(void) const {
+	return lowlevel_fuse_;
+}
+
+int Config::fuse_threads(void) const {
+	return fuse_threads_;
+}
+
+int Config::fuse_idle_threads(void) const {
+	return fuse_idle_threads_;
+}
+
+bool Config::fuse_clone_fd(void) const {
+	return fuse_clone_fd_;
+}
+
+bool Config::passthrough(void) const {
+	return passthrough_;
+}
+
+int Config::keep_cache_popularity(void) const {
+	return keep_cache_popularity_;
+}
+
+uint64_t Config::direct_io_size(void) const {
+	return direct_io_size_;
+}
+
+int Config::direct_io_popularity(void) const {
+	return direct_io_popularity_;
+}
+
 fs::path Config::run_path(void) const {
 	return run_path_;
 }
@@ -207,13 +476,41 @@ void Config::dump(const std::list<Tier> &tiers, std::stringstream &ss) const {
 	ss << "Tier Period = " << tier_period_s_.count() << std::endl;
 	ss << "Strict Period = " << (strict_period_ == 1 ? "true" : "false") << std::endl;
 	ss << "Copy Buffer Size = " << Logging::log.format_bytes(copy_buff_sz_) << std::endl;
+	ss << "Copy Engine = " << (io_uring_copy_ ? "io_uring" : "buffered") << std::endl;
+	ss << "Copy Queue Depth = " << copy_queue_depth_ << std::endl;
+	ss << "Parallel Copy Threshold = " << Logging::log.format_bytes(parallel_copy_threshold_)
+	   << std::endl;
+	ss << "Parallel Copy Threads = " << parallel_copy_threads_ << std::endl;
+	ss << "Mover Threads = " << mover_threads_ << std::endl;
 	ss << "Crawler Threads = " << crawler_threads_ << std::endl;
+	ss << "Incremental Tiering = " << (incremental_tiering_ ? "true" : "false") << std::endl;
+	ss << "Minimal Movement = " << (minimal_movement_ ? "true" : "false") << std::endl;
+	ss << "Hysteresis = " << hysteresis_ << " %" << std::endl;
+	ss << "Place By Allocated Size = " << (place_by_allocated_size_ ? "true" : "false")
+	   << std::endl;
+	ss << "Negative Timeout = " << negative_timeout_ << std::endl;
+	ss << "Kernel Cache Timeout = " << kernel_cache_timeout_ << std::endl;
+	ss << "Metadata Keys = " << (directory_keys_ ? "directory" : "path") << std::endl;
+	ss << "FUSE API = " << (lowlevel_fuse_ ? "low" : "high") << std::endl;
+	ss << "FUSE Threads = " << fuse_threads_ << std::endl;
+	ss << "FUSE Idle Threads = " << fuse_idle_threads_ << std::endl;
+	ss << "FUSE Clone FD = " << (fuse_clone_fd_ ? "true" : "false") << std::endl;
+	ss << "Passthrough = " << (passthrough_ ? "true" : "false") << std::endl;
+	ss << "Keep Cache Popularity = " << keep_cache_popularity_ << std::endl;
+	ss << "Direct IO Size = " << Logging::log.format_bytes(direct_io_size_) << std::endl;
+	ss << "Direct IO Popularity = " << direct_io_popularity_ << std::endl;
 	ss << " " << std::endl;
 	for (const Tier &t : tiers) {
 		ss << "[" << t.id() << "]" << std::endl;
 		ss << "Path = " << t.path() << std::endl;
 		ss << "Quota = " << t.quota().get_fraction() * 100.0 << " % (" << t.quota().get_str() << ")"
 		   << std::endl;
+		ss << "Concurrent Moves = " << t.concurrent_moves() << std::endl;
+		for (const Tier &source : tiers) {
+			if (&source != &t)
+				ss << "# Moves from " << source.id() << ": "
+				   << move_method_str(t.move_method(&source)) << std::endl;
+		}
 		ss << " " << std::endl;
 	}
 }
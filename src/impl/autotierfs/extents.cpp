@@ -0,0 +1,47 @@
+/*
+ *    Copyright (C) 2019-2021 Joshua Boudreau <jboudreau@45drives.com>
+ *
+ *    This file is part of autotier.
+ *
+ *    autotier is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    autotier is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with autotier.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "extents.hpp"
+
+#include <cerrno>
+
+extern "C" {
+#include <unistd.h>
+}
+
+void data_extents(int fd, off_t size, std::vector<Extent> &extents) {
+	extents.clear();
+	off_t offset = 0;
+	while (offset < size) {
+		off_t data = lseek(fd, offset, SEEK_DATA);
+		if (data == (off_t)-1) {
+			if (errno != ENXIO) // not supported, copy everything that is left
+				extents.push_back(Extent{ offset, size });
+			break; // ENXIO: rest of file is a hole
+		}
+		if (data >= size)
+			break;
+		off_t hole = lseek(fd, data, SEEK_HOLE);
+		if (hole == (off_t)-1 || hole > size)
+			hole = size;
+		extents.push_back(Extent{ data, hole });
+		offset = hole;
+	}
+	lseek(fd, 0, SEEK_SET);
+}
@@ -20,7 +20,6 @@
 #include "file.hpp"
 
 #include "alert.hpp"
-#include "popularityCalc.hpp"
 #include "tier.hpp"
 
 #include <sstream>
@@ -77,19 +76,7 @@ File::File(File &&other)
 File::~File() {}
 
 void File::update_db(std::shared_ptr<rocksdb::DB> &db) {
-	metadata_.update(relative_path_.string(), db);
-}
-
-void File::calc_popularity(double period_seconds) {
-	if (period_seconds <= 0.0)
-		return;
-	double usage_frequency =
-		metadata_.access_count_ ? double(metadata_.access_count_) / period_seconds : 0.0;
-	double average_period_age = (double)(time(NULL) - ctime_) + period_seconds / 2.0;
-	double damping = std::min(average_period_age * SLOPE + START_DAMPING, DAMPING) / period_seconds;
-	metadata_.popularity_ =
-		MULTIPLIER * usage_frequency / damping + (1.0 - 1.0 / damping) * metadata_.popularity_;
-	metadata_.access_count_ = 0;
+	metadata_.update(relative_path_.string(), db, nullptr, size_.get());
 }
 
 fs::path File::full_path(void) const {
@@ -129,10 +116,12 @@ bool File::is_pinned(void) const {
 
 void File::transfer_to_tier(Tier *tptr, std::shared_ptr<rocksdb::DB> &db) {
 	tier_ptr_->subtract_file_size(size_);
+	std::string old_tier_path = tier_ptr_->path().string();
 	tier_ptr_ = tptr;
 	tier_ptr_->add_file_size(size_);
 	metadata_.tier_path_ = tptr->path().string();
-	metadata_.update(relative_path_.string(), db);
+	Metadata::set_tier_path(
+		relative_path_.string(), db, metadata_.tier_path_, size_.get(), old_tier_path);
 }
 
 void File::overwrite_times(void) const {
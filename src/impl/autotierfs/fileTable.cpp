@@ -0,0 +1,311 @@
+/*
+ *    Copyright (C) 2019-2021 Joshua Boudreau <jboudreau@45drives.com>
+ *
+ *    This file is part of autotier.
+ *
+ *    autotier is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    autotier is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with autotier.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "fileTable.hpp"
+
+#include "popularityCalc.hpp"
+#include "tier.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <ctime>
+
+#define NO_DIR UINT32_MAX ///< last_dir_ before any directory is interned
+
+/**
+ * @brief Replace column with column[order[0]], column[order[1]], ...
+ *
+ * @tparam T Column type
+ * @param column Column to reorder
+ * @param order Permutation
+ */
+template<typename T>
+static void gather(std::vector<T> &column, const std::vector<FileTable::row_type> &order) {
+	std::vector<T> sorted;
+	sorted.reserve(column.size());
+	for (FileTable::row_type row : order)
+		sorted.push_back(column[row]);
+	column.swap(sorted);
+}
+
+FileTable::FileTable(void) : last_dir_(NO_DIR), dead_name_bytes_(0) {}
+
+void FileTable::clear(void) {
+	dirs_.clear();
+	dir_ids_.clear();
+	last_dir_ = NO_DIR;
+	names_.clear();
+	dead_name_bytes_ = 0;
+	resize(0);
+}
+
+void FileTable::reserve(size_t rows) {
+	dir_.reserve(rows);
+	name_.reserve(rows);
+	tier_.reserve(rows);
+	flags_.reserve(rows);
+	size_.reserve(rows);
+	alloc_size_.reserve(rows);
+	atime_.reserve(rows);
+	mtime_.reserve(rows);
+	ctime_.reserve(rows);
+	popularity_.reserve(rows);
+	written_popularity_.reserve(rows);
+	access_count_.reserve(rows);
+}
+
+void FileTable::emplace_back(const std::string &relative_path,
+							 uint8_t tier,
+							 const struct stat &st,
+							 const Metadata &metadata) {
+	size_t slash = relative_path.rfind('/');
+	if (slash == std::string::npos) {
+		dir_.push_back(intern_dir(""));
+		name_.push_back(intern_name(relative_path.c_str(), relative_path.size()));
+	} else {
+		dir_.push_back(intern_dir(relative_path.substr(0, slash)));
+		name_.push_back(
+			intern_name(relative_path.c_str() + slash + 1, relative_path.size() - slash - 1));
+	}
+	tier_.push_back(tier);
+	flags_.push_back(metadata.pinned_ ? PINNED | DIRTY : DIRTY);
+	size_.push_back(st.st_size);
+	alloc_size_.push_back(uint64_t(st.st_blocks) * 512);
+	atime_.push_back(int64_t(st.st_atim.tv_sec) * 1000000 + st.st_atim.tv_nsec / 1000);
+	mtime_.push_back(int64_t(st.st_mtim.tv_sec) * 1000000 + st.st_mtim.tv_nsec / 1000);
+	ctime_.push_back(st.st_ctim.tv_sec);
+	popularity_.push_back(metadata.popularity_);
+	written_popularity_.push_back(metadata.popularity_);
+	access_count_.push_back(metadata.access_count_);
+}
+
+void FileTable::append(FileTable &&other) {
+	if (empty() && dirs_.empty()) {
+		*this = std::move(other);
+		other.clear();
+		return;
+	}
+	std::vector<uint32_t> dir_map(other.dirs_.size());
+	for (size_t i = 0; i < other.dirs_.size(); ++i)
+		dir_map[i] = intern_dir(other.dirs_[i]);
+	uint64_t name_base = names_.size();
+	names_.insert(names_.end(), other.names_.begin(), other.names_.end());
+	dead_name_bytes_ += other.dead_name_bytes_;
+	reserve(size() + other.size());
+	for (uint32_t dir : other.dir_)
+		dir_.push_back(dir_map[dir]);
+	for (uint64_t name : other.name_)
+		name_.push_back(name_base + name);
+	tier_.insert(tier_.end(), other.tier_.begin(), other.tier_.end());
+	flags_.insert(flags_.end(), other.flags_.begin(), other.flags_.end());
+	size_.insert(size_.end(), other.size_.begin(), other.size_.end());
+	alloc_size_.insert(alloc_size_.end(), other.alloc_size_.begin(), other.alloc_size_.end());
+	atime_.insert(atime_.end(), other.atime_.begin(), other.atime_.end());
+	mtime_.insert(mtime_.end(), other.mtime_.begin(), other.mtime_.end());
+	ctime_.insert(ctime_.end(), other.ctime_.begin(), other.ctime_.end());
+	popularity_.insert(popularity_.end(), other.popularity_.begin(), other.popularity_.end());
+	written_popularity_.insert(written_popularity_.end(),
+							   other.written_popularity_.begin(),
+							   other.written_popularity_.end());
+	access_count_.insert(
+		access_count_.end(), other.access_count_.begin(), other.access_count_.end());
+	other.clear();
+}
+
+void FileTable::permute(const std::vector<row_type> &order) {
+	gather(dir_, order);
+	gather(name_, order);
+	gather(tier_, order);
+	gather(flags_, order);
+	gather(size_, order);
+	gather(alloc_size_, order);
+	gather(atime_, order);
+	gather(mtime_, order);
+	gather(ctime_, order);
+	gather(popularity_, order);
+	gather(written_popularity_, order);
+	gather(access_count_, order);
+}
+
+void FileTable::rename_dirs(const std::string &old_dir, const std::string &new_dir) {
+	std::vector<bool> renamed(dirs_.size(), false);
+	bool any = false;
+	for (size_t i = 0; i < dirs_.size(); ++i) {
+		std::string &dir = dirs_[i];
+		if (dir.compare(0, old_dir.size(), old_dir) == 0
+			&& (dir.size() == old_dir.size() || dir[old_dir.size()] == '/')) {
+			dir = new_dir + dir.substr(old_dir.size());
+			renamed[i] = any = true;
+		}
+	}
+	index_dirs();
+	if (!any)
+		return;
+	// index entries of path keys are under the old paths
+	for (row_type row = 0; row < size(); ++row) {
+		if (renamed[dir_[row]])
+			flags_[row] |= DIRTY;
+	}
+}
+
+void FileTable::rename(row_type row, const std::string &relative_path) {
+	size_t slash = relative_path.rfind('/');
+	dead_name_bytes_ += strlen(name(row)) + 1;
+	flags_[row] |= DIRTY;
+	if (slash == std::string::npos) {
+		dir_[row] = intern_dir("");
+		name_[row] = intern_name(relative_path.c_str(), relative_path.size());
+	} else {
+		dir_[row] = intern_dir(relative_path.substr(0, slash));
+		name_[row] =
+			intern_name(relative_path.c_str() + slash + 1, relative_path.size() - slash - 1);
+	}
+}
+
+void FileTable::calc_popularity(double period_seconds) {
+	if (period_seconds <= 0.0)
+		return;
+	time_t now = time(NULL);
+	for (row_type row = 0; row < size(); ++row) {
+		if (flags_[row] & PINNED)
+			continue;
+		double usage_frequency =
+			access_count_[row] ? double(access_count_[row]) / period_seconds : 0.0;
+		double average_period_age = (double)(now - ctime_[row]) + period_seconds / 2.0;
+		double damping =
+			std::min(average_period_age * SLOPE + START_DAMPING, DAMPING) / period_seconds;
+		popularity_[row] =
+			MULTIPLIER * usage_frequency / damping + (1.0 - 1.0 / damping) * popularity_[row];
+	}
+}
+
+bool FileTable::needs_write(row_type row) const {
+	if ((flags_[row] & DIRTY) || access_count_[row] != 0)
+		return true;
+	return std::abs(popularity_[row] - written_popularity_[row])
+		   > POPULARITY_WRITE_TOLERANCE * written_popularity_[row];
+}
+
+void FileTable::reset_access_counts(void) {
+	std::fill(access_count_.begin(), access_count_.end(), 0);
+}
+
+std::string FileTable::relative_path(row_type row) const {
+	const std::string &directory = dir(row);
+	if (directory.empty())
+		return name(row);
+	return directory + "/" + name(row);
+}
+
+Metadata FileTable::metadata(row_type row, const std::string &tier_path) const {
+	Metadata metadata;
+	metadata.access_count_ = access_count_[row];
+	metadata.popularity_ = popularity_[row];
+	metadata.pinned_ = flags_[row] & PINNED;
+	metadata.tier_path_ = tier_path;
+	return metadata;
+}
+
+File FileTable::file(row_type row, Tier *tptr) const {
+	File f;
+	f.size_ = ffd::Bytes(size_[row]);
+	f.tier_ptr_ = tptr;
+	f.times_[0].tv_sec = atime_[row] / 1000000;
+	f.times_[0].tv_usec = atime_[row] % 1000000;
+	f.times_[1].tv_sec = mtime_[row] / 1000000;
+	f.times_[1].tv_usec = mtime_[row] % 1000000;
+	f.atime_ = f.times_[0].tv_sec;
+	f.ctime_ = ctime_[row];
+	f.relative_path_ = relative_path(row);
+	f.metadata_ = metadata(row, tptr->path().string());
+	return f;
+}
+
+uint32_t FileTable::intern_dir(const std::string &relative_dir) {
+	if (last_dir_ != NO_DIR && dirs_[last_dir_] == relative_dir)
+		return last_dir_;
+	std::unordered_map<std::string, uint32_t>::iterator itr = dir_ids_.find(relative_dir);
+	if (itr != dir_ids_.end()) {
+		last_dir_ = itr->second;
+	} else {
+		last_dir_ = dirs_.size();
+		dirs_.push_back(relative_dir);
+		dir_ids_.emplace(relative_dir, last_dir_);
+	}
+	return last_dir_;
+}
+
+uint64_t FileTable::intern_name(const char *name, size_t len) {
+	uint64_t offset = names_.size();
+	names_.insert(names_.end(), name, name + len);
+	names_.push_back('\0');
+	return offset;
+}
+
+void FileTable::move_row(row_type from, row_type to) {
+	dir_[to] = dir_[from];
+	name_[to] = name_[from];
+	tier_[to] = tier_[from];
+	flags_[to] = flags_[from];
+	size_[to] = size_[from];
+	alloc_size_[to] = alloc_size_[from];
+	atime_[to] = atime_[from];
+	mtime_[to] = mtime_[from];
+	ctime_[to] = ctime_[from];
+	popularity_[to] = popularity_[from];
+	written_popularity_[to] = written_popularity_[from];
+	access_count_[to] = access_count_[from];
+}
+
+void FileTable::resize(size_t rows) {
+	dir_.resize(rows);
+	name_.resize(rows);
+	tier_.resize(rows);
+	flags_.resize(rows);
+	size_.resize(rows);
+	alloc_size_.resize(rows);
+	atime_.resize(rows);
+	mtime_.resize(rows);
+	ctime_.resize(rows);
+	popularity_.resize(rows);
+	written_popularity_.resize(rows);
+	access_count_.resize(rows);
+}
+
+void FileTable::compact_names(void) {
+	if (dead_name_bytes_ * 2 <= names_.size())
+		return;
+	std::vector<char> names;
+	names.reserve(names_.size() - dead_name_bytes_);
+	for (row_type row = 0; row < size(); ++row) {
+		const char *n = name(row);
+		uint64_t offset = names.size();
+		names.insert(names.end(), n, n + strlen(n) + 1);
+		name_[row] = offset;
+	}
+	names_.swap(names);
+	dead_name_bytes_ = 0;
+}
+
+void FileTable::index_dirs(void) {
+	dir_ids_.clear();
+	for (uint32_t i = 0; i < dirs_.size(); ++i)
+		dir_ids_.emplace(dirs_[i], i); // keeps first id if renames made duplicates
+	last_dir_ = NO_DIR;
+}
@@ -22,7 +22,6 @@
  */
 
 #include "fuseOps.hpp"
-#include "metadata.hpp"
 #include "tier.hpp"
 
 #ifdef LOG_METHODS
@@ -35,7 +34,7 @@ namespace fuse_ops {
 	int access(const char *path, int mask) {
 		int res;
 
-		fuse_context *ctx = fuse_get_context();
+		fuse_context *ctx = l::get_context();
 		FusePriv *priv = (FusePriv *)ctx->private_data;
 		if (!priv)
 			return -ECHILD;
@@ -48,7 +47,8 @@ namespace fuse_ops {
 		}
 #endif
 
-		int is_directory = l::is_directory(path);
+		fs::path tier_path;
+		int is_directory = l::find_path(path, tier_path);
 		if (is_directory == -1)
 			return -errno;
 		if (is_directory) {
@@ -58,10 +58,6 @@ namespace fuse_ops {
 					return res;
 			}
 		} else {
-			Metadata f(path, priv->db_);
-			if (f.not_found())
-				return -ENOENT;
-			fs::path tier_path = f.tier_path();
 			res = ::access((tier_path / path).c_str(), mask);
 		}
 
@@ -22,7 +22,6 @@
  */
 
 #include "fuseOps.hpp"
-#include "metadata.hpp"
 #include "tier.hpp"
 
 #ifdef LOG_METHODS
@@ -35,7 +34,7 @@ namespace fuse_ops {
 	int chown(const char *path, uid_t uid, gid_t gid, struct fuse_file_info *fi) {
 		int res;
 
-		fuse_context *ctx = fuse_get_context();
+		fuse_context *ctx = l::get_context();
 		FusePriv *priv = (FusePriv *)ctx->private_data;
 		if (!priv)
 			return -ECHILD;
@@ -57,7 +56,8 @@ namespace fuse_ops {
 #ifdef LOG_METHODS
 			Logging::log.message("chown " + std::string(path), Logger::log_level_t::NONE);
 #endif
-			int is_directory = l::is_directory(path);
+			fs::path tier_path;
+			int is_directory = l::find_path(path, tier_path);
 			if (is_directory == -1)
 				return -errno;
 			if (is_directory) {
@@ -68,10 +68,6 @@ namespace fuse_ops {
 						return -errno;
 				}
 			} else {
-				Metadata f(path, priv->db_);
-				if (f.not_found())
-					return -ENOENT;
-				fs::path tier_path = f.tier_path();
 				res = ::lchown((tier_path / path).c_str(), uid, gid);
 			}
 		}
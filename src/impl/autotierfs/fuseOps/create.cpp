@@ -22,8 +22,11 @@
  */
 
 #include "fuseOps.hpp"
+#include "journal.hpp"
 #include "metadata.hpp"
 #include "openFiles.hpp"
+#include "pathCache.hpp"
+#include "rocksDbHelpers.hpp"
 #include "tier.hpp"
 
 extern "C" {
@@ -50,7 +53,7 @@ namespace fuse_ops {
 		int res;
 		char *fullpath = nullptr;
 
-		fuse_context *ctx = fuse_get_context();
+		fuse_context *ctx = l::get_context();
 		FusePriv *priv = (FusePriv *)ctx->private_data;
 		if (!priv)
 			return -ECHILD;
@@ -74,7 +77,12 @@ namespace fuse_ops {
 
 		fi->fh = res;
 
-		Metadata(path, priv->db_, top_tier).update(path, priv->db_);
+		{
+			l::rocksdb::KeyLock lk(path);
+			Metadata(path, priv->db_, top_tier).update(path, priv->db_);
+		}
+		priv->path_cache_->invalidate(path);
+		priv->journal_->record(ChangeJournal::MODIFIED, path);
 
 		priv->insert_fd_to_path(fi->fh, fullpath);
 		priv->insert_size_at_open(fi->fh, 0);
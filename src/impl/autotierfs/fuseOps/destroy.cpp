@@ -36,6 +36,10 @@ namespace fuse_ops {
 
 		Logging::log.message("All threads joined.", Logger::DEBUG);
 
+		priv->access_cache_->stop();
+
+		priv->autotier_->save_file_table();
+
 		delete priv->autotier_;
 
 		Logging::log.message("Deleted TierEngine.", Logger::DEBUG);
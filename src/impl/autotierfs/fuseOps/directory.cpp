@@ -55,7 +55,7 @@ namespace fuse_ops {
 	};
 
 	int opendir(const char *path, struct fuse_file_info *fi) {
-		fuse_context *ctx = fuse_get_context();
+		fuse_context *ctx = l::get_context();
 		FusePriv *priv = (FusePriv *)ctx->private_data;
 		if (!priv)
 			return -ECHILD;
@@ -174,7 +174,7 @@ namespace fuse_ops {
 		int res;
 		class dirp *d = get_dirp(fi);
 
-		fuse_context *ctx = fuse_get_context();
+		fuse_context *ctx = l::get_context();
 		FusePriv *priv = (FusePriv *)ctx->private_data;
 		if (!priv)
 			return -ECHILD;
@@ -27,62 +27,187 @@
 #include "alert.hpp"
 #include "config.hpp"
 #include "fuseOps.hpp"
+#include "kernelCache.hpp"
+#include "requestCounts.hpp"
 
 FusePassthrough::FusePassthrough(const fs::path &config_path,
 								 const ConfigOverrides &config_overrides) {
 	fuse_ops::autotier_ptr = new TierEngine(config_path, config_overrides);
 }
 
+/**
+ * @brief Worker thread settings for fuse_loop_mt() and fuse_session_loop_mt() from the
+ * config file.
+ *
+ */
+class LoopConfig {
+public:
+	LoopConfig(const Config &config, bool clone_fd) {
+#if FUSE_USE_VERSION >= 312
+		loop_config_ = fuse_loop_cfg_create();
+		fuse_loop_cfg_set_clone_fd(loop_config_, clone_fd || config.fuse_clone_fd());
+		fuse_loop_cfg_set_idle_threads(loop_config_, config.fuse_idle_threads());
+		fuse_loop_cfg_set_max_threads(loop_config_, config.fuse_threads());
+#else
+		loop_config_ = &loop_config_v1_;
+		loop_config_->clone_fd = clone_fd || config.fuse_clone_fd();
+		loop_config_->max_idle_threads = config.fuse_idle_threads();
+#endif
+	}
+	~LoopConfig(void) {
+#if FUSE_USE_VERSION >= 312
+		fuse_loop_cfg_destroy(loop_config_);
+#endif
+	}
+	struct fuse_loop_config *get(void) {
+		return loop_config_;
+	}
+private:
+	struct fuse_loop_config *loop_config_;
+#if FUSE_USE_VERSION < 312
+	struct fuse_loop_config loop_config_v1_;
+#endif
+};
+
+/**
+ * @brief Serve the filesystem through the high-level API, doing what fuse_main() does but
+ * with worker threads set up from the config file.
+ *
+ * @param argv Arguments as given to fuse_main()
+ * @param ops FUSE operations
+ * @return int 0 if unmounted cleanly, else 1
+ */
+static int mount_highlevel(std::vector<char *> &argv, const struct fuse_operations *ops) {
+	struct fuse_args args = FUSE_ARGS_INIT((int)argv.size(), argv.data());
+	struct fuse_cmdline_opts opts;
+	struct fuse *fuse;
+	const Config &config = fuse_ops::autotier_ptr->get_config();
+	int res = 1;
+
+	if (fuse_parse_cmdline(&args, &opts) != 0)
+		return 1;
+	fuse = fuse_new(&args, ops, sizeof(*ops), NULL);
+	if (fuse == NULL)
+		goto out_free;
+	if (config.kernel_cache_timeout() > 0 || config.negative_timeout() > 0)
+		KernelCache::set_fuse(fuse);
+	if (fuse_mount(fuse, opts.mountpoint) != 0)
+		goto out_destroy;
+	if (fuse_daemonize(opts.foreground) != 0)
+		goto out_unmount;
+	if (fuse_set_signal_handlers(fuse_get_session(fuse)) != 0)
+		goto out_unmount;
+	if (opts.singlethread) {
+		res = fuse_loop(fuse);
+	} else {
+		LoopConfig loop_config(config, opts.clone_fd);
+		res = fuse_loop_mt(fuse, loop_config.get());
+	}
+	fuse_remove_signal_handlers(fuse_get_session(fuse));
+out_unmount:
+	fuse_unmount(fuse);
+out_destroy:
+	KernelCache::clear();
+	fuse_destroy(fuse);
+out_free:
+	free(opts.mountpoint);
+	fuse_opt_free_args(&args);
+	return res ? 1 : 0;
+}
+
+/**
+ * @brief Serve the filesystem through the low-level API, as mount_highlevel() does for
+ * the high-level API.
+ *
+ * @param argv Arguments as given to fuse_main()
+ * @return int 0 if unmounted cleanly, else 1
+ */
+static int mount_lowlevel(std::vector<char *> &argv) {
+	struct fuse_args args = FUSE_ARGS_INIT((int)argv.size(), argv.data());
+	struct fuse_cmdline_opts opts;
+	struct fuse_session *se;
+	int res = 1;
+
+	if (fuse_parse_cmdline(&args, &opts) != 0)
+		return 1;
+	// init gets the session through userdata to send invalidations
+	se = fuse_session_new(
+		&args, &fuse_ll_ops::operations, sizeof(fuse_ll_ops::operations), &se);
+	if (se == NULL)
+		goto out_free;
+	if (fuse_set_signal_handlers(se) != 0)
+		goto out_destroy;
+	if (fuse_session_mount(se, opts.mountpoint) != 0)
+		goto out_remove_handlers;
+	if (fuse_daemonize(opts.foreground) != 0)
+		goto out_unmount;
+	if (opts.singlethread) {
+		res = fuse_session_loop(se);
+	} else {
+		LoopConfig loop_config(fuse_ops::autotier_ptr->get_config(), opts.clone_fd);
+		res = fuse_session_loop_mt(se, loop_config.get());
+	}
+out_unmount:
+	fuse_session_unmount(se);
+out_remove_handlers:
+	fuse_remove_signal_handlers(se);
+out_destroy:
+	fuse_session_destroy(se);
+out_free:
+	free(opts.mountpoint);
+	fuse_opt_free_args(&args);
+	return res ? 1 : 0;
+}
+
 // methods
 int FusePassthrough::mount_fs(fs::path mountpoint, char *fuse_opts) {
-	// TODO: Replace fuse_main() call with lower level fuse loop
 	fuse_ops::autotier_ptr->mount_point(mountpoint);
 	Logging::log.message("Mounting filesystem", Logger::log_level_t::DEBUG);
 	static const struct fuse_operations at_oper = {
-		.getattr = fuse_ops::getattr,
-		.readlink = fuse_ops::readlink,
-		.mknod = fuse_ops::mknod,
-		.mkdir = fuse_ops::mkdir,
-		.unlink = fuse_ops::unlink,
-		.rmdir = fuse_ops::rmdir,
-		.symlink = fuse_ops::symlink,
-		.rename = fuse_ops::rename,
-		.link = fuse_ops::link,
-		.chmod = fuse_ops::chmod,
-		.chown = fuse_ops::chown,
-		.truncate = fuse_ops::truncate,
-		.open = fuse_ops::open,
-		.read = fuse_ops::read,
-		.write = fuse_ops::write,
-		.statfs = fuse_ops::statfs,
-		.flush = fuse_ops::flush,
-		.release = fuse_ops::release,
-		.fsync = fuse_ops::fsync,
-		.setxattr = fuse_ops::setxattr,
-		.getxattr = fuse_ops::getxattr,
-		.listxattr = fuse_ops::listxattr,
-		.removexattr = fuse_ops::removexattr,
-		.opendir = fuse_ops::opendir,
-		.readdir = fuse_ops::readdir,
-		.releasedir = fuse_ops::releasedir,
+		.getattr = COUNTED(fuse_ops::getattr),
+		.readlink = COUNTED(fuse_ops::readlink),
+		.mknod = COUNTED(fuse_ops::mknod),
+		.mkdir = COUNTED(fuse_ops::mkdir),
+		.unlink = COUNTED(fuse_ops::unlink),
+		.rmdir = COUNTED(fuse_ops::rmdir),
+		.symlink = COUNTED(fuse_ops::symlink),
+		.rename = COUNTED(fuse_ops::rename),
+		.link = COUNTED(fuse_ops::link),
+		.chmod = COUNTED(fuse_ops::chmod),
+		.chown = COUNTED(fuse_ops::chown),
+		.truncate = COUNTED(fuse_ops::truncate),
+		.open = COUNTED(fuse_ops::open),
+		.read = COUNTED(fuse_ops::read),
+		.write = COUNTED(fuse_ops::write),
+		.statfs = COUNTED(fuse_ops::statfs),
+		.flush = COUNTED(fuse_ops::flush),
+		.release = COUNTED(fuse_ops::release),
+		.fsync = COUNTED(fuse_ops::fsync),
+		.setxattr = COUNTED(fuse_ops::setxattr),
+		.getxattr = COUNTED(fuse_ops::getxattr),
+		.listxattr = COUNTED(fuse_ops::listxattr),
+		.removexattr = COUNTED(fuse_ops::removexattr),
+		.opendir = COUNTED(fuse_ops::opendir),
+		.readdir = COUNTED(fuse_ops::readdir),
+		.releasedir = COUNTED(fuse_ops::releasedir),
 #ifdef USE_FSYNCDIR
-		.fsyncdir = fuse_ops::fsyncdir,
+		.fsyncdir = COUNTED(fuse_ops::fsyncdir),
 #endif
 		.init = fuse_ops::init,
 		.destroy = fuse_ops::destroy,
-		.access = fuse_ops::access,
-		.create = fuse_ops::create,
+		.access = COUNTED(fuse_ops::access),
+		.create = COUNTED(fuse_ops::create),
 #ifdef HAVE_LIBULOCKMGR
-		.lock = fuse_ops::lock,
+		.lock = COUNTED(fuse_ops::lock),
 #endif
-		.utimens = fuse_ops::utimens,
-		.write_buf = fuse_ops::write_buf,
-		.read_buf = fuse_ops::read_buf,
-		.flock = fuse_ops::flock,
-		.fallocate = fuse_ops::fallocate,
+		.utimens = COUNTED(fuse_ops::utimens),
+		.write_buf = COUNTED(fuse_ops::write_buf),
+		.read_buf = COUNTED(fuse_ops::read_buf),
+		.flock = COUNTED(fuse_ops::flock),
+		.fallocate = COUNTED(fuse_ops::fallocate),
 #ifndef EL8
-		.copy_file_range = fuse_ops::copy_file_range,
-		.lseek = fuse_ops::lseek,
+		.copy_file_range = COUNTED(fuse_ops::copy_file_range),
+		.lseek = COUNTED(fuse_ops::lseek),
 #endif
 	};
 	std::vector<char *> argv = { strdup("autotier"), strdup(mountpoint.c_str()) };
@@ -90,5 +215,13 @@ int FusePassthrough::mount_fs(fs::path mountpoint, char *fuse_opts) {
 		argv.push_back(strdup("-o"));
 		argv.push_back(fuse_opts);
 	}
-	return fuse_main(argv.size(), argv.data(), &at_oper, NULL);
+#if FUSE_USE_VERSION < 312
+	if (fuse_ops::autotier_ptr->get_config().fuse_threads() != DEFAULT_FUSE_THREADS)
+		Logging::log.warning("FUSE Threads needs libfuse 3.12 or newer, not limiting threads.");
+#endif
+	if (fuse_ops::autotier_ptr->get_config().lowlevel_fuse())
+		return mount_lowlevel(argv);
+	if (fuse_ops::autotier_ptr->get_config().passthrough())
+		Logging::log.warning("Passthrough needs FUSE API = low, reading through autotier.");
+	return mount_highlevel(argv, &at_oper);
 }
@@ -22,7 +22,6 @@
  */
 
 #include "fuseOps.hpp"
-#include "metadata.hpp"
 #include "tier.hpp"
 
 #ifdef LOG_METHODS
@@ -35,7 +34,7 @@ namespace fuse_ops {
 	int getattr(const char *path, struct stat *stbuf, struct fuse_file_info *fi) {
 		int res;
 
-		fuse_context *ctx = fuse_get_context();
+		fuse_context *ctx = l::get_context();
 		FusePriv *priv = (FusePriv *)ctx->private_data;
 		if (!priv)
 			return -ECHILD;
@@ -49,24 +48,20 @@ namespace fuse_ops {
 #endif
 
 		if (fi == NULL) {
-			int is_directory = l::is_directory(path);
+			fs::path tier_path;
+			int is_directory = l::find_path(path, tier_path);
+#ifdef LOG_METHODS
+			{
+				std::stringstream ss;
+				ss << "getattr " << path << " found? " << std::boolalpha << (is_directory != -1);
+				Logging::log.message(ss.str(), Logger::log_level_t::NONE);
+			}
+#endif
 			if (is_directory == -1)
 				return -errno;
 			if (is_directory) {
-				res = ::lstat((priv->tiers_.front()->path() / path).c_str(), stbuf);
+				res = ::lstat((tier_path / path).c_str(), stbuf);
 			} else {
-				Metadata f(path, priv->db_);
-#ifdef LOG_METHODS
-				{
-					std::stringstream ss;
-					ss << "getattr file " << path << " found? " << std::boolalpha << !f.not_found();
-					Logging::log.message(ss.str(), Logger::log_level_t::NONE);
-				}
-#endif
-				if (f.not_found())
-					return -ENOENT;
-
-				fs::path tier_path = f.tier_path();
 #ifdef LOG_METHODS
 				{
 					std::stringstream ss;
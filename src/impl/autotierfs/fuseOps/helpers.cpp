@@ -21,13 +21,27 @@
  *    along with autotier.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include "TierEngine/TierEngine.hpp"
+#include "config.hpp"
 #include "fuseOps.hpp"
+#include "metadata.hpp"
+#include "pathCache.hpp"
 #include "rocksDbHelpers.hpp"
 #include "tier.hpp"
 
 namespace l {
+	static thread_local fuse_context *lowlevel_context = nullptr; ///< Set per low-level request
+
+	fuse_context *get_context(void) {
+		return lowlevel_context ? lowlevel_context : fuse_get_context();
+	}
+
+	void set_context(fuse_context *ctx) {
+		lowlevel_context = ctx;
+	}
+
 	int is_directory(const fs::path &relative_path) {
-		FusePriv *priv = (FusePriv *)fuse_get_context()->private_data;
+		FusePriv *priv = (FusePriv *)l::get_context()->private_data;
 		fs::file_status status;
 		try {
 			status = fs::symlink_status(priv->tiers_.front()->path() / relative_path);
@@ -38,8 +52,49 @@ namespace l {
 		return fs::is_directory(status);
 	}
 
+	int find_path(const char *path, fs::path &tier_path) {
+		FusePriv *priv = (FusePriv *)l::get_context()->private_data;
+		PathCache::Entry entry;
+		if (priv->path_cache_->lookup(path, entry)) {
+			if (entry.tier_ == nullptr) {
+				errno = ENOENT;
+				return -1;
+			}
+			tier_path = entry.tier_->path();
+			return entry.directory_;
+		}
+		uint64_t generation = priv->path_cache_->generation(path);
+		int is_dir = is_directory(path);
+		if (is_dir == -1)
+			return -1;
+		if (is_dir) {
+			entry.tier_ = priv->tiers_.front();
+		} else {
+			Metadata f(path, priv->db_);
+			if (f.not_found()) {
+				entry.tier_ = nullptr;
+				entry.directory_ = false;
+				priv->path_cache_->insert(path, entry, generation);
+				errno = ENOENT;
+				return -1;
+			}
+			tier_path = f.tier_path();
+			entry.tier_ = nullptr;
+			for (Tier *tptr : priv->tiers_) {
+				if (tptr->path() == tier_path)
+					entry.tier_ = tptr;
+			}
+			if (entry.tier_ == nullptr)
+				return 0; // tier no longer configured, don't cache
+		}
+		entry.directory_ = is_dir;
+		tier_path = entry.tier_->path();
+		priv->path_cache_->insert(path, entry, generation);
+		return is_dir;
+	}
+
 	Tier *fullpath_to_tier(fs::path fullpath) {
-		FusePriv *priv = (FusePriv *)fuse_get_context()->private_data;
+		FusePriv *priv = (FusePriv *)l::get_context()->private_data;
 		for (Tier *tptr : priv->tiers_) {
 			if (std::equal(tptr->path().string().begin(),
 						   tptr->path().string().end(),
@@ -66,40 +121,22 @@ namespace l {
 		return st.st_size;
 	}
 
-	void update_keys_in_directory(std::string old_directory,
-								  std::string new_directory,
-								  std::shared_ptr<::rocksdb::DB> db) {
-		// Remove leading /.
-		if (old_directory.front() == '/')
-			old_directory = old_directory.substr(1, std::string::npos);
-		if (new_directory.front() == '/')
-			new_directory = new_directory.substr(1, std::string::npos);
-
-		/* Ensure that only paths containing exclusively the changed directory are updated.
-		 * EX: subdir and subdir2 exist. If subdir is updated, test should check for "subdir/"
-		 * to avoid changing subdir2 aswell.
-		 */
-		if (old_directory.back() != '/')
-			old_directory += '/';
-		if (new_directory.back() != '/')
-			new_directory += '/';
-
-		// Batch changes to atomically update keys
-		::rocksdb::WriteBatch batch;
-
-		::rocksdb::ReadOptions read_options;
-		::rocksdb::Iterator *itr = db->NewIterator(read_options);
-		for (itr->Seek(old_directory); itr->Valid() && itr->key().starts_with(old_directory);
-			 itr->Next()) {
-			std::string old_path = itr->key().ToString();
-			std::string new_path = new_directory + old_path.substr(old_directory.length());
-			batch.Delete(itr->key());
-			batch.Put(new_path, itr->value());
-		}
-		delete itr;
-		{
-			std::lock_guard<std::mutex> lk(l::rocksdb::global_lock_);
-			db->Write(::rocksdb::WriteOptions(), &batch);
+	void set_cache_policy(const char *path, int fd, const Tier *tptr, struct fuse_file_info *fi) {
+		FusePriv *priv = (FusePriv *)l::get_context()->private_data;
+		const Config &config = priv->autotier_->get_config();
+		// skip the statistics read unless a policy is enabled
+		if (config.keep_cache_popularity() == 0 && config.direct_io_size() == 0)
+			return;
+		struct stat st;
+		if (fstat(fd, &st) == -1)
+			return;
+		double popularity = Metadata::read_popularity(path, priv->db_);
+		if (config.keep_cache_popularity() != 0 && popularity >= config.keep_cache_popularity()
+			&& priv->mtime_unchanged(path, st.st_mtim)) {
+			fi->keep_cache = 1;
+		} else if (config.direct_io_size() != 0 && (uint64_t)st.st_size >= config.direct_io_size()
+				   && popularity < config.direct_io_popularity() && tptr != priv->tiers_.front()) {
+			fi->direct_io = 1;
 		}
 	}
 } // namespace l
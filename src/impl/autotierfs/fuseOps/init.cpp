@@ -46,13 +46,20 @@ namespace fuse_ops {
 
 		cfg->entry_timeout = 0;
 		cfg->attr_timeout = 0;
-		cfg->negative_timeout = 0;
 		cfg->nullpath_ok = 1;
 
 		FusePriv *priv = new FusePriv;
 
 		priv->autotier_ = autotier_ptr;
 
+		// missing paths are cached in path_cache_, kernel caching is opt-in since files
+		// added directly to a tier would stay hidden until it expires
+		cfg->negative_timeout = priv->autotier_->get_config().negative_timeout();
+		// unless caching is asked for, in which case changes made by autotier itself are
+		// invalidated through KernelCache and hardlinks may show a stale st_nlink
+		cfg->entry_timeout = cfg->attr_timeout =
+			priv->autotier_->get_config().kernel_cache_timeout();
+
 		for (std::list<Tier>::iterator tptr = priv->autotier_->get_tiers().begin();
 			 tptr != priv->autotier_->get_tiers().end();
 			 ++tptr)
@@ -62,6 +69,13 @@ namespace fuse_ops {
 		// opens the db
 		priv->db_ = priv->autotier_->get_db();
 
+		priv->journal_ = &priv->autotier_->get_journal();
+
+		priv->access_cache_ = &priv->autotier_->get_access_cache();
+		priv->access_cache_->start(priv->db_);
+
+		priv->path_cache_ = &priv->autotier_->get_path_cache();
+
 		priv->tier_worker_ = std::thread(&TierEngine::begin, priv->autotier_, true);
 
 		priv->adhoc_server_ = std::thread(&TierEngine::process_adhoc_requests, priv->autotier_);
@@ -0,0 +1,72 @@
+/*
+ *    Copyright (C) 2019-2021 Joshua Boudreau <jboudreau@45drives.com>
+ *
+ *    This file is part of autotier.
+ *
+ *    autotier is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    autotier is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with autotier.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "kernelCache.hpp"
+
+#include "alert.hpp"
+#include "fuseOps.hpp"
+#include "inodeTable.hpp"
+
+namespace KernelCache {
+	std::mutex session_mt_;
+	struct fuse *fuse_ = nullptr;       ///< High-level session, or nullptr
+	struct fuse_session *se_ = nullptr; ///< Low-level session, or nullptr
+	InodeTable *inodes_ = nullptr;      ///< Node ids of the low-level session
+} // namespace KernelCache
+
+void KernelCache::set_fuse(struct fuse *fuse) {
+	std::lock_guard<std::mutex> lk(session_mt_);
+	fuse_ = fuse;
+}
+
+void KernelCache::set_session(struct fuse_session *se, InodeTable *inodes) {
+	std::lock_guard<std::mutex> lk(session_mt_);
+	se_ = se;
+	inodes_ = inodes;
+}
+
+void KernelCache::clear(void) {
+	std::lock_guard<std::mutex> lk(session_mt_);
+	fuse_ = nullptr;
+	se_ = nullptr;
+	inodes_ = nullptr;
+}
+
+void KernelCache::invalidate(const char *path) {
+	std::lock_guard<std::mutex> lk(session_mt_);
+	int res = 0;
+	if (fuse_) {
+		res = fuse_invalidate_path(fuse_, ("/" + std::string(path)).c_str());
+	} else if (se_) {
+		std::string relative_path(path);
+		fuse_ino_t parent;
+		fuse_ino_t ino = inodes_->resolve(relative_path, parent);
+		// negative offset drops attributes only, the data is the same after a move
+		if (ino)
+			res = fuse_lowlevel_notify_inval_inode(se_, ino, -1, 0);
+		if (parent && (res == 0 || res == -ENOENT)) {
+			std::string name = fs::path(relative_path).filename().string();
+			res = fuse_lowlevel_notify_inval_entry(se_, parent, name.c_str(), name.size());
+		}
+	}
+	// not known to the kernel
+	if (res != 0 && res != -ENOENT)
+		Logging::log.warning("Failed to invalidate kernel cache of " + std::string(path) + ": "
+							 + strerror(-res));
+}
@@ -22,7 +22,9 @@
  */
 
 #include "fuseOps.hpp"
+#include "journal.hpp"
 #include "metadata.hpp"
+#include "pathCache.hpp"
 
 #ifdef LOG_METHODS
 #	include "alert.hpp"
@@ -34,7 +36,7 @@ namespace fuse_ops {
 	int link(const char *from, const char *to) {
 		int res;
 
-		fuse_context *ctx = fuse_get_context();
+		fuse_context *ctx = l::get_context();
 		FusePriv *priv = (FusePriv *)ctx->private_data;
 		if (!priv)
 			return -ECHILD;
@@ -63,6 +65,8 @@ namespace fuse_ops {
 			return -errno;
 
 		Metadata l(to, priv->db_);
+		priv->path_cache_->invalidate(to);
+		priv->journal_->record(ChangeJournal::MODIFIED, to);
 
 		return res;
 	}
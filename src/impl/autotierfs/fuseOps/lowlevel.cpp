@@ -0,0 +1,960 @@
+/*
+ *    Copyright (C) 2019-2021 Joshua Boudreau <jboudreau@45drives.com>
+ *
+ *    This file is part of autotier.
+ *
+ *    autotier is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    autotier is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with autotier.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "TierEngine/TierEngine.hpp"
+#include "accessCache.hpp"
+#include "alert.hpp"
+#include "config.hpp"
+#include "fuseOps.hpp"
+#include "inodeTable.hpp"
+#include "journal.hpp"
+#include "kernelCache.hpp"
+#include "openFiles.hpp"
+#include "requestCounts.hpp"
+#include "tier.hpp"
+
+#include <regex>
+#include <unordered_map>
+
+extern "C" {
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/fsuid.h>
+#include <sys/stat.h>
+}
+
+namespace fuse_ll_ops {
+	static FusePriv *priv_ptr = nullptr; ///< Set in init(), the low-level API has no context
+	static double negative_timeout = 0;  ///< Seconds the kernel may cache a missing name
+	static double cache_timeout = 0;     ///< Seconds the kernel may cache attributes and entries
+	static bool passthrough = false;     ///< Whether read-only opens are passed through
+
+	/**
+	 * @brief Set the context returned by l::get_context() for the lifetime of a request so
+	 * the path based operations can be called unchanged.
+	 *
+	 */
+	class RequestContext {
+	public:
+		RequestContext(fuse_req_t req) {
+			const struct fuse_ctx *req_ctx = fuse_req_ctx(req);
+			ctx_.fuse = nullptr;
+			ctx_.uid = req_ctx->uid;
+			ctx_.gid = req_ctx->gid;
+			ctx_.pid = req_ctx->pid;
+			ctx_.private_data = priv_ptr;
+			ctx_.umask = req_ctx->umask;
+			l::set_context(&ctx_);
+		}
+		~RequestContext(void) {
+			l::set_context(nullptr);
+		}
+	private:
+		fuse_context ctx_;
+	};
+
+	/**
+	 * @brief Directory handle with one stream per tier holding the directory.
+	 * Offsets count the entries returned so far.
+	 *
+	 */
+	class DirHandle {
+	public:
+		std::vector<DIR *> dps_;
+		size_t cur_ = 0;
+		off_t offset_ = 0;
+		struct dirent *entry_ = nullptr; ///< Read but did not fit in the last reply
+		~DirHandle(void) {
+			for (DIR *dp : dps_)
+				closedir(dp);
+		}
+	};
+
+	/**
+	 * @brief Backing file registered with the kernel for a node. Shared by every passthrough
+	 * open of the node, as the kernel allows only one backing file per inode.
+	 *
+	 */
+	struct Backing {
+		int id_;    ///< Backing id from fuse_passthrough_open()
+		int opens_; ///< Open file handles using it
+	};
+	static std::mutex backing_mt;
+	static std::unordered_map<fuse_ino_t, Backing> backing;      ///< Of each node passed through
+	static std::unordered_map<uint64_t, fuse_ino_t> backing_fhs; ///< Node of each file handle
+	static std::unordered_map<fuse_ino_t, int> cached;           ///< Page cache opens of nodes
+	static std::unordered_map<uint64_t, fuse_ino_t> cached_fhs;  ///< Node of each such handle
+
+	/**
+	 * @brief Pass a file opened read-only through to its backend file. The kernel refuses
+	 * to mix passthrough and page cache opens of one inode, so writable opens of a node that
+	 * is passed through use direct I/O, and a node with writable opens using the page cache
+	 * is not passed through until they are released.
+	 *
+	 * @param req Request
+	 * @param ino Node id of file
+	 * @param fi Opened file
+	 */
+	static void open_passthrough(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi) {
+#ifdef FUSE_CAP_PASSTHROUGH
+		if (!passthrough)
+			return;
+		std::lock_guard<std::mutex> lk(backing_mt);
+		auto itr = backing.find(ino);
+		if ((fi->flags & O_ACCMODE) != O_RDONLY) {
+			if (itr != backing.end()) {
+				fi->direct_io = 1;
+			} else if (!fi->direct_io) {
+				cached[ino]++;
+				cached_fhs[fi->fh] = ino;
+			}
+			return;
+		}
+		if (itr == backing.end()) {
+			if (cached.find(ino) != cached.end())
+				return;
+			int backing_id = fuse_passthrough_open(req, fi->fh);
+			if (backing_id <= 0) {
+				Logging::log.warning("Passthrough failed for "
+									 + std::string(priv_ptr->fd_to_path(fi->fh))
+									 + ", reading through autotier.");
+				return;
+			}
+			itr = backing.emplace(ino, Backing{backing_id, 0}).first;
+		}
+		itr->second.opens_++;
+		fi->direct_io = 0;
+		fi->backing_id = itr->second.id_;
+		backing_fhs[fi->fh] = ino;
+#else
+		(void)req;
+		(void)ino;
+		(void)fi;
+#endif
+	}
+
+	/**
+	 * @brief Release the backing file of a handle opened by open_passthrough() once no other
+	 * handle of the node uses it, or stop counting the handle as a page cache open.
+	 *
+	 * @param req Request
+	 * @param fi File being released
+	 */
+	static void release_passthrough(fuse_req_t req, struct fuse_file_info *fi) {
+#ifdef FUSE_CAP_PASSTHROUGH
+		std::lock_guard<std::mutex> lk(backing_mt);
+		auto cached_fh = cached_fhs.find(fi->fh);
+		if (cached_fh != cached_fhs.end()) {
+			auto itr = cached.find(cached_fh->second);
+			cached_fhs.erase(cached_fh);
+			if (--itr->second == 0)
+				cached.erase(itr);
+			return;
+		}
+		auto fh = backing_fhs.find(fi->fh);
+		if (fh == backing_fhs.end())
+			return;
+		auto itr = backing.find(fh->second);
+		backing_fhs.erase(fh);
+		if (--itr->second.opens_ == 0) {
+			fuse_passthrough_close(req, itr->second.id_);
+			backing.erase(itr);
+		}
+#else
+		(void)req;
+		(void)fi;
+#endif
+	}
+
+	static std::string child_path(const std::string &parent_path, const char *name) {
+		return (parent_path == "/") ? parent_path + name : parent_path + "/" + name;
+	}
+
+	static int node_path(fuse_ino_t ino, std::string &path) {
+		if (!priv_ptr->inodes_->path(ino, path))
+			return ENOENT;
+		return 0;
+	}
+
+	/**
+	 * @brief Stat name in parent, starting at the tier it was last seen in and finding it
+	 * by path again if it moved.
+	 *
+	 * @param parent Node id of parent directory
+	 * @param name Name in parent
+	 * @param tier Set to tier holding the file, -1 for directories
+	 * @param st Set to status
+	 * @return int 0 or errno
+	 */
+	static int stat_child(fuse_ino_t parent, const char *name, int &tier, struct stat *st) {
+		if (priv_ptr->inodes_->find(parent, name, tier)) {
+			InodeTable::DirFd dir_fd(*priv_ptr->inodes_, parent, (tier == -1) ? 0 : tier);
+			if (dir_fd.fd() != -1 && ::fstatat(dir_fd.fd(), name, st, AT_SYMLINK_NOFOLLOW) == 0
+				&& (S_ISDIR(st->st_mode) == (tier == -1)))
+				return 0;
+		}
+		std::string parent_path;
+		if (node_path(parent, parent_path) != 0)
+			return ENOENT;
+		std::string path = child_path(parent_path, name);
+		fs::path tier_path;
+		int is_directory = l::find_path(path.c_str(), tier_path);
+		if (is_directory == -1)
+			return errno;
+		tier = -1;
+		if (!is_directory) {
+			for (size_t i = 0; i < priv_ptr->tiers_.size(); i++)
+				if (priv_ptr->tiers_[i]->path() == tier_path)
+					tier = i;
+			if (tier == -1)
+				return ENOENT;
+		}
+		InodeTable::DirFd dir_fd(*priv_ptr->inodes_, parent, (tier == -1) ? 0 : tier);
+		if (dir_fd.fd() == -1 || ::fstatat(dir_fd.fd(), name, st, AT_SYMLINK_NOFOLLOW) == -1)
+			return errno;
+		return 0;
+	}
+
+	static int stat_node(fuse_ino_t ino, struct stat *st) {
+		fuse_ino_t parent;
+		std::string name;
+		int tier;
+		if (ino == ROOT_INODE) {
+			InodeTable::DirFd root_fd(*priv_ptr->inodes_, ino, 0);
+			return (::fstat(root_fd.fd(), st) == -1) ? errno : 0;
+		}
+		if (!priv_ptr->inodes_->entry(ino, parent, name, tier) || name.empty())
+			return ENOENT;
+		int old_tier = tier;
+		int res = stat_child(parent, name.c_str(), tier, st);
+		if (res == 0 && tier != old_tier)
+			priv_ptr->inodes_->set_tier(ino, tier);
+		return res;
+	}
+
+	/**
+	 * @brief Reply to a request creating or looking up name in parent with its entry.
+	 *
+	 * @param req Request
+	 * @param parent Node id of parent directory
+	 * @param name Name in parent
+	 */
+	static void reply_entry(fuse_req_t req, fuse_ino_t parent, const char *name) {
+		struct fuse_entry_param e;
+		int tier;
+		memset(&e, 0, sizeof(e));
+		int res = stat_child(parent, name, tier, &e.attr);
+		if (res == ENOENT && negative_timeout > 0) {
+			e.ino = 0;
+			e.entry_timeout = negative_timeout;
+			fuse_reply_entry(req, &e);
+			return;
+		}
+		if (res != 0) {
+			fuse_reply_err(req, res);
+			return;
+		}
+		e.ino = priv_ptr->inodes_->add(parent, name, tier);
+		e.attr_timeout = e.entry_timeout = cache_timeout;
+		fuse_reply_entry(req, &e);
+	}
+
+	static void reply_attr(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi) {
+		struct stat st;
+		int res;
+		if (fi)
+			res = (::fstat(fi->fh, &st) == -1) ? errno : 0;
+		else
+			res = stat_node(ino, &st);
+		if (res != 0)
+			fuse_reply_err(req, res);
+		else
+			fuse_reply_attr(req, &st, cache_timeout);
+	}
+
+	/**
+	 * @brief Set up FusePriv and the inode table.
+	 *
+	 * @param userdata Pointer to the session, set once fuse_session_new() returned
+	 * @param conn Connection info
+	 */
+	static void init(void *userdata, struct fuse_conn_info *conn) {
+		struct fuse_config cfg;
+		memset(&cfg, 0, sizeof(cfg));
+		priv_ptr = (FusePriv *)fuse_ops::init(conn, &cfg);
+		negative_timeout = cfg.negative_timeout;
+		cache_timeout = cfg.attr_timeout;
+		priv_ptr->inodes_ = new InodeTable(priv_ptr->tiers_);
+		if (cache_timeout > 0 || negative_timeout > 0)
+			KernelCache::set_session(*(struct fuse_session **)userdata, priv_ptr->inodes_);
+		if (priv_ptr->autotier_->get_config().passthrough()) {
+#ifdef FUSE_CAP_PASSTHROUGH
+			passthrough = conn->capable & FUSE_CAP_PASSTHROUGH;
+			if (passthrough) {
+				conn->want |= FUSE_CAP_PASSTHROUGH;
+				// tiers are not stacked filesystems themselves
+				conn->max_backing_stack_depth = 1;
+			}
+#endif
+			if (!passthrough)
+				Logging::log.warning("Passthrough not supported, reading through autotier.");
+		}
+	}
+
+	static void destroy(void *userdata) {
+		(void)userdata;
+		KernelCache::clear();
+		delete priv_ptr->inodes_;
+		priv_ptr->inodes_ = nullptr;
+		fuse_ops::destroy(priv_ptr);
+		priv_ptr = nullptr;
+	}
+
+	static void lookup(fuse_req_t req, fuse_ino_t parent, const char *name) {
+		RequestContext rc(req);
+		reply_entry(req, parent, name);
+	}
+
+	static void forget(fuse_req_t req, fuse_ino_t ino, uint64_t nlookup) {
+		priv_ptr->inodes_->forget(ino, nlookup);
+		fuse_reply_none(req);
+	}
+
+	static void forget_multi(fuse_req_t req, size_t count, struct fuse_forget_data *forgets) {
+		for (size_t i = 0; i < count; i++)
+			priv_ptr->inodes_->forget(forgets[i].ino, forgets[i].nlookup);
+		fuse_reply_none(req);
+	}
+
+	static void getattr(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi) {
+		RequestContext rc(req);
+		reply_attr(req, ino, fi);
+	}
+
+	static void setattr(fuse_req_t req,
+						fuse_ino_t ino,
+						struct stat *attr,
+						int to_set,
+						struct fuse_file_info *fi) {
+		RequestContext rc(req);
+		std::string path;
+		int res = node_path(ino, path);
+		if (res != 0 && !fi) {
+			fuse_reply_err(req, res);
+			return;
+		}
+		const char *cpath = (res == 0) ? path.c_str() : nullptr;
+		res = 0;
+		if (to_set & FUSE_SET_ATTR_MODE)
+			res = fuse_ops::chmod(cpath, attr->st_mode, fi);
+		if (res == 0 && (to_set & (FUSE_SET_ATTR_UID | FUSE_SET_ATTR_GID)))
+			res = fuse_ops::chown(cpath,
+								  (to_set & FUSE_SET_ATTR_UID) ? attr->st_uid : (uid_t)-1,
+								  (to_set & FUSE_SET_ATTR_GID) ? attr->st_gid : (gid_t)-1,
+								  fi);
+		if (res == 0 && (to_set & FUSE_SET_ATTR_SIZE))
+			res = fuse_ops::truncate(cpath, attr->st_size, fi);
+		if (res == 0 && (to_set & (FUSE_SET_ATTR_ATIME | FUSE_SET_ATTR_MTIME))) {
+			struct timespec ts[2];
+			ts[0].tv_sec = ts[1].tv_sec = 0;
+			ts[0].tv_nsec = ts[1].tv_nsec = UTIME_OMIT;
+			if (to_set & FUSE_SET_ATTR_ATIME_NOW)
+				ts[0].tv_nsec = UTIME_NOW;
+			else if (to_set & FUSE_SET_ATTR_ATIME)
+				ts[0] = attr->st_atim;
+			if (to_set & FUSE_SET_ATTR_MTIME_NOW)
+				ts[1].tv_nsec = UTIME_NOW;
+			else if (to_set & FUSE_SET_ATTR_MTIME)
+				ts[1] = attr->st_mtim;
+			res = fuse_ops::utimens(cpath, ts, fi);
+		}
+		if (res != 0)
+			fuse_reply_err(req, -res);
+		else
+			reply_attr(req, ino, fi);
+	}
+
+	static void readlink(fuse_req_t req, fuse_ino_t ino) {
+		RequestContext rc(req);
+		std::string path;
+		char buf[PATH_MAX + 1];
+		int res = node_path(ino, path);
+		if (res == 0)
+			res = -fuse_ops::readlink(path.c_str(), buf, sizeof(buf));
+		if (res != 0)
+			fuse_reply_err(req, res);
+		else
+			fuse_reply_readlink(req, buf);
+	}
+
+	/**
+	 * @brief Call a path based operation creating name in parent, then reply with its entry.
+	 *
+	 * @tparam F Callable taking the new path and returning 0 or -errno
+	 * @param req Request
+	 * @param parent Node id of parent directory
+	 * @param name Name in parent
+	 * @param create_fn Operation
+	 */
+	template<typename F>
+	static void create_entry(fuse_req_t req, fuse_ino_t parent, const char *name, F create_fn) {
+		std::string parent_path;
+		int res = node_path(parent, parent_path);
+		if (res == 0)
+			res = -create_fn(child_path(parent_path, name).c_str());
+		if (res != 0)
+			fuse_reply_err(req, res);
+		else
+			reply_entry(req, parent, name);
+	}
+
+	static void
+	mknod(fuse_req_t req, fuse_ino_t parent, const char *name, mode_t mode, dev_t rdev) {
+		RequestContext rc(req);
+		create_entry(req, parent, name, [=](const char *path) {
+			return fuse_ops::mknod(path, mode, rdev);
+		});
+	}
+
+	static void mkdir(fuse_req_t req, fuse_ino_t parent, const char *name, mode_t mode) {
+		RequestContext rc(req);
+		create_entry(req, parent, name, [=](const char *path) {
+			return fuse_ops::mkdir(path, mode);
+		});
+	}
+
+	static void symlink(fuse_req_t req, const char *link, fuse_ino_t parent, const char *name) {
+		RequestContext rc(req);
+		create_entry(req, parent, name, [=](const char *path) {
+			return fuse_ops::symlink(link, path);
+		});
+	}
+
+	static void link(fuse_req_t req, fuse_ino_t ino, fuse_ino_t newparent, const char *newname) {
+		RequestContext rc(req);
+		std::string from;
+		if (node_path(ino, from) != 0) {
+			fuse_reply_err(req, ENOENT);
+			return;
+		}
+		create_entry(req, newparent, newname, [&](const char *path) {
+			return fuse_ops::link(from.c_str(), path);
+		});
+	}
+
+	static void unlink(fuse_req_t req, fuse_ino_t parent, const char *name) {
+		RequestContext rc(req);
+		std::string parent_path;
+		int res = node_path(parent, parent_path);
+		if (res == 0)
+			res = -fuse_ops::unlink(child_path(parent_path, name).c_str());
+		if (res == 0)
+			priv_ptr->inodes_->remove(parent, name);
+		fuse_reply_err(req, res);
+	}
+
+	static void rmdir(fuse_req_t req, fuse_ino_t parent, const char *name) {
+		RequestContext rc(req);
+		std::string parent_path;
+		int res = node_path(parent, parent_path);
+		if (res == 0)
+			res = -fuse_ops::rmdir(child_path(parent_path, name).c_str());
+		if (res == 0)
+			priv_ptr->inodes_->remove(parent, name);
+		fuse_reply_err(req, res);
+	}
+
+	static void rename(fuse_req_t req,
+					   fuse_ino_t parent,
+					   const char *name,
+					   fuse_ino_t newparent,
+					   const char *newname,
+					   unsigned int flags) {
+		RequestContext rc(req);
+		std::string parent_path;
+		std::string new_parent_path;
+		int res = node_path(parent, parent_path);
+		if (res == 0)
+			res = node_path(newparent, new_parent_path);
+		if (res == 0)
+			res = -fuse_ops::rename(child_path(parent_path, name).c_str(),
+									child_path(new_parent_path, newname).c_str(),
+									flags);
+		if (res == 0)
+			priv_ptr->inodes_->rename(parent, name, newparent, newname);
+		fuse_reply_err(req, res);
+	}
+
+	/**
+	 * @brief Open a file relative to its parent's descriptor in the tier it was last seen
+	 * in, doing the same bookkeeping as fuse_ops::open().
+	 *
+	 * @param ino Node id of file
+	 * @param parent Node id of parent directory
+	 * @param name Name in parent
+	 * @param tier Tier the file was last seen in
+	 * @param fi File info to set fh of
+	 * @return int 0 or errno
+	 */
+	static int open_file(fuse_ino_t ino,
+						 fuse_ino_t parent,
+						 std::string name,
+						 int tier,
+						 struct fuse_file_info *fi) {
+		fuse_context *ctx = l::get_context();
+		std::string path;
+		if (node_path(ino, path) != 0)
+			return ENOENT;
+		for (int attempt = 0;; attempt++) {
+			std::string fullpath = (priv_ptr->tiers_[tier]->path() / path).string();
+			InodeTable::DirFd dir_fd(*priv_ptr->inodes_, parent, tier);
+			struct stat st;
+			int res = -1;
+			// register before open to avoid tiering race, size before open in case of truncate
+			OpenFiles::register_open_file(fullpath);
+			if (dir_fd.fd() != -1 && ::setfsuid(ctx->uid) != -1 && ::setfsgid(ctx->gid) != -1
+				&& ::fstatat(dir_fd.fd(), name.c_str(), &st, 0) == 0)
+				res = ::openat(dir_fd.fd(), name.c_str(), fi->flags, 0777);
+			int err = errno;
+			::setfsuid(getuid());
+			::setfsgid(getgid());
+			if (res != -1) {
+				fi->fh = res;
+				priv_ptr->insert_size_at_open(res, st.st_size);
+				priv_ptr->access_cache_->touch(path.c_str());
+				priv_ptr->journal_->record(ChangeJournal::MODIFIED, path.c_str());
+				l::set_cache_policy(path.c_str(), res, priv_ptr->tiers_[tier], fi);
+				priv_ptr->insert_fd_to_path(res, &fullpath[0]);
+				return 0;
+			}
+			OpenFiles::release_open_file(fullpath);
+			if (err != ENOENT || attempt)
+				return err;
+			// moved to another tier since the lookup
+			if ((err = stat_node(ino, &st)) != 0)
+				return err;
+			if (S_ISDIR(st.st_mode))
+				return EISDIR;
+			if (!priv_ptr->inodes_->entry(ino, parent, name, tier) || tier == -1)
+				return ENOENT;
+		}
+	}
+
+	static void open(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi) {
+		RequestContext rc(req);
+		fuse_ino_t parent;
+		std::string name;
+		int tier;
+		int res = 0;
+		if (!priv_ptr->inodes_->entry(ino, parent, name, tier)
+			|| (ino != ROOT_INODE && name.empty()))
+			res = ENOENT;
+		else if (tier != -1)
+			res = open_file(ino, parent, name, tier, fi);
+		else if ((res = node_path(ino, name)) == 0)
+			res = -fuse_ops::open(name.c_str(), fi);
+		if (res != 0) {
+			fuse_reply_err(req, res);
+			return;
+		}
+		if (tier != -1)
+			open_passthrough(req, ino, fi);
+		fuse_reply_open(req, fi);
+	}
+
+	/**
+	 * @brief Build the path of ino if it is still linked. Operations on open files get
+	 * nullptr otherwise, as with nullpath_ok in the high-level API.
+	 *
+	 * @param ino Node id
+	 * @param path Storage for path
+	 * @return const char* Path or nullptr
+	 */
+	static const char *fh_path(fuse_ino_t ino, std::string &path) {
+		return (node_path(ino, path) == 0) ? path.c_str() : nullptr;
+	}
+
+	static void
+	read(fuse_req_t req, fuse_ino_t ino, size_t size, off_t off, struct fuse_file_info *fi) {
+		RequestContext rc(req);
+		(void)ino;
+		struct fuse_bufvec *bufp = nullptr;
+		int res = fuse_ops::read_buf(nullptr, &bufp, size, off, fi);
+		if (res != 0)
+			fuse_reply_err(req, -res);
+		else
+			fuse_reply_data(req, bufp, FUSE_BUF_SPLICE_MOVE);
+		free(bufp);
+	}
+
+	static void write_buf(fuse_req_t req,
+						  fuse_ino_t ino,
+						  struct fuse_bufvec *bufv,
+						  off_t off,
+						  struct fuse_file_info *fi) {
+		RequestContext rc(req);
+		std::string path;
+		int res = fuse_ops::write_buf(fh_path(ino, path), bufv, off, fi);
+		if (res < 0)
+			fuse_reply_err(req, -res);
+		else
+			fuse_reply_write(req, res);
+	}
+
+	static void flush(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi) {
+		RequestContext rc(req);
+		std::string path;
+		fuse_reply_err(req, -fuse_ops::flush(fh_path(ino, path), fi));
+	}
+
+	static void release(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi) {
+		RequestContext rc(req);
+		std::string path;
+		release_passthrough(req, fi);
+		// the kernel ignores errors of release
+		fuse_ops::release(fh_path(ino, path), fi);
+		fuse_reply_err(req, 0);
+	}
+
+	static void fsync(fuse_req_t req, fuse_ino_t ino, int datasync, struct fuse_file_info *fi) {
+		RequestContext rc(req);
+		std::string path;
+		fuse_reply_err(req, -fuse_ops::fsync(fh_path(ino, path), datasync, fi));
+	}
+
+	static inline DirHandle *get_dir_handle(struct fuse_file_info *fi) {
+		return (DirHandle *)(uintptr_t)fi->fh;
+	}
+
+	static void opendir(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi) {
+		RequestContext rc(req);
+		DirHandle *d = new DirHandle;
+		for (size_t i = 0; i < priv_ptr->tiers_.size(); i++) {
+			InodeTable::DirFd dir_fd(*priv_ptr->inodes_, ino, i);
+			if (dir_fd.fd() == -1)
+				continue;
+			int fd = ::openat(dir_fd.fd(), ".", O_RDONLY | O_DIRECTORY);
+			if (fd == -1)
+				continue;
+			DIR *dp = ::fdopendir(fd);
+			if (dp != NULL)
+				d->dps_.push_back(dp);
+			else
+				::close(fd);
+		}
+		if (d->dps_.empty()) {
+			delete d;
+			fuse_reply_err(req, ENOENT);
+			return;
+		}
+		fi->fh = (uintptr_t)d;
+		fuse_reply_open(req, fi);
+	}
+
+	/**
+	 * @brief Next entry to list, skipping directories already listed from the first tier
+	 * and hidden temporary files of moves in progress.
+	 *
+	 * @param d Directory handle
+	 * @return struct dirent* Entry or nullptr at the end
+	 */
+	static struct dirent *next_entry(DirHandle *d) {
+		static const std::regex temp_file_re("^\\..*\\.autotier\\.hide$");
+		while (!d->entry_ && d->cur_ < d->dps_.size()) {
+			struct dirent *entry = ::readdir(d->dps_[d->cur_]);
+			if (!entry)
+				++d->cur_;
+			else if (!(entry->d_type == DT_DIR && d->cur_ != 0)
+					 && !std::regex_match(entry->d_name, temp_file_re))
+				d->entry_ = entry;
+		}
+		return d->entry_;
+	}
+
+	static void readdir(fuse_req_t req,
+						fuse_ino_t ino,
+						size_t size,
+						off_t off,
+						struct fuse_file_info *fi) {
+		(void)ino;
+		DirHandle *d = get_dir_handle(fi);
+		if (off != d->offset_) {
+			// seeked, count entries from the start again
+			for (DIR *dp : d->dps_)
+				rewinddir(dp);
+			d->cur_ = 0;
+			d->offset_ = 0;
+			d->entry_ = nullptr;
+			while (d->offset_ < off && next_entry(d)) {
+				d->entry_ = nullptr;
+				d->offset_++;
+			}
+		}
+		std::vector<char> buf(size);
+		size_t used = 0;
+		while (struct dirent *entry = next_entry(d)) {
+			struct stat st;
+			memset(&st, 0, sizeof(st));
+			st.st_ino = entry->d_ino;
+			st.st_mode = entry->d_type << 12;
+			size_t len = fuse_add_direntry(
+				req, buf.data() + used, size - used, entry->d_name, &st, d->offset_ + 1);
+			if (len > size - used)
+				break;
+			used += len;
+			d->entry_ = nullptr;
+			d->offset_++;
+		}
+		fuse_reply_buf(req, buf.data(), used);
+	}
+
+	static void releasedir(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi) {
+		(void)ino;
+		delete get_dir_handle(fi);
+		fuse_reply_err(req, 0);
+	}
+
+#ifdef USE_FSYNCDIR
+	static void fsyncdir(fuse_req_t req, fuse_ino_t ino, int datasync, struct fuse_file_info *fi) {
+		(void)ino;
+		int res = 0;
+		for (DIR *dp : get_dir_handle(fi)->dps_)
+			if ((datasync ? ::fdatasync(dirfd(dp)) : ::fsync(dirfd(dp))) == -1)
+				res = errno;
+		fuse_reply_err(req, res);
+	}
+#endif
+
+	static void statfs(fuse_req_t req, fuse_ino_t ino) {
+		RequestContext rc(req);
+		std::string path;
+		struct statvfs st;
+		int res = node_path(ino, path);
+		if (res == 0)
+			res = -fuse_ops::statfs(path.c_str(), &st);
+		if (res != 0)
+			fuse_reply_err(req, res);
+		else
+			fuse_reply_statfs(req, &st);
+	}
+
+	static void setxattr(fuse_req_t req,
+						 fuse_ino_t ino,
+						 const char *name,
+						 const char *value,
+						 size_t size,
+						 int flags) {
+		RequestContext rc(req);
+		std::string path;
+		int res = node_path(ino, path);
+		if (res == 0)
+			res = -fuse_ops::setxattr(path.c_str(), name, value, size, flags);
+		fuse_reply_err(req, res);
+	}
+
+	/**
+	 * @brief Reply to getxattr or listxattr, with the size only if size is 0.
+	 *
+	 * @tparam F Callable taking a buffer and its size, returning length or -errno
+	 * @param req Request
+	 * @param size Size of reply buffer
+	 * @param xattr_fn Operation
+	 */
+	template<typename F>
+	static void reply_xattr(fuse_req_t req, size_t size, F xattr_fn) {
+		std::vector<char> buf(size);
+		int res = xattr_fn(size ? buf.data() : nullptr, size);
+		if (res < 0)
+			fuse_reply_err(req, -res);
+		else if (size == 0)
+			fuse_reply_xattr(req, res);
+		else
+			fuse_reply_buf(req, buf.data(), res);
+	}
+
+	static void getxattr(fuse_req_t req, fuse_ino_t ino, const char *name, size_t size) {
+		RequestContext rc(req);
+		std::string path;
+		if (node_path(ino, path) != 0) {
+			fuse_reply_err(req, ENOENT);
+			return;
+		}
+		reply_xattr(req, size, [&](char *value, size_t value_size) {
+			return fuse_ops::getxattr(path.c_str(), name, value, value_size);
+		});
+	}
+
+	static void listxattr(fuse_req_t req, fuse_ino_t ino, size_t size) {
+		RequestContext rc(req);
+		std::string path;
+		if (node_path(ino, path) != 0) {
+			fuse_reply_err(req, ENOENT);
+			return;
+		}
+		reply_xattr(req, size, [&](char *list, size_t list_size) {
+			return fuse_ops::listxattr(path.c_str(), list, list_size);
+		});
+	}
+
+	static void removexattr(fuse_req_t req, fuse_ino_t ino, const char *name) {
+		RequestContext rc(req);
+		std::string path;
+		int res = node_path(ino, path);
+		if (res == 0)
+			res = -fuse_ops::removexattr(path.c_str(), name);
+		fuse_reply_err(req, res);
+	}
+
+	static void access(fuse_req_t req, fuse_ino_t ino, int mask) {
+		RequestContext rc(req);
+		std::string path;
+		int res = node_path(ino, path);
+		if (res == 0)
+			res = -fuse_ops::access(path.c_str(), mask);
+		fuse_reply_err(req, res);
+	}
+
+	static void create(fuse_req_t req,
+					   fuse_ino_t parent,
+					   const char *name,
+					   mode_t mode,
+					   struct fuse_file_info *fi) {
+		RequestContext rc(req);
+		std::string parent_path;
+		struct fuse_entry_param e;
+		int tier;
+		int res = node_path(parent, parent_path);
+		std::string path = child_path(parent_path, name);
+		if (res == 0)
+			res = -fuse_ops::create(path.c_str(), mode, fi);
+		if (res != 0) {
+			fuse_reply_err(req, res);
+			return;
+		}
+		memset(&e, 0, sizeof(e));
+		if ((res = stat_child(parent, name, tier, &e.attr)) != 0) {
+			fuse_ops::release(path.c_str(), fi);
+			fuse_reply_err(req, res);
+			return;
+		}
+		e.ino = priv_ptr->inodes_->add(parent, name, tier);
+		e.attr_timeout = e.entry_timeout = cache_timeout;
+		open_passthrough(req, e.ino, fi);
+		fuse_reply_create(req, &e, fi);
+	}
+
+	static void flock(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi, int op) {
+		RequestContext rc(req);
+		std::string path;
+		fuse_reply_err(req, -fuse_ops::flock(fh_path(ino, path), fi, op));
+	}
+
+	static void fallocate(fuse_req_t req,
+						  fuse_ino_t ino,
+						  int mode,
+						  off_t offset,
+						  off_t length,
+						  struct fuse_file_info *fi) {
+		RequestContext rc(req);
+		std::string path;
+		fuse_reply_err(req, -fuse_ops::fallocate(fh_path(ino, path), mode, offset, length, fi));
+	}
+
+#ifndef EL8
+	static void copy_file_range(fuse_req_t req,
+								fuse_ino_t ino_in,
+								off_t off_in,
+								struct fuse_file_info *fi_in,
+								fuse_ino_t ino_out,
+								off_t off_out,
+								struct fuse_file_info *fi_out,
+								size_t len,
+								int flags) {
+		RequestContext rc(req);
+		std::string path_in;
+		std::string path_out;
+		ssize_t res = fuse_ops::copy_file_range(fh_path(ino_in, path_in),
+												fi_in,
+												off_in,
+												fh_path(ino_out, path_out),
+												fi_out,
+												off_out,
+												len,
+												flags);
+		if (res < 0)
+			fuse_reply_err(req, -res);
+		else
+			fuse_reply_write(req, res);
+	}
+
+	static void
+	lseek(fuse_req_t req, fuse_ino_t ino, off_t off, int whence, struct fuse_file_info *fi) {
+		RequestContext rc(req);
+		std::string path;
+		off_t res = fuse_ops::lseek(fh_path(ino, path), off, whence, fi);
+		if (res < 0)
+			fuse_reply_err(req, -res);
+		else
+			fuse_reply_lseek(req, res);
+	}
+#endif
+
+	const struct fuse_lowlevel_ops operations = {
+		.init = init,
+		.destroy = destroy,
+		.lookup = COUNTED(lookup),
+		.forget = COUNTED(forget),
+		.getattr = COUNTED(getattr),
+		.setattr = COUNTED(setattr),
+		.readlink = COUNTED(readlink),
+		.mknod = COUNTED(mknod),
+		.mkdir = COUNTED(mkdir),
+		.unlink = COUNTED(unlink),
+		.rmdir = COUNTED(rmdir),
+		.symlink = COUNTED(symlink),
+		.rename = COUNTED(rename),
+		.link = COUNTED(link),
+		.open = COUNTED(open),
+		.read = COUNTED(read),
+		.flush = COUNTED(flush),
+		.release = COUNTED(release),
+		.fsync = COUNTED(fsync),
+		.opendir = COUNTED(opendir),
+		.readdir = COUNTED(readdir),
+		.releasedir = COUNTED(releasedir),
+#ifdef USE_FSYNCDIR
+		.fsyncdir = COUNTED(fsyncdir),
+#endif
+		.statfs = COUNTED(statfs),
+		.setxattr = COUNTED(setxattr),
+		.getxattr = COUNTED(getxattr),
+		.listxattr = COUNTED(listxattr),
+		.removexattr = COUNTED(removexattr),
+		.access = COUNTED(access),
+		.create = COUNTED(create),
+		.write_buf = COUNTED(write_buf),
+		.forget_multi = COUNTED(forget_multi),
+		.flock = COUNTED(flock),
+		.fallocate = COUNTED(fallocate),
+#ifndef EL8
+		.copy_file_range = COUNTED(copy_file_range),
+		.lseek = COUNTED(lseek),
+#endif
+	};
+} // namespace fuse_ll_ops
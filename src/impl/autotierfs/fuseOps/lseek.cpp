@@ -22,7 +22,6 @@
  */
 
 #include "fuseOps.hpp"
-#include "metadata.hpp"
 
 #ifdef LOG_METHODS
 #	include "alert.hpp"
@@ -44,14 +43,13 @@ namespace fuse_ops {
 #endif
 
 		if (fi == NULL) {
-			fuse_context *ctx = fuse_get_context();
+			fuse_context *ctx = l::get_context();
 			FusePriv *priv = (FusePriv *)ctx->private_data;
 			if (!priv)
 				return -ECHILD;
-			Metadata f(path, priv->db_);
-			if (f.not_found())
-				return -ENOENT;
-			fs::path tier_path = f.tier_path();
+			fs::path tier_path;
+			if (l::find_path(path, tier_path) == -1)
+				return -errno;
 			fd = ::open((tier_path / path).c_str(), O_RDONLY, 0777);
 		} else
 			fd = fi->fh;
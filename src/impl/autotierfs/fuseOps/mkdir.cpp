@@ -22,6 +22,7 @@
  */
 
 #include "fuseOps.hpp"
+#include "pathCache.hpp"
 #include "tier.hpp"
 
 #ifdef LOG_METHODS
@@ -34,7 +35,7 @@ namespace fuse_ops {
 	int mkdir(const char *path, mode_t mode) {
 		int res;
 
-		fuse_context *ctx = fuse_get_context();
+		fuse_context *ctx = l::get_context();
 		FusePriv *priv = (FusePriv *)ctx->private_data;
 		if (!priv)
 			return -ECHILD;
@@ -56,6 +57,7 @@ namespace fuse_ops {
 			if (res == -1)
 				return -errno;
 		}
+		priv->path_cache_->invalidate(path);
 
 		return res;
 	}
@@ -22,7 +22,9 @@
  */
 
 #include "fuseOps.hpp"
+#include "journal.hpp"
 #include "metadata.hpp"
+#include "pathCache.hpp"
 #include "tier.hpp"
 
 #ifdef LOG_METHODS
@@ -35,7 +37,7 @@ namespace fuse_ops {
 	int mknod(const char *path, mode_t mode, dev_t rdev) {
 		int res;
 
-		fuse_context *ctx = fuse_get_context();
+		fuse_context *ctx = l::get_context();
 		FusePriv *priv = (FusePriv *)ctx->private_data;
 		if (!priv)
 			return -ECHILD;
@@ -63,6 +65,8 @@ namespace fuse_ops {
 			return -errno;
 
 		Metadata l(path, priv->db_, priv->tiers_.front());
+		priv->path_cache_->invalidate(path);
+		priv->journal_->record(ChangeJournal::MODIFIED, path);
 
 		return res;
 	}
@@ -21,8 +21,9 @@
  *    along with autotier.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include "accessCache.hpp"
 #include "fuseOps.hpp"
-#include "metadata.hpp"
+#include "journal.hpp"
 #include "openFiles.hpp"
 #include "tier.hpp"
 
@@ -42,7 +43,7 @@ namespace fuse_ops {
 		int res;
 		char *fullpath = nullptr;
 
-		fuse_context *ctx = fuse_get_context();
+		fuse_context *ctx = l::get_context();
 		FusePriv *priv = (FusePriv *)ctx->private_data;
 		if (!priv)
 			return -ECHILD;
@@ -53,7 +54,8 @@ namespace fuse_ops {
 		Logging::log.message(ss.str(), Logger::log_level_t::NONE);
 #endif
 
-		int is_directory = l::is_directory(path);
+		fs::path tier_path;
+		int is_directory = l::find_path(path, tier_path);
 		if (is_directory == -1)
 			return -errno;
 		if (::setfsuid(ctx->uid) == -1)
@@ -66,12 +68,6 @@ namespace fuse_ops {
 			if (res == -1)
 				goto error_out;
 		} else { // is file
-			Metadata f(path, priv->db_);
-			if (f.not_found()) {
-				errno = ENOENT;
-				goto error_out;
-			}
-			fs::path tier_path = f.tier_path();
 			fullpath = strdup((tier_path / path).c_str());
 			if (fullpath == nullptr)
 				goto error_out;
@@ -92,8 +88,9 @@ namespace fuse_ops {
 			if (::setfsgid(getgid()) == -1)
 				goto registered_error_out;
 			priv->insert_size_at_open(res, file_size);
-			f.touch();
-			f.update(path, priv->db_);
+			priv->access_cache_->touch(path);
+			priv->journal_->record(ChangeJournal::MODIFIED, path);
+			l::set_cache_policy(path, res, l::fullpath_to_tier(fullpath), fi);
 #ifdef LOG_METHODS
 			{
 				std::stringstream ss;
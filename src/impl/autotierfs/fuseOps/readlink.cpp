@@ -22,7 +22,6 @@
  */
 
 #include "fuseOps.hpp"
-#include "metadata.hpp"
 
 #ifdef LOG_METHODS
 #	include "alert.hpp"
@@ -34,7 +33,7 @@ namespace fuse_ops {
 	int readlink(const char *path, char *buf, size_t size) {
 		int res;
 
-		fuse_context *ctx = fuse_get_context();
+		fuse_context *ctx = l::get_context();
 		FusePriv *priv = (FusePriv *)ctx->private_data;
 		if (!priv)
 			return -ECHILD;
@@ -47,11 +46,9 @@ namespace fuse_ops {
 		}
 #endif
 
-		Metadata f(path, priv->db_);
-		if (f.not_found())
-			return -ENOENT;
-
-		fs::path tier_path = f.tier_path();
+		fs::path tier_path;
+		if (l::find_path(path, tier_path) == -1)
+			return -errno;
 
 		res = ::readlink((tier_path / path).c_str(), buf, size - 1);
 
@@ -23,7 +23,9 @@
 
 #include "TierEngine/TierEngine.hpp"
 #include "alert.hpp"
+#include "config.hpp"
 #include "fuseOps.hpp"
+#include "journal.hpp"
 #include "openFiles.hpp"
 #include "tier.hpp"
 
@@ -36,7 +38,7 @@ namespace fuse_ops {
 		int res;
 		(void)path;
 
-		fuse_context *ctx = fuse_get_context();
+		fuse_context *ctx = l::get_context();
 		FusePriv *priv = (FusePriv *)ctx->private_data;
 		if (!priv)
 			return -ECHILD;
@@ -69,6 +71,15 @@ namespace fuse_ops {
 				new_size = l::file_size(fi->fh);
 				if (new_size == -1)
 					return -errno;
+				if (new_size != old_size && tptr)
+					priv->journal_->record(ChangeJournal::MODIFIED,
+										   fullpath + tptr->path().string().size());
+				// pages cached until now stay valid if the file is opened again unchanged
+				struct stat st;
+				if (tptr && priv->autotier_->get_config().keep_cache_popularity() != 0
+					&& fstat(fi->fh, &st) == 0)
+					priv->insert_mtime_at_release(fullpath + tptr->path().string().size(),
+												  st.st_mtim);
 #ifdef LOG_METHODS
 				{
 					std::stringstream ss;
@@ -21,8 +21,12 @@
  *    along with autotier.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include "accessCache.hpp"
 #include "fuseOps.hpp"
+#include "journal.hpp"
 #include "metadata.hpp"
+#include "pathCache.hpp"
+#include "rocksDbHelpers.hpp"
 #include "tier.hpp"
 
 #ifdef LOG_METHODS
@@ -35,7 +39,7 @@ namespace fuse_ops {
 	int rename(const char *from, const char *to, unsigned int flags) {
 		int res;
 
-		fuse_context *ctx = fuse_get_context();
+		fuse_context *ctx = l::get_context();
 		FusePriv *priv = (FusePriv *)ctx->private_data;
 		if (!priv)
 			return -ECHILD;
@@ -58,8 +62,14 @@ namespace fuse_ops {
 				if (res == -1)
 					return -errno;
 			}
-			l::update_keys_in_directory(from + 1, to + 1, priv->db_);
+			Metadata::rename_directory(from, to, priv->db_);
+			priv->path_cache_->invalidate_dir(from);
+			priv->path_cache_->invalidate_dir(to);
+			priv->access_cache_->rename(from, to, true);
+			priv->journal_->record(ChangeJournal::RENAMED, from, to);
 		} else {
+			// record is read, then moved to the new key
+			l::rocksdb::KeyLock lk(from, to);
 			Metadata f(from, priv->db_);
 			if (f.not_found())
 				return -ENOENT;
@@ -71,6 +81,11 @@ namespace fuse_ops {
 
 			std::string key_to_delete(from);
 			f.update(to, priv->db_, &key_to_delete);
+			priv->path_cache_->invalidate(from);
+			priv->path_cache_->invalidate(to);
+			priv->access_cache_->rename(from, to, false);
+			priv->journal_->record(ChangeJournal::REMOVED, from);
+			priv->journal_->record(ChangeJournal::MODIFIED, to);
 		}
 
 		return res;
@@ -22,6 +22,8 @@
  */
 
 #include "fuseOps.hpp"
+#include "metadata.hpp"
+#include "pathCache.hpp"
 #include "tier.hpp"
 
 #ifdef LOG_METHODS
@@ -34,7 +36,7 @@ namespace fuse_ops {
 	int rmdir(const char *path) {
 		int res;
 
-		fuse_context *ctx = fuse_get_context();
+		fuse_context *ctx = l::get_context();
 		FusePriv *priv = (FusePriv *)ctx->private_data;
 		if (!priv)
 			return -ECHILD;
@@ -50,10 +52,16 @@ namespace fuse_ops {
 		res = -ENONET;
 		for (Tier *tptr : priv->tiers_) {
 			res = ::rmdir((tptr->path() / path).c_str());
-			if (res == -1)
-				return -errno;
+			if (res == -1) {
+				res = -errno;
+				break;
+			}
 		}
 
+		if (res == 0)
+			Metadata::remove_directory(path, priv->db_);
+		priv->path_cache_->invalidate(path);
+
 		return res;
 	}
 } // namespace fuse_ops
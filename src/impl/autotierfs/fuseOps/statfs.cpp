@@ -34,7 +34,7 @@ namespace fuse_ops {
 	int statfs(const char *path, struct statvfs *stbuf) {
 		int res;
 
-		fuse_context *ctx = fuse_get_context();
+		fuse_context *ctx = l::get_context();
 		FusePriv *priv = (FusePriv *)ctx->private_data;
 		if (!priv)
 			return -ECHILD;
@@ -23,6 +23,7 @@
 
 #include "fuseOps.hpp"
 #include "metadata.hpp"
+#include "pathCache.hpp"
 #include "tier.hpp"
 
 #ifdef LOG_METHODS
@@ -35,7 +36,7 @@ namespace fuse_ops {
 	int symlink(const char *from, const char *to) {
 		int res;
 
-		fuse_context *ctx = fuse_get_context();
+		fuse_context *ctx = l::get_context();
 		FusePriv *priv = (FusePriv *)ctx->private_data;
 		if (!priv)
 			return -ECHILD;
@@ -59,6 +60,7 @@ namespace fuse_ops {
 			return -errno;
 
 		Metadata l(to, priv->db_, priv->tiers_.front());
+		priv->path_cache_->invalidate(to);
 
 		return res;
 	}
@@ -22,7 +22,7 @@
  */
 
 #include "fuseOps.hpp"
-#include "metadata.hpp"
+#include "journal.hpp"
 
 #ifdef LOG_METHODS
 #	include "alert.hpp"
@@ -34,7 +34,7 @@ namespace fuse_ops {
 	int truncate(const char *path, off_t size, struct fuse_file_info *fi) {
 		int res;
 
-		fuse_context *ctx = fuse_get_context();
+		fuse_context *ctx = l::get_context();
 		FusePriv *priv = (FusePriv *)ctx->private_data;
 		if (!priv)
 			return -ECHILD;
@@ -50,12 +50,13 @@ namespace fuse_ops {
 		if (fi) {
 			res = ::ftruncate(fi->fh, size);
 		} else {
-			Metadata f(path, priv->db_);
-			if (f.not_found())
-				return -ENOENT;
-			fs::path tier_path = f.tier_path();
+			fs::path tier_path;
+			if (l::find_path(path, tier_path) == -1)
+				return -errno;
 			fs::path full_path = tier_path / path;
 			res = ::truncate(full_path.c_str(), size);
+			if (res != -1)
+				priv->journal_->record(ChangeJournal::MODIFIED, path);
 		}
 
 		if (res == -1)
@@ -22,8 +22,11 @@
  */
 
 #include "TierEngine/TierEngine.hpp"
+#include "accessCache.hpp"
 #include "fuseOps.hpp"
+#include "journal.hpp"
 #include "metadata.hpp"
+#include "pathCache.hpp"
 #include "rocksDbHelpers.hpp"
 #include "tier.hpp"
 
@@ -37,7 +40,7 @@ namespace fuse_ops {
 	int unlink(const char *path) {
 		int res;
 
-		fuse_context *ctx = fuse_get_context();
+		fuse_context *ctx = l::get_context();
 		FusePriv *priv = (FusePriv *)ctx->private_data;
 		if (!priv)
 			return -ECHILD;
@@ -71,10 +74,15 @@ namespace fuse_ops {
 			return -errno;
 
 		{
-			std::lock_guard<std::mutex> lk(l::rocksdb::global_lock_);
-			if (!priv->db_->Delete(rocksdb::WriteOptions(), path + 1).ok())
+			// keeps a flush of this path's access count from recreating the record
+			l::rocksdb::KeyLock lk(path);
+			if (!Metadata::remove(path, priv->db_))
 				return -1;
+			priv->access_cache_->forget(path);
 		}
+		priv->path_cache_->invalidate(path);
+
+		priv->journal_->record(ChangeJournal::REMOVED, path);
 
 		return res;
 	}
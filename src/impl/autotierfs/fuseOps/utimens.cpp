@@ -22,7 +22,7 @@
  */
 
 #include "fuseOps.hpp"
-#include "metadata.hpp"
+#include "journal.hpp"
 #include "tier.hpp"
 
 #ifdef LOG_METHODS
@@ -46,10 +46,11 @@ namespace fuse_ops {
 		if (fi) {
 			res = ::futimens(fi->fh, ts);
 		} else {
-			int is_directory = l::is_directory(path);
+			fs::path tier_path;
+			int is_directory = l::find_path(path, tier_path);
 			if (is_directory == -1)
 				return -errno;
-			fuse_context *ctx = fuse_get_context();
+			fuse_context *ctx = l::get_context();
 			FusePriv *priv = (FusePriv *)ctx->private_data;
 			if (!priv)
 				return -ECHILD;
@@ -61,12 +62,10 @@ namespace fuse_ops {
 						return res;
 				}
 			} else {
-				Metadata f(path, priv->db_);
-				if (f.not_found())
-					return -ENOENT;
-				fs::path tier_path = f.tier_path();
 				/* don't use utime/utimes since they follow symlinks */
 				res = ::utimensat(0, (tier_path / path).c_str(), ts, AT_SYMLINK_NOFOLLOW);
+				if (res != -1)
+					priv->journal_->record(ChangeJournal::MODIFIED, path);
 			}
 		}
 
@@ -58,7 +58,7 @@ namespace fuse_ops {
 				if (error == ENOSPC) {
 					out_of_space = true;
 					if (!priv) {
-						fuse_context *ctx = fuse_get_context();
+						fuse_context *ctx = l::get_context();
 						priv = (FusePriv *)ctx->private_data;
 						if (!priv)
 							return -error;
@@ -102,7 +102,7 @@ namespace fuse_ops {
 			if (bytes_copied == -ENOSPC) {
 				out_of_space = true;
 				if (!priv) {
-					fuse_context *ctx = fuse_get_context();
+					fuse_context *ctx = l::get_context();
 					priv = (FusePriv *)ctx->private_data;
 					if (!priv)
 						return -ENOSPC;
@@ -22,7 +22,6 @@
  */
 
 #include "fuseOps.hpp"
-#include "metadata.hpp"
 #include "tier.hpp"
 
 #ifdef LOG_METHODS
@@ -39,7 +38,7 @@ namespace fuse_ops {
 	int setxattr(const char *path, const char *name, const char *value, size_t size, int flags) {
 		int res;
 
-		fuse_context *ctx = fuse_get_context();
+		fuse_context *ctx = l::get_context();
 		FusePriv *priv = (FusePriv *)ctx->private_data;
 		if (!priv)
 			return -ECHILD;
@@ -54,7 +53,8 @@ namespace fuse_ops {
 
 		fs::path fullpath;
 
-		int is_directory = l::is_directory(path);
+		fs::path tier_path;
+		int is_directory = l::find_path(path, tier_path);
 		if (is_directory == -1)
 			return -errno;
 		if (is_directory) {
@@ -65,10 +65,7 @@ namespace fuse_ops {
 					return -errno;
 			}
 		} else {
-			Metadata f(path, priv->db_);
-			if (f.not_found())
-				return -ENOENT;
-			fullpath = f.tier_path() + std::string(path);
+			fullpath = tier_path.string() + path;
 			res = ::lsetxattr(fullpath.c_str(), name, value, size, flags);
 			if (res == -1)
 				return -errno;
@@ -80,7 +77,7 @@ namespace fuse_ops {
 	int getxattr(const char *path, const char *name, char *value, size_t size) {
 		int res;
 
-		fuse_context *ctx = fuse_get_context();
+		fuse_context *ctx = l::get_context();
 		FusePriv *priv = (FusePriv *)ctx->private_data;
 		if (!priv)
 			return -ECHILD;
@@ -95,16 +92,14 @@ namespace fuse_ops {
 
 		fs::path fullpath;
 
-		int is_directory = l::is_directory(path);
+		fs::path tier_path;
+		int is_directory = l::find_path(path, tier_path);
 		if (is_directory == -1)
 			return -errno;
 		if (is_directory) {
 			fullpath = priv->tiers_.front()->path() / path;
 		} else {
-			Metadata f(path, priv->db_);
-			if (f.not_found())
-				return -ENOENT;
-			fullpath = f.tier_path() + std::string(path);
+			fullpath = tier_path.string() + path;
 		}
 
 		res = ::lgetxattr(fullpath.c_str(), name, value, size);
@@ -118,7 +113,7 @@ namespace fuse_ops {
 	int listxattr(const char *path, char *list, size_t size) {
 		int res;
 
-		fuse_context *ctx = fuse_get_context();
+		fuse_context *ctx = l::get_context();
 		FusePriv *priv = (FusePriv *)ctx->private_data;
 		if (!priv)
 			return -ECHILD;
@@ -133,16 +128,14 @@ namespace fuse_ops {
 
 		fs::path fullpath;
 
-		int is_directory = l::is_directory(path);
+		fs::path tier_path;
+		int is_directory = l::find_path(path, tier_path);
 		if (is_directory == -1)
 			return -errno;
 		if (is_directory) {
 			fullpath = priv->tiers_.front()->path() / path;
 		} else {
-			Metadata f(path, priv->db_);
-			if (f.not_found())
-				return -ENOENT;
-			fullpath = f.tier_path() + std::string(path);
+			fullpath = tier_path.string() + path;
 		}
 
 		res = ::llistxattr(fullpath.c_str(), list, size);
@@ -155,7 +148,7 @@ namespace fuse_ops {
 	int removexattr(const char *path, const char *name) {
 		int res;
 
-		fuse_context *ctx = fuse_get_context();
+		fuse_context *ctx = l::get_context();
 		FusePriv *priv = (FusePriv *)ctx->private_data;
 		if (!priv)
 			return -ECHILD;
@@ -168,7 +161,8 @@ namespace fuse_ops {
 		}
 #endif
 
-		int is_directory = l::is_directory(path);
+		fs::path tier_path;
+		int is_directory = l::find_path(path, tier_path);
 		if (is_directory == -1)
 			return -errno;
 		if (is_directory) {
@@ -179,10 +173,7 @@ namespace fuse_ops {
 					return -errno;
 			}
 		} else {
-			Metadata f(path, priv->db_);
-			if (f.not_found())
-				return -ENOENT;
-			fs::path fullpath = f.tier_path() + std::string(path);
+			fs::path fullpath = tier_path.string() + path;
 			res = ::lremovexattr(fullpath.c_str(), name);
 			if (res == -1)
 				return -errno;
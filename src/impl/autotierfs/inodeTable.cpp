@@ -0,0 +1,273 @@
+/*
+ *    Copyright (C) 2019-2021 Joshua Boudreau <jboudreau@45drives.com>
+ *
+ *    This file is part of autotier.
+ *
+ *    autotier is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    autotier is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with autotier.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "inodeTable.hpp"
+
+#include "tier.hpp"
+
+#include <algorithm>
+#include <fcntl.h>
+#include <iterator>
+#include <sys/resource.h>
+#include <unistd.h>
+
+InodeTable::DirFd::DirFd(InodeTable &table, uint64_t ino, size_t tier)
+	: table_(table), ino_(ino) {
+	std::lock_guard<std::mutex> lk(table_.mt_);
+	fd_ = table_.open_dir(ino, tier);
+	if (fd_ != -1)
+		table_.nodes_[ino].pins_++;
+}
+
+InodeTable::DirFd::~DirFd(void) {
+	if (fd_ == -1)
+		return;
+	std::lock_guard<std::mutex> lk(table_.mt_);
+	auto itr = table_.nodes_.find(ino_);
+	if (itr != table_.nodes_.end())
+		itr->second.pins_--;
+}
+
+InodeTable::InodeTable(const std::vector<Tier *> &tiers) : next_ino_(ROOT_INODE + 1) {
+	struct rlimit limit;
+	if (getrlimit(RLIMIT_NOFILE, &limit) == -1)
+		limit.rlim_cur = 1024;
+	max_fds_ = std::max<size_t>(limit.rlim_cur / INODE_TABLE_DIR_FD_SHARE, tiers.size());
+	Node root;
+	root.parent_ = 0;
+	root.tier_ = -1;
+	root.pins_ = 0;
+	root.nlookup_ = 1;
+	for (const Tier *tptr : tiers) {
+		tier_paths_.push_back(tptr->path().string());
+		root.fds_.push_back(open(tier_paths_.back().c_str(), O_PATH | O_DIRECTORY));
+	}
+	nodes_.emplace(ROOT_INODE, std::move(root));
+}
+
+InodeTable::~InodeTable(void) {
+	for (auto &node : nodes_)
+		for (int fd : node.second.fds_)
+			if (fd != -1)
+				close(fd);
+}
+
+std::string InodeTable::child_key(uint64_t parent, const std::string &name) {
+	return std::string(reinterpret_cast<const char *>(&parent), sizeof(parent)) + name;
+}
+
+uint64_t InodeTable::find(uint64_t parent, const std::string &name, int &tier) {
+	std::lock_guard<std::mutex> lk(mt_);
+	auto child = children_.find(child_key(parent, name));
+	if (child == children_.end())
+		return 0;
+	tier = nodes_[child->second].tier_;
+	return child->second;
+}
+
+uint64_t InodeTable::add(uint64_t parent, const std::string &name, int tier) {
+	std::lock_guard<std::mutex> lk(mt_);
+	std::string key = child_key(parent, name);
+	auto child = children_.find(key);
+	if (child != children_.end()) {
+		Node &node = nodes_[child->second];
+		if ((node.tier_ == -1) == (tier == -1)) {
+			node.tier_ = tier;
+			node.nlookup_++;
+			return child->second;
+		}
+		// replaced by a different kind of file, give it a new node
+		node.name_.clear();
+		children_.erase(child);
+	}
+	uint64_t ino = next_ino_++;
+	Node node;
+	node.parent_ = parent;
+	node.name_ = name;
+	node.tier_ = tier;
+	if (tier == -1) {
+		node.fds_.assign(tier_paths_.size(), -1);
+		node.used_.resize(tier_paths_.size());
+	}
+	node.pins_ = 0;
+	node.nlookup_ = 1;
+	nodes_.emplace(ino, std::move(node));
+	children_.emplace(std::move(key), ino);
+	return ino;
+}
+
+void InodeTable::forget(uint64_t ino, uint64_t nlookup) {
+	if (ino == ROOT_INODE)
+		return;
+	std::lock_guard<std::mutex> lk(mt_);
+	auto itr = nodes_.find(ino);
+	if (itr == nodes_.end())
+		return;
+	Node &node = itr->second;
+	if (node.nlookup_ > nlookup) {
+		node.nlookup_ -= nlookup;
+		return;
+	}
+	for (size_t tier = 0; tier < node.fds_.size(); tier++) {
+		if (node.fds_[tier] != -1) {
+			close(node.fds_[tier]);
+			lru_.erase(node.used_[tier]);
+		}
+	}
+	if (!node.name_.empty()) {
+		auto child = children_.find(child_key(node.parent_, node.name_));
+		if (child != children_.end() && child->second == ino)
+			children_.erase(child);
+	}
+	nodes_.erase(itr);
+}
+
+bool InodeTable::entry(uint64_t ino, uint64_t &parent, std::string &name, int &tier) {
+	std::lock_guard<std::mutex> lk(mt_);
+	auto itr = nodes_.find(ino);
+	if (itr == nodes_.end())
+		return false;
+	parent = itr->second.parent_;
+	name = itr->second.name_;
+	tier = itr->second.tier_;
+	return true;
+}
+
+bool InodeTable::path(uint64_t ino, std::string &path) {
+	std::lock_guard<std::mutex> lk(mt_);
+	std::vector<const std::string *> names;
+	while (ino != ROOT_INODE) {
+		auto itr = nodes_.find(ino);
+		if (itr == nodes_.end() || itr->second.name_.empty())
+			return false;
+		names.push_back(&itr->second.name_);
+		ino = itr->second.parent_;
+	}
+	path.clear();
+	for (auto name = names.rbegin(); name != names.rend(); ++name)
+		path += "/" + **name;
+	if (path.empty())
+		path = "/";
+	return true;
+}
+
+uint64_t InodeTable::resolve(const std::string &path, uint64_t &parent) {
+	std::lock_guard<std::mutex> lk(mt_);
+	uint64_t ino = ROOT_INODE;
+	parent = 0;
+	size_t start = 0;
+	while (ino && start < path.size()) {
+		size_t end = path.find('/', start);
+		if (end == std::string::npos)
+			end = path.size();
+		if (end != start) {
+			parent = ino;
+			auto child = children_.find(child_key(parent, path.substr(start, end - start)));
+			ino = (child == children_.end()) ? 0 : child->second;
+			if (!ino && end != path.size())
+				parent = 0;
+		}
+		start = end + 1;
+	}
+	return ino;
+}
+
+void InodeTable::set_tier(uint64_t ino, int tier) {
+	std::lock_guard<std::mutex> lk(mt_);
+	auto itr = nodes_.find(ino);
+	if (itr != nodes_.end() && itr->second.tier_ != -1)
+		itr->second.tier_ = tier;
+}
+
+int InodeTable::open_dir(uint64_t ino, size_t tier) {
+	auto itr = nodes_.find(ino);
+	if (itr == nodes_.end() || tier >= itr->second.fds_.size()) {
+		errno = ENOENT;
+		return -1;
+	}
+	Node &node = itr->second;
+	if (ino == ROOT_INODE)
+		return node.fds_[tier];
+	if (node.fds_[tier] != -1) {
+		lru_.splice(lru_.begin(), lru_, node.used_[tier]);
+		return node.fds_[tier];
+	}
+	if (node.name_.empty()) {
+		errno = ENOENT;
+		return -1;
+	}
+	int parent_fd = open_dir(node.parent_, tier);
+	if (parent_fd == -1)
+		return -1;
+	// not cached on failure, the directory may be created in this tier later
+	int fd = openat(parent_fd, node.name_.c_str(), O_PATH | O_DIRECTORY | O_NOFOLLOW);
+	if (fd == -1)
+		return -1;
+	node.fds_[tier] = fd;
+	node.used_[tier] = lru_.emplace(lru_.begin(), ino, tier);
+	close_unused(node.used_[tier]);
+	return fd;
+}
+
+void InodeTable::close_unused(List::iterator keep) {
+	// kept descriptors go back to the front, so each one is passed over once at most
+	for (size_t checked = lru_.size(); lru_.size() > max_fds_ && checked != 0; checked--) {
+		List::iterator oldest = std::prev(lru_.end());
+		Node &node = nodes_[oldest->first];
+		if (oldest == keep || node.pins_ != 0) {
+			lru_.splice(lru_.begin(), lru_, oldest);
+			continue;
+		}
+		close(node.fds_[oldest->second]);
+		node.fds_[oldest->second] = -1;
+		lru_.erase(oldest);
+	}
+}
+
+void InodeTable::rename(uint64_t parent,
+						const std::string &name,
+						uint64_t new_parent,
+						const std::string &new_name) {
+	std::lock_guard<std::mutex> lk(mt_);
+	auto child = children_.find(child_key(parent, name));
+	if (child == children_.end())
+		return;
+	uint64_t ino = child->second;
+	children_.erase(child);
+	std::string new_key = child_key(new_parent, new_name);
+	auto replaced = children_.find(new_key);
+	if (replaced != children_.end()) {
+		nodes_[replaced->second].name_.clear();
+		children_.erase(replaced);
+	}
+	Node &node = nodes_[ino];
+	node.parent_ = new_parent;
+	node.name_ = new_name;
+	// open descriptors follow the directory, nothing to reopen
+	children_.emplace(std::move(new_key), ino);
+}
+
+void InodeTable::remove(uint64_t parent, const std::string &name) {
+	std::lock_guard<std::mutex> lk(mt_);
+	auto child = children_.find(child_key(parent, name));
+	if (child == children_.end())
+		return;
+	nodes_[child->second].name_.clear();
+	children_.erase(child);
+}
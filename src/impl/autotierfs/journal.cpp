@@ -0,0 +1,241 @@
+/*
+ *    Copyright (C) 2019-2021 Joshua Boudreau <jboudreau@45drives.com>
+ *
+ *    This file is part of autotier.
+ *
+ *    autotier is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    autotier is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with autotier.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "journal.hpp"
+
+#include "alert.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <thread>
+
+extern "C" {
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+}
+
+/**
+ * @brief Read rest of fd into data.
+ *
+ * @param fd File descriptor to read
+ * @param data Appended to
+ * @return true Read to end of file
+ * @return false Read failed
+ */
+static bool read_all(int fd, std::string &data) {
+	char buff[JOURNAL_BUFFER_SIZE];
+	ssize_t res;
+	while ((res = ::read(fd, buff, sizeof(buff))) != 0) {
+		if (res == -1) {
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+		data.append(buff, res);
+	}
+	return true;
+}
+
+ChangeJournal::ChangeJournal(void) : sequence_(0), fd_(-1), lost_(false) {}
+
+ChangeJournal::~ChangeJournal(void) {
+	flush();
+	std::lock_guard<std::mutex> lk(fd_mt_);
+	if (fd_ != -1)
+		::close(fd_);
+}
+
+bool ChangeJournal::open(const fs::path &path) {
+	std::lock_guard<std::mutex> lk(fd_mt_);
+	path_ = path;
+	fd_ = ::open(path_.c_str(), O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+	if (fd_ == -1) {
+		Logging::log.warning("Failed to open change journal " + path_.string() + ": "
+							 + strerror(errno));
+		return false;
+	}
+	// records kept from before a restart must stay ahead of new ones
+	std::string data;
+	std::vector<std::pair<uint64_t, Entry>> entries;
+	if (read_all(fd_, data) && parse(data, entries) && !entries.empty()) {
+		uint64_t last = 0;
+		for (const std::pair<uint64_t, Entry> &entry : entries)
+			last = std::max(last, entry.first);
+		sequence_ = last + 1;
+	}
+	return true;
+}
+
+bool ChangeJournal::is_open(void) const {
+	return fd_ != -1;
+}
+
+ChangeJournal::Shard &ChangeJournal::shard(void) {
+	return shards_[std::hash<std::thread::id>()(std::this_thread::get_id()) % JOURNAL_SHARDS];
+}
+
+void ChangeJournal::record(Op op, const char *path, const char *new_path) {
+	if (fd_ == -1)
+		return;
+	while (*path == '/')
+		++path;
+	Shard &s = shard();
+	std::lock_guard<std::mutex> lk(s.mt_);
+	// taken under the shard lock, so drain() sees every number handed out before it
+	uint64_t seq = sequence_++;
+	s.buffer_.push_back(op);
+	s.buffer_.append(reinterpret_cast<const char *>(&seq), sizeof(seq));
+	s.buffer_.append(path);
+	s.buffer_.push_back('\0');
+	if (op == RENAMED) {
+		while (*new_path == '/')
+			++new_path;
+		s.buffer_.append(new_path);
+		s.buffer_.push_back('\0');
+	}
+	if (s.buffer_.size() >= JOURNAL_BUFFER_SIZE) {
+		std::lock_guard<std::mutex> fd_lk(fd_mt_);
+		if (fd_ != -1)
+			write_locked(s.buffer_);
+	}
+}
+
+void ChangeJournal::flush(void) {
+	for (Shard &s : shards_) {
+		std::lock_guard<std::mutex> lk(s.mt_);
+		std::lock_guard<std::mutex> fd_lk(fd_mt_);
+		if (fd_ != -1)
+			write_locked(s.buffer_);
+	}
+}
+
+void ChangeJournal::write_locked(std::string &buffer) {
+	const char *pos = buffer.data();
+	size_t left = buffer.size();
+	while (left) {
+		ssize_t res = ::write(fd_, pos, left);
+		if (res == -1) {
+			if (errno == EINTR)
+				continue;
+			Logging::log.warning(std::string("Failed to write change journal: ")
+								 + strerror(errno));
+			lost_ = true;
+			break;
+		}
+		pos += res;
+		left -= res;
+	}
+	buffer.clear();
+}
+
+bool ChangeJournal::parse(const std::string &data,
+						  std::vector<std::pair<uint64_t, Entry>> &entries) {
+	size_t pos = 0;
+	while (pos < data.size()) {
+		Entry entry;
+		uint64_t seq;
+		if (data.size() - pos < 1 + sizeof(seq))
+			return false;
+		entry.op_ = static_cast<Op>(data[pos++]);
+		std::memcpy(&seq, data.data() + pos, sizeof(seq));
+		pos += sizeof(seq);
+		size_t end = data.find('\0', pos);
+		if (end == std::string::npos)
+			return false; // truncated record
+		entry.path_ = data.substr(pos, end - pos);
+		pos = end + 1;
+		if (entry.op_ == RENAMED) {
+			end = data.find('\0', pos);
+			if (end == std::string::npos)
+				return false;
+			entry.new_path_ = data.substr(pos, end - pos);
+			pos = end + 1;
+		}
+		entries.emplace_back(seq, std::move(entry));
+	}
+	return true;
+}
+
+bool ChangeJournal::drain(std::vector<Entry> &entries) {
+	fs::path drain_path = path_.string() + ".draining";
+	bool complete;
+	{
+		// every shard, in order, then fd_mt_, as record() takes them
+		std::vector<std::unique_lock<std::mutex>> shard_lks;
+		for (Shard &s : shards_)
+			shard_lks.emplace_back(s.mt_);
+		std::lock_guard<std::mutex> lk(fd_mt_);
+		if (fd_ == -1)
+			return false;
+		for (Shard &s : shards_)
+			write_locked(s.buffer_);
+		complete = !lost_;
+		lost_ = false;
+		int new_fd = -1;
+		if (::rename(path_.c_str(), drain_path.c_str()) == 0)
+			new_fd = ::open(path_.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+		if (new_fd == -1) {
+			Logging::log.warning("Failed to rotate change journal " + path_.string() + ": "
+								 + strerror(errno));
+			::unlink(drain_path.c_str());
+			if (::ftruncate(fd_, 0) == -1)
+				lost_ = true;
+			return false;
+		}
+		::close(fd_.exchange(new_fd));
+	}
+	int fd = ::open(drain_path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd == -1) {
+		Logging::log.warning("Failed to read change journal " + drain_path.string() + ": "
+							 + strerror(errno));
+		return false;
+	}
+	std::string data;
+	if (!read_all(fd, data))
+		complete = false;
+	::close(fd);
+	::unlink(drain_path.c_str());
+	std::vector<std::pair<uint64_t, Entry>> sequenced;
+	if (!parse(data, sequenced))
+		complete = false;
+	// shards are written out at different times, so the file is only ordered per shard
+	std::stable_sort(sequenced.begin(),
+					 sequenced.end(),
+					 [](const std::pair<uint64_t, Entry> &a, const std::pair<uint64_t, Entry> &b) {
+						 return a.first < b.first;
+					 });
+	for (std::pair<uint64_t, Entry> &entry : sequenced)
+		entries.emplace_back(std::move(entry.second));
+	return complete;
+}
+
+void ChangeJournal::clear(void) {
+	std::vector<std::unique_lock<std::mutex>> shard_lks;
+	for (Shard &s : shards_)
+		shard_lks.emplace_back(s.mt_);
+	std::lock_guard<std::mutex> lk(fd_mt_);
+	if (fd_ == -1)
+		return;
+	for (Shard &s : shards_)
+		s.buffer_.clear();
+	sequence_ = 0;
+	lost_ = (::ftruncate(fd_, 0) == -1);
+}
@@ -19,22 +19,397 @@
 
 #include "metadata.hpp"
 
+#include "alert.hpp"
+#include "radixSort.hpp"
 #include "rocksDbHelpers.hpp"
 #include "tier.hpp"
 
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <rocksdb/cache.h>
+#include <rocksdb/filter_policy.h>
+#include <rocksdb/table.h>
 #include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+
+#define PINNED_FLAG          0x01       ///< Bit of flags byte in binary records
+#define ROOT_DIR_ID          0          ///< Id of the tier root in the directory table
+#define DIR_ID_CACHE_MAX     65536      ///< Directories cached before the cache is emptied
+#define KEY_CONVERT_BATCH    10000      ///< Records rewritten per batch when changing key form
+#define MAX_DIR_DEPTH        4096       ///< Bounds path lookups through a corrupt directory table
+#define PLACEMENT_CACHE_SIZE (64 << 20) ///< Bytes of block cache for placement records
+#define BLOOM_BITS_PER_KEY   10         ///< About 1% false positives
+#define TIER_PREFIX_SIZE     2          ///< Bytes of tier id before keys in the tier index
+
+/**
+ * @brief Second byte of directory keys, after DIR_KEY_PREFIX.
+ *
+ */
+enum DirKeyType : char {
+	FILE_RECORD = 'F', ///< Parent id and file name, holds Metadata
+	DIR_ENTRY = 'D',   ///< Parent id and directory name, holds id of directory
+	DIR_NAME = 'N'     ///< Directory id, holds parent id and directory name
+};
+
+/**
+ * @brief Tier paths by id. Published once loaded and never changed after, so records can
+ * be read without locking.
+ *
+ */
+struct TierIdTable {
+	std::vector<std::string> paths_;                ///< Tier path of each id
+	std::unordered_map<std::string, uint16_t> ids_; ///< Id of each tier path
+};
+
+static const std::string tier_ids_key("\0tier_ids", 9);              ///< NUL-separated paths by id
+static std::atomic<const TierIdTable *> tier_ids(nullptr);           ///< Current table
+static std::mutex tier_ids_mt;                                       ///< Serializes load_tier_ids()
+static std::vector<std::unique_ptr<TierIdTable>> tier_id_tables;     ///< Every table loaded
+static const std::string next_dir_id_key("\0next_dir_id", 12);       ///< Next unused directory id
+static const std::string stats_split_key("\0stats_split", 12);       ///< Set once stats are split
+static const std::string pins_indexed_key("\0pins_indexed", 13);     ///< Set once pins are indexed
+static const std::string popularity_gen_key("\0popularity_gen", 15); ///< Current index generation
+static std::vector<rocksdb::ColumnFamilyHandle *> cf_handles;        ///< Open column families
+static rocksdb::ColumnFamilyHandle *stats_cf = nullptr;              ///< Statistics column family
+static rocksdb::ColumnFamilyHandle *popularity_cf = nullptr;         ///< Index by popularity
+static rocksdb::ColumnFamilyHandle *pins_cf = nullptr;               ///< Index of pinned files
+static rocksdb::ColumnFamilyHandle *tiers_cf = nullptr;              ///< Index by tier
+
+/**
+ * @brief Append id to key big-endian, so records of a directory sort together.
+ *
+ * @param key
+ * @param id
+ */
+static void append_id(std::string &key, uint64_t id) {
+	for (int shift = 56; shift >= 0; shift -= 8)
+		key.push_back(static_cast<char>((id >> shift) & 0xff));
+}
+
+/**
+ * @brief Read id written by append_id().
+ *
+ * @param data
+ * @return uint64_t
+ */
+static uint64_t read_id(const char *data) {
+	uint64_t id = 0;
+	for (size_t i = 0; i < sizeof(id); ++i)
+		id = (id << 8) | static_cast<unsigned char>(data[i]);
+	return id;
+}
+
+/**
+ * @brief Build a directory key.
+ *
+ * @param type Kind of record
+ * @param id Parent directory id, or directory id for DIR_NAME
+ * @param name File or directory name, empty for DIR_NAME
+ * @return std::string
+ */
+static std::string table_key(DirKeyType type, uint64_t id, const std::string &name) {
+	std::string key(1, DIR_KEY_PREFIX);
+	key.push_back(type);
+	append_id(key, id);
+	key.append(name);
+	return key;
+}
 
 Metadata::Metadata(void)
 	: access_count_(0)
 	, popularity_(0.0)
 	, not_found_(false)
 	, pinned_(false)
-	, tier_path_("") {}
+	, tier_path_("")
+	, tier_id_(NO_TIER_ID) {}
 
 Metadata::Metadata(const std::string &serialized) {
-	std::stringstream ss(serialized);
-	boost::archive::text_iarchive ia(ss);
-	this->serialize(ia, 0);
+	parse(serialized.data(), serialized.size());
+}
+
+Metadata::Metadata(const rocksdb::Slice &serialized) {
+	parse(serialized.data(), serialized.size());
+}
+
+void Metadata::parse(const char *data, size_t len) {
+	if (len == 0 || (data[0] != METADATA_FORMAT_VERSION && data[0] != 1)) {
+		// text archive from before the binary format, rewritten on the next update
+		std::stringstream ss(std::string(data, len));
+		boost::archive::text_iarchive ia(ss);
+		this->serialize(ia, 0);
+		tier_id_ = NO_TIER_ID;
+		return;
+	}
+	if (len != (data[0] == 1 ? METADATA_V1_SIZE : METADATA_BINARY_SIZE))
+		throw std::runtime_error("Malformed metadata record");
+	// version, flags, tier id, then access count and popularity in version 1
+	pinned_ = data[1] & PINNED_FLAG;
+	memcpy(&tier_id_, data + 2, sizeof(tier_id_));
+	if (data[0] == 1)
+		parse_stats(data + 4, METADATA_STATS_SIZE);
+	const TierIdTable *table = tier_ids.load(std::memory_order_acquire);
+	if (table && tier_id_ < table->paths_.size())
+		tier_path_ = table->paths_[tier_id_];
+	else
+		tier_path_.clear();
+}
+
+void Metadata::load_tier_ids(std::shared_ptr<rocksdb::DB> &db,
+							 const std::vector<std::string> &tier_paths) {
+	std::lock_guard<std::mutex> lk(tier_ids_mt);
+	std::unique_ptr<TierIdTable> table(new TierIdTable);
+	std::string value;
+	if (db->Get(rocksdb::ReadOptions(), tier_ids_key, &value).ok()) {
+		size_t pos = 0;
+		while (pos < value.size()) {
+			size_t end = value.find('\0', pos);
+			if (end == std::string::npos)
+				end = value.size();
+			table->ids_.emplace(value.substr(pos, end - pos), table->paths_.size());
+			table->paths_.push_back(value.substr(pos, end - pos));
+			pos = end + 1;
+		}
+	}
+	bool added = false;
+	for (const std::string &path : tier_paths) {
+		if (table->ids_.count(path) || table->paths_.size() >= NO_TIER_ID)
+			continue;
+		table->ids_.emplace(path, table->paths_.size());
+		table->paths_.push_back(path);
+		value.append(path);
+		value.push_back('\0');
+		added = true;
+	}
+	if (added)
+		db->Put(rocksdb::WriteOptions(), tier_ids_key, value);
+	tier_ids.store(table.get(), std::memory_order_release);
+	tier_id_tables.push_back(std::move(table));
+}
+
+std::string Metadata::serialized(void) {
+	uint16_t tier_id = tier_id_;
+	if (!tier_path_.empty()) {
+		const TierIdTable *table = tier_ids.load(std::memory_order_acquire);
+		std::unordered_map<std::string, uint16_t>::const_iterator itr;
+		if (table && (itr = table->ids_.find(tier_path_)) != table->ids_.end())
+			tier_id = itr->second;
+		else
+			tier_id = NO_TIER_ID;
+	}
+	if (tier_id != NO_TIER_ID || tier_path_.empty()) {
+		char data[METADATA_BINARY_SIZE];
+		data[0] = METADATA_FORMAT_VERSION;
+		data[1] = pinned_ ? PINNED_FLAG : 0;
+		memcpy(data + 2, &tier_id, sizeof(tier_id));
+		return std::string(data, sizeof(data));
+	}
+	// tier without an id, e.g. before load_tier_ids()
+	std::stringstream ss;
+	{
+		boost::archive::text_oarchive oa(ss);
+		this->serialize(oa, 0);
+	}
+	return ss.str();
+}
+
+std::string Metadata::serialized_stats(void) const {
+	char data[METADATA_STATS_SIZE];
+	uint64_t access_count = access_count_;
+	memcpy(data, &access_count, sizeof(access_count));
+	memcpy(data + sizeof(access_count), &popularity_, sizeof(popularity_));
+	return std::string(data, sizeof(data));
+}
+
+bool Metadata::parse_stats(const char *data, size_t len) {
+	uint64_t access_count;
+	if (len != METADATA_STATS_SIZE)
+		return false;
+	memcpy(&access_count, data, sizeof(access_count));
+	memcpy(&popularity_, data + sizeof(access_count), sizeof(popularity_));
+	access_count_ = access_count;
+	return true;
+}
+
+std::vector<rocksdb::ColumnFamilyDescriptor> Metadata::column_families(
+	const rocksdb::Options &options) {
+	rocksdb::ColumnFamilyOptions placement(options);
+	rocksdb::BlockBasedTableOptions table_options;
+	table_options.filter_policy.reset(rocksdb::NewBloomFilterPolicy(BLOOM_BITS_PER_KEY));
+	table_options.block_cache = rocksdb::NewLRUCache(PLACEMENT_CACHE_SIZE);
+	table_options.cache_index_and_filter_blocks = true;
+	placement.table_factory.reset(rocksdb::NewBlockBasedTableFactory(table_options));
+	placement.merge_operator.reset(new MetadataMergeOperator());
+	// written on every open and tiering cycle, read only while tiering
+	rocksdb::ColumnFamilyOptions stats(options);
+	stats.compaction_style = rocksdb::kCompactionStyleUniversal;
+	stats.max_write_buffer_number = 4;
+	stats.merge_operator.reset(new MetadataMergeOperator(true));
+	// keys only, rewritten each tiering cycle and dropped a generation at a time
+	rocksdb::ColumnFamilyOptions index(options);
+	std::vector<rocksdb::ColumnFamilyDescriptor> descriptors;
+	descriptors.emplace_back(rocksdb::kDefaultColumnFamilyName, placement);
+	descriptors.emplace_back(STATS_COLUMN_FAMILY, stats);
+	descriptors.emplace_back(POPULARITY_COLUMN_FAMILY, index);
+	descriptors.emplace_back(PINS_COLUMN_FAMILY, index);
+	descriptors.emplace_back(TIERS_COLUMN_FAMILY, index);
+	return descriptors;
+}
+
+void Metadata::open_column_families(const std::vector<rocksdb::ColumnFamilyHandle *> &handles) {
+	cf_handles = handles;
+	stats_cf = popularity_cf = pins_cf = tiers_cf = nullptr;
+	// by name, as read-only opens leave out families the database doesn't have yet
+	for (rocksdb::ColumnFamilyHandle *handle : handles) {
+		if (handle->GetName() == STATS_COLUMN_FAMILY)
+			stats_cf = handle;
+		else if (handle->GetName() == POPULARITY_COLUMN_FAMILY)
+			popularity_cf = handle;
+		else if (handle->GetName() == PINS_COLUMN_FAMILY)
+			pins_cf = handle;
+		else if (handle->GetName() == TIERS_COLUMN_FAMILY)
+			tiers_cf = handle;
+	}
+}
+
+void Metadata::close_column_families(rocksdb::DB *db) {
+	for (rocksdb::ColumnFamilyHandle *handle : cf_handles)
+		db->DestroyColumnFamilyHandle(handle);
+	cf_handles.clear();
+	stats_cf = popularity_cf = pins_cf = tiers_cf = nullptr;
+}
+
+void Metadata::load_stats(const rocksdb::Slice &key, std::shared_ptr<rocksdb::DB> &db) {
+	std::string value;
+	if (stats_cf && db->Get(rocksdb::ReadOptions(), stats_cf, key, &value).ok())
+		parse_stats(value.data(), value.size());
+}
+
+bool Metadata::file_path(const rocksdb::Slice &key,
+						 std::shared_ptr<rocksdb::DB> &db,
+						 std::string &path) {
+	if (key.empty() || reserved_key(key))
+		return false;
+	if (key[0] != DIR_KEY_PREFIX) {
+		path = key.ToString();
+		return true;
+	}
+	size_t header = 2 + sizeof(uint64_t);
+	if (key.size() <= header || key[1] != FILE_RECORD)
+		return false;
+	uint64_t id = read_id(key.data() + 2);
+	path.assign(key.data() + header, key.size() - header);
+	std::string value;
+	for (int depth = 0; id != ROOT_DIR_ID; ++depth) {
+		if (depth == MAX_DIR_DEPTH
+			|| !db->Get(rocksdb::ReadOptions(), table_key(DIR_NAME, id, ""), &value).ok()
+			|| value.size() <= sizeof(uint64_t))
+			return false;
+		id = read_id(value.data());
+		path = value.substr(sizeof(uint64_t)) + "/" + path;
+	}
+	return true;
+}
+
+bool Metadata::apply(const rocksdb::Slice &operand) {
+	if (operand.empty())
+		return false;
+	const char *data = operand.data() + 1;
+	size_t len = operand.size() - 1;
+	switch (operand[0]) {
+	case ADD_ACCESSES: {
+		uint64_t count;
+		if (len != sizeof(count))
+			return false;
+		memcpy(&count, data, sizeof(count));
+		access_count_ += count;
+		break;
+	}
+	case SET_TIER:
+		tier_path_.assign(data, len);
+		tier_id_ = NO_TIER_ID;
+		break;
+	case SET_PINNED:
+		if (len != 1)
+			return false;
+		pinned_ = data[0] != 0;
+		break;
+	case SET_POPULARITY: {
+		double popularity;
+		uint64_t used;
+		if (len != sizeof(popularity) + sizeof(used))
+			return false;
+		memcpy(&popularity, data, sizeof(popularity));
+		memcpy(&used, data + sizeof(popularity), sizeof(used));
+		popularity_ = popularity;
+		access_count_ = access_count_ > used ? access_count_ - used : 0;
+		break;
+	}
+	default:
+		return false;
+	}
+	return true;
+}
+
+bool MetadataMergeOperator::FullMergeV2(const MergeOperationInput &merge_in,
+										MergeOperationOutput *merge_out) const {
+	Metadata metadata;
+	if (merge_in.existing_value) {
+		if (stats_) {
+			if (!metadata.parse_stats(merge_in.existing_value->data(),
+									  merge_in.existing_value->size()))
+				return false;
+		} else {
+			try {
+				metadata = Metadata(*merge_in.existing_value);
+			} catch (const std::exception &) {
+				return false;
+			}
+		}
+	} else if (stats_) {
+		metadata.popularity_ = MULTIPLIER * AVG_USAGE; // as read for files without stats
+	}
+	for (const rocksdb::Slice &operand : merge_in.operand_list) {
+		if (!metadata.apply(operand))
+			return false;
+	}
+	merge_out->new_value = stats_ ? metadata.serialized_stats() : metadata.serialized();
+	return true;
+}
+
+bool MetadataMergeOperator::PartialMerge(const rocksdb::Slice &key,
+										 const rocksdb::Slice &left_operand,
+										 const rocksdb::Slice &right_operand,
+										 std::string *new_value,
+										 rocksdb::Logger *logger) const {
+	(void)key;
+	(void)logger;
+	if (left_operand.empty() || right_operand.empty() || left_operand[0] != right_operand[0])
+		return false;
+	size_t len = left_operand.size();
+	switch (left_operand[0]) {
+	case Metadata::ADD_ACCESSES:
+	case Metadata::SET_POPULARITY: {
+		// counts add up, a later popularity replaces an earlier one
+		uint64_t left, right;
+		if (len != right_operand.size() || len < 1 + sizeof(left))
+			return false;
+		memcpy(&left, left_operand.data() + len - sizeof(left), sizeof(left));
+		memcpy(&right, right_operand.data() + len - sizeof(right), sizeof(right));
+		left += right;
+		new_value->assign(right_operand.data(), len - sizeof(left));
+		new_value->append(reinterpret_cast<const char *>(&left), sizeof(left));
+		return true;
+	}
+	case Metadata::SET_TIER:
+	case Metadata::SET_PINNED:
+		new_value->assign(right_operand.data(), right_operand.size());
+		return true;
+	default:
+		return false;
+	}
 }
 
 Metadata::Metadata(const Metadata &other)
@@ -42,7 +417,8 @@ Metadata::Metadata(const Metadata &other)
 	, popularity_(other.popularity_)
 	, not_found_(other.not_found_)
 	, pinned_(other.pinned_)
-	, tier_path_(other.tier_path_) {}
+	, tier_path_(other.tier_path_)
+	, tier_id_(other.tier_id_) {}
 
 Metadata &Metadata::operator=(const Metadata &other) {
 	access_count_ = other.access_count_;
@@ -50,6 +426,7 @@ Metadata &Metadata::operator=(const Metadata &other) {
 	not_found_ = other.not_found_;
 	pinned_ = other.pinned_;
 	tier_path_ = other.tier_path_;
+	tier_id_ = other.tier_id_;
 	return *this;
 }
 
@@ -58,7 +435,8 @@ Metadata::Metadata(Metadata &&other)
 	, popularity_(std::move(other.popularity_))
 	, not_found_(std::move(other.not_found_))
 	, pinned_(std::move(other.pinned_))
-	, tier_path_(std::move(other.tier_path_)) {}
+	, tier_path_(std::move(other.tier_path_))
+	, tier_id_(other.tier_id_) {}
 
 Metadata &Metadata::operator=(Metadata &&other) {
 	access_count_ = std::move(other.access_count_);
@@ -66,20 +444,580 @@ Metadata &Metadata::operator=(Metadata &&other) {
 	not_found_ = std::move(other.not_found_);
 	pinned_ = std::move(other.pinned_);
 	tier_path_ = std::move(other.tier_path_);
+	tier_id_ = other.tier_id_;
 	return *this;
 }
 
 #ifndef BAREBONES_METADATA
 
-Metadata::Metadata(std::string path, std::shared_ptr<rocksdb::DB> &db, Tier *tptr) {
-	std::string str;
-	if (path[0] == '/')
-		path = path.substr(1);
-	rocksdb::Status s = db->Get(rocksdb::ReadOptions(), path, &str);
+static std::atomic<bool> directory_keys(false);                ///< Records use directory keys
+static std::mutex dir_ids_mt;                                  ///< Guards the statics below
+static uint64_t next_dir_id = ROOT_DIR_ID + 1;                 ///< Id of next new directory
+static uint64_t dir_cache_generation = 0;                      ///< Bumped when dirs move
+static std::unordered_map<std::string, uint64_t> dir_id_cache; ///< Id of recent directories
+
+/**
+ * @brief Find id of directory in the directory table, from dir_id_cache if possible.
+ * The lock is not held while reading the database, so a lookup racing a directory rename
+ * is not cached.
+ *
+ * @param db RocksDB database
+ * @param dir Directory relative to the tier root, empty for the root
+ * @param create Add missing directories
+ * @param id Id of directory
+ * @return true Found or added
+ * @return false Missing and create is false, or the write failed
+ */
+static bool dir_id(rocksdb::DB *db, const std::string &dir, bool create, uint64_t &id) {
+	if (dir.empty()) {
+		id = ROOT_DIR_ID;
+		return true;
+	}
+	uint64_t generation;
+	{
+		std::lock_guard<std::mutex> lk(dir_ids_mt);
+		std::unordered_map<std::string, uint64_t>::iterator itr = dir_id_cache.find(dir);
+		if (itr != dir_id_cache.end()) {
+			id = itr->second;
+			return true;
+		}
+		generation = dir_cache_generation;
+	}
+	size_t slash = dir.rfind('/');
+	std::string name = slash == std::string::npos ? dir : dir.substr(slash + 1);
+	uint64_t parent;
+	if (!dir_id(db, slash == std::string::npos ? "" : dir.substr(0, slash), create, parent))
+		return false;
+	std::string entry = table_key(DIR_ENTRY, parent, name);
+	std::string value;
+	if (db->Get(rocksdb::ReadOptions(), entry, &value).ok() && value.size() == sizeof(id)) {
+		id = read_id(value.data());
+	} else if (!create) {
+		return false;
+	} else {
+		std::lock_guard<std::mutex> lk(dir_ids_mt);
+		if (db->Get(rocksdb::ReadOptions(), entry, &value).ok() && value.size() == sizeof(id)) {
+			id = read_id(value.data()); // added by another thread
+		} else {
+			id = next_dir_id++;
+			rocksdb::WriteBatch batch;
+			std::string id_value;
+			append_id(id_value, id);
+			batch.Put(entry, id_value);
+			std::string name_value;
+			append_id(name_value, parent);
+			name_value.append(name);
+			batch.Put(table_key(DIR_NAME, id, ""), name_value);
+			std::string next_value;
+			append_id(next_value, next_dir_id);
+			batch.Put(next_dir_id_key, next_value);
+			if (!db->Write(rocksdb::WriteOptions(), &batch).ok())
+				return false;
+		}
+	}
+	std::lock_guard<std::mutex> lk(dir_ids_mt);
+	if (generation == dir_cache_generation) {
+		if (dir_id_cache.size() >= DIR_ID_CACHE_MAX)
+			dir_id_cache.clear();
+		dir_id_cache.emplace(dir, id);
+	}
+	return true;
+}
+
+/**
+ * @brief Split path into parent directory and name, dropping slashes at either end.
+ *
+ * @param path
+ * @param parent
+ * @param name
+ */
+static void split_path(std::string path, std::string &parent, std::string &name) {
+	while (!path.empty() && path.front() == '/')
+		path.erase(0, 1);
+	while (!path.empty() && path.back() == '/')
+		path.pop_back();
+	size_t slash = path.rfind('/');
+	if (slash == std::string::npos) {
+		parent.clear();
+		name = path;
+	} else {
+		parent = path.substr(0, slash);
+		name = path.substr(slash + 1);
+	}
+}
+
+/**
+ * @brief Build a popularity index key, ordered by generation, then from most to least
+ * popular, then by database key.
+ *
+ * @param generation Index generation
+ * @param popularity Popularity of file
+ * @param key Database key of file
+ * @return std::string
+ */
+static std::string popularity_index_key(uint64_t generation,
+										double popularity,
+										const std::string &key) {
+	std::string index_key;
+	append_id(index_key, generation);
+	append_id(index_key, ~double_key(popularity));
+	index_key.append(key);
+	return index_key;
+}
+
+/**
+ * @brief Read popularity back out of a popularity index key.
+ *
+ * @param data Index key past the generation
+ * @return double
+ */
+static double index_popularity(const char *data) {
+	uint64_t bits = ~read_id(data);
+	// undo double_key()
+	bits = (bits & (uint64_t(1) << 63)) ? bits & ~(uint64_t(1) << 63) : ~bits;
+	double popularity;
+	memcpy(&popularity, &bits, sizeof(popularity));
+	return popularity;
+}
+
+/**
+ * @brief Build the prefix of a tier's entries in the tier index.
+ *
+ * @param id Tier id
+ * @return std::string
+ */
+static std::string tier_prefix(uint16_t id) {
+	std::string prefix;
+	prefix.push_back(static_cast<char>(id >> 8));
+	prefix.push_back(static_cast<char>(id & 0xff));
+	return prefix;
+}
+
+/**
+ * @brief Build a tier index key.
+ *
+ * @param tier_path Path to tier root
+ * @param key Database key of file
+ * @param index_key Tier index key
+ * @return true Built
+ * @return false Tier has no id
+ */
+static bool tier_index_key(const std::string &tier_path,
+						   const std::string &key,
+						   std::string &index_key) {
+	const TierIdTable *table = tier_ids.load(std::memory_order_acquire);
+	std::unordered_map<std::string, uint16_t>::const_iterator itr;
+	if (table == nullptr || (itr = table->ids_.find(tier_path)) == table->ids_.end())
+		return false;
+	index_key = tier_prefix(itr->second) + key;
+	return true;
+}
+
+bool Metadata::db_key(std::string relative_path,
+					  std::shared_ptr<rocksdb::DB> &db,
+					  bool create,
+					  std::string &key) {
+	if (!directory_keys.load(std::memory_order_relaxed)) {
+		if (!relative_path.empty() && relative_path.front() == '/')
+			relative_path = relative_path.substr(1, std::string::npos);
+		key = relative_path;
+		return true;
+	}
+	std::string parent, name;
+	split_path(relative_path, parent, name);
+	uint64_t id;
+	if (!dir_id(db.get(), parent, create, id))
+		return false;
+	key = table_key(FILE_RECORD, id, name);
+	return true;
+}
+
+void Metadata::use_directory_keys(std::shared_ptr<rocksdb::DB> &db, bool enable) {
+	{
+		std::lock_guard<std::mutex> lk(dir_ids_mt);
+		std::string value;
+		if (db->Get(rocksdb::ReadOptions(), next_dir_id_key, &value).ok()
+			&& value.size() == sizeof(uint64_t))
+			next_dir_id = read_id(value.data());
+		++dir_cache_generation;
+		dir_id_cache.clear();
+	}
+	directory_keys.store(enable);
+	rocksdb::WriteBatch batch;
+	size_t converted = 0;
+	bool table_found = false;
+	rocksdb::ReadOptions read_options;
+	read_options.total_order_seek = true; // seeks cross key prefixes
+	// indexes first, as converting back to path keys drops the directory table. The
+	// popularity index is left to be rewritten by the next tiering cycle.
+	if (tiers_cf) {
+		// keys follow the tier id, so the whole index is read
+		rocksdb::Iterator *it = db->NewIterator(read_options, tiers_cf);
+		for (it->SeekToFirst(); it->Valid(); it->Next()) {
+			if (it->key().size() <= TIER_PREFIX_SIZE)
+				continue;
+			rocksdb::Slice file_key(it->key().data() + TIER_PREFIX_SIZE,
+									it->key().size() - TIER_PREFIX_SIZE);
+			if ((file_key[0] == DIR_KEY_PREFIX) == enable)
+				continue;
+			std::string prefix(it->key().data(), TIER_PREFIX_SIZE), key;
+			if (enable ? db_key(file_key.ToString(), db, true, key) : file_path(file_key, db, key))
+				batch.Put(tiers_cf, prefix + key, it->value());
+			else if (enable)
+				continue;
+			batch.Delete(tiers_cf, it->key());
+			if (batch.Count() >= KEY_CONVERT_BATCH) {
+				db->Write(rocksdb::WriteOptions(), &batch);
+				batch.Clear();
+			}
+		}
+		delete it;
+	}
+	for (rocksdb::ColumnFamilyHandle *cf : { stats_cf, pins_cf, db->DefaultColumnFamily() }) {
+		if (cf == nullptr)
+			continue;
+		rocksdb::Iterator *it = db->NewIterator(read_options, cf);
+		it->Seek(std::string(1, enable ? '\x01' : DIR_KEY_PREFIX));
+		while (it->Valid()) {
+			if (enable && it->key()[0] == DIR_KEY_PREFIX) {
+				// path keys sort on both sides of the directory keys
+				it->Seek(std::string(1, DIR_KEY_PREFIX + 1));
+				continue;
+			}
+			if (!enable && it->key()[0] != DIR_KEY_PREFIX)
+				break;
+			std::string key;
+			if (enable) {
+				if (db_key(it->key().ToString(), db, true, key)) {
+					batch.Put(cf, key, it->value());
+					batch.Delete(cf, it->key());
+					++converted;
+				}
+			} else {
+				// directory table entries are dropped along with the records
+				if (file_path(it->key(), db, key)) {
+					batch.Put(cf, key, it->value());
+					++converted;
+				}
+				batch.Delete(cf, it->key());
+				table_found = true;
+			}
+			if (batch.Count() >= KEY_CONVERT_BATCH) {
+				db->Write(rocksdb::WriteOptions(), &batch);
+				batch.Clear();
+			}
+			it->Next();
+		}
+		delete it;
+	}
+	if (table_found)
+		batch.Delete(next_dir_id_key);
+	db->Write(rocksdb::WriteOptions(), &batch);
+	if (converted)
+		Logging::log.message("Converted " + std::to_string(converted) + " metadata records to "
+								 + (enable ? "directory" : "path") + " keys.",
+							 Logger::log_level_t::NORMAL);
+}
+
+void Metadata::split_stats(std::shared_ptr<rocksdb::DB> &db) {
+	std::string done;
+	if (stats_cf == nullptr || db->Get(rocksdb::ReadOptions(), stats_split_key, &done).ok())
+		return;
+	rocksdb::WriteBatch batch;
+	size_t split = 0;
+	rocksdb::Iterator *it = db->NewIterator(rocksdb::ReadOptions());
+	for (it->SeekToFirst(); it->Valid(); it->Next()) {
+		rocksdb::Slice key = it->key();
+		rocksdb::Slice value = it->value();
+		bool table_entry = key.size() > 1 && key[0] == DIR_KEY_PREFIX && key[1] != FILE_RECORD;
+		if (reserved_key(key) || table_entry
+			|| (!value.empty() && value[0] == METADATA_FORMAT_VERSION))
+			continue;
+		Metadata metadata;
+		try {
+			metadata = Metadata(value);
+		} catch (const std::exception &) {
+			continue;
+		}
+		batch.Put(key, metadata.serialized());
+		batch.Put(stats_cf, key, metadata.serialized_stats());
+		if (++split % KEY_CONVERT_BATCH == 0) {
+			db->Write(rocksdb::WriteOptions(), &batch);
+			batch.Clear();
+		}
+	}
+	delete it;
+	batch.Put(stats_split_key, "");
+	db->Write(rocksdb::WriteOptions(), &batch);
+	if (split)
+		Logging::log.message("Moved statistics of " + std::to_string(split)
+								 + " metadata records to their own column family.",
+							 Logger::log_level_t::NORMAL);
+}
+
+void Metadata::index_pins(std::shared_ptr<rocksdb::DB> &db) {
+	std::string done;
+	if (pins_cf == nullptr || db->Get(rocksdb::ReadOptions(), pins_indexed_key, &done).ok())
+		return;
+	rocksdb::WriteBatch batch;
+	size_t indexed = 0;
+	rocksdb::Iterator *it = db->NewIterator(rocksdb::ReadOptions());
+	for (it->SeekToFirst(); it->Valid(); it->Next()) {
+		rocksdb::Slice key = it->key();
+		bool table_entry = key.size() > 1 && key[0] == DIR_KEY_PREFIX && key[1] != FILE_RECORD;
+		if (reserved_key(key) || table_entry)
+			continue;
+		Metadata metadata;
+		try {
+			metadata = Metadata(it->value());
+		} catch (const std::exception &) {
+			continue;
+		}
+		if (!metadata.pinned_)
+			continue;
+		batch.Put(pins_cf, key, "");
+		if (++indexed % KEY_CONVERT_BATCH == 0) {
+			db->Write(rocksdb::WriteOptions(), &batch);
+			batch.Clear();
+		}
+	}
+	delete it;
+	batch.Put(pins_indexed_key, "");
+	db->Write(rocksdb::WriteOptions(), &batch);
+	if (indexed)
+		Logging::log.message("Indexed " + std::to_string(indexed) + " pinned files.",
+							 Logger::log_level_t::NORMAL);
+}
+
+void Metadata::scan_pins(std::shared_ptr<rocksdb::DB> &db,
+						 const std::function<void(const std::string &, const Metadata &)> &visit) {
+	if (pins_cf == nullptr)
+		return;
+	std::string path, value;
+	rocksdb::Iterator *it = db->NewIterator(rocksdb::ReadOptions(), pins_cf);
+	for (it->SeekToFirst(); it->Valid(); it->Next()) {
+		if (!db->Get(rocksdb::ReadOptions(), it->key(), &value).ok()
+			|| !file_path(it->key(), db, path))
+			continue;
+		Metadata metadata{ rocksdb::Slice(value) };
+		// the record decides, as it may be merged before the index is written
+		if (metadata.pinned_ && !metadata.tier_path_.empty())
+			visit(path, metadata);
+	}
+	delete it;
+}
+
+void Metadata::scan_popularity(std::shared_ptr<rocksdb::DB> &db,
+							   bool ascending,
+							   double min,
+							   double max,
+							   size_t limit,
+							   const std::function<void(const std::string &, double)> &visit) {
+	std::string value;
+	if (popularity_cf == nullptr
+		|| !db->Get(rocksdb::ReadOptions(), popularity_gen_key, &value).ok()
+		|| value.size() != sizeof(uint64_t))
+		return; // not tiered since the index was added
+	uint64_t generation = read_id(value.data());
+	std::string prefix;
+	append_id(prefix, generation);
+	rocksdb::Iterator *it = db->NewIterator(rocksdb::ReadOptions(), popularity_cf);
+	if (ascending) {
+		// back from the first key less popular than min
+		std::string start;
+		uint64_t bound = ~double_key(min);
+		if (bound == UINT64_MAX) {
+			append_id(start, generation + 1);
+		} else {
+			start = prefix;
+			append_id(start, bound + 1);
+		}
+		it->SeekForPrev(start);
+	} else {
+		std::string start = prefix;
+		append_id(start, ~double_key(max));
+		it->Seek(start);
+	}
+	size_t visited = 0;
+	std::string path;
+	for (; it->Valid() && it->key().starts_with(prefix); ascending ? it->Prev() : it->Next()) {
+		if (it->key().size() <= 2 * sizeof(uint64_t))
+			continue;
+		double popularity = index_popularity(it->key().data() + sizeof(uint64_t));
+		if (ascending ? popularity > max : popularity < min)
+			break;
+		rocksdb::Slice key(it->key().data() + 2 * sizeof(uint64_t),
+						   it->key().size() - 2 * sizeof(uint64_t));
+		// removed or renamed since the last tiering cycle
+		if (!db->Get(rocksdb::ReadOptions(), key, &value).ok()
+			|| Metadata(rocksdb::Slice(value)).tier_path_.empty() || !file_path(key, db, path))
+			continue;
+		visit(path, popularity);
+		if (limit && ++visited == limit)
+			break;
+	}
+	delete it;
+}
+
+void Metadata::scan_tier(
+	std::shared_ptr<rocksdb::DB> &db,
+	const std::string &tier_path,
+	const std::function<void(const std::string &, const Metadata &, uint64_t)> &visit) {
+	std::string prefix;
+	if (tiers_cf == nullptr || !tier_index_key(tier_path, "", prefix))
+		return;
+	std::string path, value;
+	rocksdb::Iterator *it = db->NewIterator(rocksdb::ReadOptions(), tiers_cf);
+	for (it->Seek(prefix); it->Valid() && it->key().starts_with(prefix); it->Next()) {
+		rocksdb::Slice key(it->key().data() + TIER_PREFIX_SIZE,
+						   it->key().size() - TIER_PREFIX_SIZE);
+		if (key.empty() || it->value().size() != sizeof(uint64_t)
+			|| !db->Get(rocksdb::ReadOptions(), key, &value).ok() || !file_path(key, db, path))
+			continue;
+		Metadata metadata{ rocksdb::Slice(value) };
+		// moved without the index entry following, e.g. by an older version
+		if (metadata.tier_path_ != tier_path)
+			continue;
+		metadata.load_stats(key, db);
+		visit(path, metadata, read_id(it->value().data()));
+	}
+	delete it;
+}
+
+bool Metadata::remove(std::string relative_path, std::shared_ptr<rocksdb::DB> &db) {
+	std::string key;
+	if (!db_key(relative_path, db, false, key))
+		return true;
+	rocksdb::WriteBatch batch;
+	batch.Delete(key);
+	if (stats_cf)
+		batch.Delete(stats_cf, key);
+	if (pins_cf)
+		batch.Delete(pins_cf, key);
+	const TierIdTable *table = tier_ids.load(std::memory_order_acquire);
+	// from every tier, so the record needn't be read to find which
+	for (uint16_t id = 0; tiers_cf && table && id < table->paths_.size(); ++id)
+		batch.Delete(tiers_cf, tier_prefix(id) + key);
+	return db->Write(rocksdb::WriteOptions(), &batch).ok();
+}
+
+void Metadata::rename_directory(std::string old_directory,
+								std::string new_directory,
+								std::shared_ptr<rocksdb::DB> &db) {
+	if (!directory_keys.load(std::memory_order_relaxed)) {
+		// Remove leading /.
+		if (old_directory.front() == '/')
+			old_directory = old_directory.substr(1, std::string::npos);
+		if (new_directory.front() == '/')
+			new_directory = new_directory.substr(1, std::string::npos);
+
+		/* Ensure that only paths containing exclusively the changed directory are updated.
+		 * EX: subdir and subdir2 exist. If subdir is updated, test should check for "subdir/"
+		 * to avoid changing subdir2 aswell.
+		 */
+		if (old_directory.back() != '/')
+			old_directory += '/';
+		if (new_directory.back() != '/')
+			new_directory += '/';
+
+		// Batch changes to atomically update keys
+		rocksdb::WriteBatch batch;
+
+		// each column family keyed by path, under every tier id for the tier index
+		std::vector<std::pair<rocksdb::ColumnFamilyHandle *, std::string>> scopes = {
+			{ db->DefaultColumnFamily(), "" }, { stats_cf, "" }, { pins_cf, "" }
+		};
+		const TierIdTable *table = tier_ids.load(std::memory_order_acquire);
+		for (uint16_t id = 0; tiers_cf && table && id < table->paths_.size(); ++id)
+			scopes.emplace_back(tiers_cf, tier_prefix(id));
+		rocksdb::ReadOptions read_options;
+		for (const std::pair<rocksdb::ColumnFamilyHandle *, std::string> &scope : scopes) {
+			rocksdb::ColumnFamilyHandle *cf = scope.first;
+			if (cf == nullptr)
+				continue;
+			std::string old_prefix = scope.second + old_directory;
+			std::string new_prefix = scope.second + new_directory;
+			rocksdb::Iterator *itr = db->NewIterator(read_options, cf);
+			for (itr->Seek(old_prefix); itr->Valid() && itr->key().starts_with(old_prefix);
+				 itr->Next()) {
+				std::string old_path = itr->key().ToString();
+				std::string new_path = new_prefix + old_path.substr(old_prefix.length());
+				batch.Delete(cf, itr->key());
+				batch.Put(cf, new_path, itr->value());
+			}
+			delete itr;
+		}
+		db->Write(rocksdb::WriteOptions(), &batch);
+		return;
+	}
+	std::string old_parent, old_name, new_parent, new_name;
+	split_path(old_directory, old_parent, old_name);
+	split_path(new_directory, new_parent, new_name);
+	uint64_t old_parent_id, new_parent_id;
+	if (!dir_id(db.get(), old_parent, false, old_parent_id))
+		return; // nothing recorded under it
+	if (!dir_id(db.get(), new_parent, true, new_parent_id))
+		return;
+	std::lock_guard<std::mutex> lk(dir_ids_mt);
+	++dir_cache_generation;
+	dir_id_cache.clear();
+	std::string old_entry = table_key(DIR_ENTRY, old_parent_id, old_name);
+	std::string new_entry = table_key(DIR_ENTRY, new_parent_id, new_name);
+	std::string value, replaced;
+	if (!db->Get(rocksdb::ReadOptions(), old_entry, &value).ok()
+		|| value.size() != sizeof(uint64_t))
+		return;
+	rocksdb::WriteBatch batch;
+	// an empty directory can be renamed over
+	if (db->Get(rocksdb::ReadOptions(), new_entry, &replaced).ok()
+		&& replaced.size() == sizeof(uint64_t))
+		batch.Delete(table_key(DIR_NAME, read_id(replaced.data()), ""));
+	batch.Delete(old_entry);
+	batch.Put(new_entry, value);
+	std::string name_value;
+	append_id(name_value, new_parent_id);
+	name_value.append(new_name);
+	batch.Put(table_key(DIR_NAME, read_id(value.data()), ""), name_value);
+	db->Write(rocksdb::WriteOptions(), &batch);
+}
+
+void Metadata::remove_directory(std::string directory, std::shared_ptr<rocksdb::DB> &db) {
+	if (!directory_keys.load(std::memory_order_relaxed))
+		return;
+	std::string parent, name;
+	split_path(directory, parent, name);
+	uint64_t parent_id;
+	if (!dir_id(db.get(), parent, false, parent_id))
+		return;
+	std::lock_guard<std::mutex> lk(dir_ids_mt);
+	++dir_cache_generation;
+	dir_id_cache.clear();
+	std::string entry = table_key(DIR_ENTRY, parent_id, name);
+	std::string value;
+	if (!db->Get(rocksdb::ReadOptions(), entry, &value).ok() || value.size() != sizeof(uint64_t))
+		return;
+	rocksdb::WriteBatch batch;
+	batch.Delete(entry);
+	batch.Delete(table_key(DIR_NAME, read_id(value.data()), ""));
+	db->Write(rocksdb::WriteOptions(), &batch);
+}
+
+Metadata::Metadata(std::string path, std::shared_ptr<rocksdb::DB> &db, Tier *tptr, bool stats) {
+	std::string key;
+	rocksdb::PinnableSlice value;
+	rocksdb::Status s = rocksdb::Status::NotFound();
+	if (db_key(path, db, false, key))
+		s = db->Get(rocksdb::ReadOptions(), db->DefaultColumnFamily(), key, &value);
 	if (s.ok()) {
-		std::stringstream ss(str);
-		boost::archive::text_iarchive ia(ss);
-		this->serialize(ia, 0);
+		parse(value.data(), value.size());
+		if (stats)
+			load_stats(key, db);
+		if (tier_path_.empty()) {
+			if (tptr)
+				tier_path_ = tptr->path().string();
+			else
+				not_found_ = true;
+		}
 	} else if (tptr) {
 		tier_path_ = tptr->path().string();
 	} else {
@@ -87,29 +1025,122 @@ Metadata::Metadata(std::string path, std::shared_ptr<rocksdb::DB> &db, Tier *tpt
 	}
 }
 
-void Metadata::update(std::string relative_path, std::shared_ptr<rocksdb::DB> &db, std::string *old_key) {
-	if (relative_path.front() == '/')
-		relative_path = relative_path.substr(1, std::string::npos);
-	std::stringstream ss;
-	{
-		boost::archive::text_oarchive oa(ss);
-		this->serialize(oa, 0);
-	}
+double Metadata::read_popularity(std::string relative_path, std::shared_ptr<rocksdb::DB> &db) {
+	Metadata f;
+	f.popularity_ = MULTIPLIER * AVG_USAGE;
+	std::string key;
+	if (db_key(relative_path, db, false, key))
+		f.load_stats(key, db);
+	return f.popularity_;
+}
+
+void Metadata::update(std::string relative_path,
+					  std::shared_ptr<rocksdb::DB> &db,
+					  std::string *old_key,
+					  uint64_t size) {
+	std::string key;
+	if (!db_key(relative_path, db, true, key))
+		return;
 	rocksdb::WriteBatch batch;
+	std::string indexed_size, index_key;
+	append_id(indexed_size, size);
 	if (old_key) {
-		if (old_key->front() == '/')
-			*old_key = old_key->substr(1, std::string::npos);
-		batch.Delete(*old_key);
-	}
-	batch.Put(relative_path, ss.str());
-	{
-		std::lock_guard<std::mutex> lk(l::rocksdb::global_lock_);
-		db->Write(rocksdb::WriteOptions(), &batch);
+		std::string old_db_key, stats;
+		if (db_key(*old_key, db, false, old_db_key)) {
+			if (tiers_cf && tier_index_key(tier_path_, old_db_key, index_key)) {
+				db->Get(rocksdb::ReadOptions(), tiers_cf, index_key, &indexed_size);
+				batch.Delete(tiers_cf, index_key);
+			}
+			batch.Delete(old_db_key);
+			if (stats_cf && db->Get(rocksdb::ReadOptions(), stats_cf, old_db_key, &stats).ok()) {
+				batch.Delete(stats_cf, old_db_key);
+				batch.Put(stats_cf, key, stats);
+			}
+			if (pins_cf)
+				batch.Delete(pins_cf, old_db_key);
+		}
 	}
+	if (pins_cf && pinned_)
+		batch.Put(pins_cf, key, "");
+	if (tiers_cf && tier_index_key(tier_path_, key, index_key))
+		batch.Put(tiers_cf, index_key, indexed_size);
+	batch.Put(key, serialized());
+	db->Write(rocksdb::WriteOptions(), &batch);
+}
+
+void Metadata::touch(uintmax_t count) {
+	access_count_ += count;
+}
+
+void Metadata::merge(std::string relative_path,
+					 std::shared_ptr<rocksdb::DB> &db,
+					 const std::string &operand,
+					 bool create) {
+	std::string key;
+	if (!db_key(relative_path, db, create, key))
+		return;
+	rocksdb::ColumnFamilyHandle *cf = db->DefaultColumnFamily();
+	if (stats_cf && (operand[0] == ADD_ACCESSES || operand[0] == SET_POPULARITY))
+		cf = stats_cf;
+	// no read first, so no lock is needed to keep other changes to the record
+	db->Merge(rocksdb::WriteOptions(), cf, key, operand);
+}
+
+void Metadata::add_accesses(std::string relative_path,
+							std::shared_ptr<rocksdb::DB> &db,
+							uintmax_t count) {
+	uint64_t count64 = count;
+	std::string operand(1, ADD_ACCESSES);
+	operand.append(reinterpret_cast<const char *>(&count64), sizeof(count64));
+	// a directory renamed or removed since the accesses is not added back
+	merge(relative_path, db, operand, false);
+}
+
+void Metadata::set_tier_path(std::string relative_path,
+							 std::shared_ptr<rocksdb::DB> &db,
+							 const std::string &tier_path,
+							 uint64_t size,
+							 const std::string &old_tier_path) {
+	std::string key;
+	if (!db_key(relative_path, db, true, key))
+		return;
+	rocksdb::WriteBatch batch;
+	batch.Merge(key, std::string(1, SET_TIER) + tier_path);
+	std::string index_key, value;
+	if (tiers_cf && old_tier_path != tier_path && tier_index_key(old_tier_path, key, index_key))
+		batch.Delete(tiers_cf, index_key);
+	append_id(value, size);
+	if (tiers_cf && tier_index_key(tier_path, key, index_key))
+		batch.Put(tiers_cf, index_key, value);
+	db->Write(rocksdb::WriteOptions(), &batch);
 }
 
-void Metadata::touch(void) {
-	access_count_++;
+void Metadata::set_pinned(std::string relative_path,
+						  std::shared_ptr<rocksdb::DB> &db,
+						  bool pinned) {
+	std::string key;
+	if (!db_key(relative_path, db, true, key))
+		return;
+	std::string operand(1, SET_PINNED);
+	operand.push_back(pinned ? 1 : 0);
+	rocksdb::WriteBatch batch;
+	batch.Merge(key, operand);
+	if (pins_cf && pinned)
+		batch.Put(pins_cf, key, "");
+	else if (pins_cf)
+		batch.Delete(pins_cf, key);
+	db->Write(rocksdb::WriteOptions(), &batch);
+}
+
+void Metadata::set_popularity(std::string relative_path,
+							  std::shared_ptr<rocksdb::DB> &db,
+							  double popularity,
+							  uintmax_t accesses_used) {
+	uint64_t used = accesses_used;
+	std::string operand(1, SET_POPULARITY);
+	operand.append(reinterpret_cast<const char *>(&popularity), sizeof(popularity));
+	operand.append(reinterpret_cast<const char *>(&used), sizeof(used));
+	merge(relative_path, db, operand, true);
 }
 
 std::string Metadata::tier_path(void) const {
@@ -118,6 +1149,7 @@ std::string Metadata::tier_path(void) const {
 
 void Metadata::tier_path(const std::string &path) {
 	tier_path_ = path;
+	tier_id_ = NO_TIER_ID;
 }
 
 bool Metadata::pinned(void) const {
@@ -145,4 +1177,71 @@ std::string Metadata::dump_stats(void) const {
 	return ss.str();
 }
 
+PopularityIndexWriter::PopularityIndexWriter(std::shared_ptr<rocksdb::DB> &db, bool incremental)
+	: db_(db), generation_(1), incremental_(false) {
+	std::string value;
+	if (db_->Get(rocksdb::ReadOptions(), popularity_gen_key, &value).ok()
+		&& value.size() == sizeof(uint64_t)) {
+		generation_ = read_id(value.data());
+		incremental_ = incremental;
+		if (!incremental_)
+			++generation_;
+	}
+	if (popularity_cf == nullptr || incremental_)
+		return;
+	// left by a cycle that didn't finish
+	std::string begin, end;
+	append_id(begin, generation_);
+	append_id(end, generation_ + 1);
+	batch_.DeleteRange(popularity_cf, begin, end);
+}
+
+bool PopularityIndexWriter::incremental(void) const {
+	return incremental_;
+}
+
+void PopularityIndexWriter::add(const std::string &relative_path, double popularity) {
+	std::string key;
+	if (popularity_cf == nullptr || !Metadata::db_key(relative_path, db_, false, key))
+		return;
+	batch_.Put(popularity_cf, popularity_index_key(generation_, popularity, key), "");
+	if (batch_.Count() >= KEY_CONVERT_BATCH) {
+		db_->Write(rocksdb::WriteOptions(), &batch_);
+		batch_.Clear();
+	}
+}
+
+void PopularityIndexWriter::update(const std::string &relative_path,
+								   double old_popularity,
+								   double popularity) {
+	std::string key;
+	if (popularity_cf == nullptr || !Metadata::db_key(relative_path, db_, false, key))
+		return;
+	// entries of files renamed away are left for the next full rewrite, readers skip them
+	batch_.Delete(popularity_cf, popularity_index_key(generation_, old_popularity, key));
+	batch_.Put(popularity_cf, popularity_index_key(generation_, popularity, key), "");
+	if (batch_.Count() >= KEY_CONVERT_BATCH) {
+		db_->Write(rocksdb::WriteOptions(), &batch_);
+		batch_.Clear();
+	}
+}
+
+void PopularityIndexWriter::commit(void) {
+	if (popularity_cf == nullptr)
+		return;
+	if (incremental_) {
+		db_->Write(rocksdb::WriteOptions(), &batch_);
+		batch_.Clear();
+		return;
+	}
+	std::string value, begin, end;
+	append_id(value, generation_);
+	append_id(begin, 0);
+	append_id(end, generation_);
+	batch_.Put(popularity_gen_key, value);
+	batch_.DeleteRange(popularity_cf, begin, end);
+	db_->Write(rocksdb::WriteOptions(), &batch_);
+	batch_.Clear();
+}
+
 #endif
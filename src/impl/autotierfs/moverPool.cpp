@@ -0,0 +1,163 @@
+/*
+ *    Copyright (C) 2019-2021 Joshua Boudreau <jboudreau@45drives.com>
+ *
+ *    This file is part of autotier.
+ *
+ *    autotier is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    autotier is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with autotier.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "moverPool.hpp"
+
+#include "file.hpp"
+#include "kernelCache.hpp"
+#include "pathCache.hpp"
+#include "tier.hpp"
+#include "uringMover.hpp"
+
+#include <algorithm>
+
+#define URING_BATCH_FILES_PER_BUFFER 4 ///< Files moved per io_uring buffer in one chunk
+
+MoverPool::MoverPool(const std::vector<Tier *> &tiers,
+					 int threads,
+					 int buff_sz,
+					 unsigned int queue_depth,
+					 const fs::path &run_path,
+					 std::shared_ptr<rocksdb::DB> &db,
+					 PathCache &path_cache)
+	: tiers_(tiers)
+	, thread_count_(threads)
+	, buff_sz_(buff_sz)
+	, queue_depth_(queue_depth)
+	, run_path_(run_path)
+	, db_(db)
+	, path_cache_(path_cache)
+	, queues_(tiers.size() * tiers.size())
+	, active_(tiers.size(), 0)
+	, demotions_out_(tiers.size(), 0)
+	, queued_(0)
+	, pending_(0)
+	, running_(false)
+	, stop_(false) {
+	for (int i = 0; i < threads; ++i)
+		threads_.emplace_back(&MoverPool::worker, this);
+}
+
+MoverPool::~MoverPool(void) {
+	{
+		std::lock_guard<std::mutex> lk(mt_);
+		stop_ = true;
+	}
+	work_cv_.notify_all();
+	for (std::thread &thread : threads_)
+		thread.join();
+}
+
+void MoverPool::enqueue(File *fptr, size_t source, size_t dest) {
+	std::lock_guard<std::mutex> lk(mt_);
+	queues_[source * tiers_.size() + dest].push_back(fptr);
+	if (dest > source)
+		++demotions_out_[source];
+	++queued_;
+	++pending_;
+}
+
+void MoverPool::wait(void) {
+	std::unique_lock<std::mutex> lk(mt_);
+	running_ = true;
+	work_cv_.notify_all();
+	done_cv_.wait(lk, [this]() { return pending_ == 0 || stop_; });
+	running_ = false;
+}
+
+void MoverPool::worker(void) {
+	std::unique_ptr<UringMover> mover;
+	std::unique_lock<std::mutex> lk(mt_);
+	while (true) {
+		size_t pair = 0;
+		work_cv_.wait(lk, [&]() { return stop_ || (running_ && next_move(pair)); });
+		if (stop_)
+			return;
+		size_t source = pair / tiers_.size();
+		size_t dest = pair % tiers_.size();
+		std::deque<File *> &queue = queues_[pair];
+		size_t take = 1;
+		if (queue_depth_ != 0
+			&& tiers_[dest]->move_method(tiers_[source]) == MoveMethod::BUFFERED) {
+			// up to one io_uring batch, leaving a share of the queue for idle movers
+			take = std::min<size_t>(URING_BATCH_FILES_PER_BUFFER * queue_depth_,
+									std::max<size_t>(1, queue.size() / thread_count_));
+		}
+		std::vector<File *> chunk(queue.begin(), queue.begin() + take);
+		queue.erase(queue.begin(), queue.begin() + take);
+		queued_ -= take;
+		++active_[source];
+		++active_[dest];
+		lk.unlock();
+
+		if (queue_depth_ != 0 && !mover)
+			mover.reset(new UringMover(queue_depth_, buff_sz_));
+		std::vector<std::string> relative_paths;
+		for (File *fptr : chunk)
+			relative_paths.push_back(fptr->relative_path().string());
+		tiers_[dest]->transfer_files(chunk.begin(),
+									 chunk.end(),
+									 buff_sz_,
+									 mover && mover->ok() ? mover.get() : nullptr,
+									 run_path_,
+									 db_);
+		for (size_t i = 0; i < chunk.size(); ++i) {
+			path_cache_.invalidate(relative_paths[i].c_str());
+			KernelCache::invalidate(relative_paths[i].c_str());
+			if (chunk[i]->relative_path() != relative_paths[i]) { // renamed after conflict
+				path_cache_.invalidate(chunk[i]->relative_path().c_str());
+				KernelCache::invalidate(chunk[i]->relative_path().c_str());
+			}
+		}
+
+		lk.lock();
+		--active_[source];
+		--active_[dest];
+		if (dest > source)
+			demotions_out_[source] -= take;
+		if (queued_ == 0)
+			mover.reset(); // free registered buffers between cycles
+		pending_ -= take;
+		if (pending_ == 0)
+			done_cv_.notify_all();
+		work_cv_.notify_all();
+	}
+}
+
+bool MoverPool::next_move(size_t &pair) const {
+	size_t n = tiers_.size();
+	// first pass demotions, second pass promotions
+	for (int pass = 0; pass < 2; ++pass) {
+		for (size_t source = 0; source < n; ++source) {
+			for (size_t dest = 0; dest < n; ++dest) {
+				bool demotion = dest > source;
+				if (queues_[source * n + dest].empty() || demotion != (pass == 0))
+					continue;
+				if (active_[source] >= tiers_[source]->concurrent_moves()
+					|| active_[dest] >= tiers_[dest]->concurrent_moves())
+					continue;
+				if (!demotion && demotions_out_[dest] != 0)
+					continue; // space in dest is not free yet
+				pair = source * n + dest;
+				return true;
+			}
+		}
+	}
+	return false;
+}
@@ -0,0 +1,135 @@
+/*
+ *    Copyright (C) 2019-2021 Joshua Boudreau <jboudreau@45drives.com>
+ *
+ *    This file is part of autotier.
+ *
+ *    autotier is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    autotier is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with autotier.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "pathCache.hpp"
+
+#include "kernelCache.hpp"
+
+#include <functional>
+#include <vector>
+
+#define PATH_CACHE_SHARD_ENTRIES (PATH_CACHE_ENTRIES / PATH_CACHE_SHARDS)
+
+/**
+ * @brief Strip leading slashes so "/a" and "a" are the same key.
+ *
+ * @param path
+ * @return std::string
+ */
+static std::string cache_key(const char *path) {
+	while (*path == '/')
+		++path;
+	return std::string(path);
+}
+
+PathCache::PathCache(void) {}
+
+PathCache::Shard &PathCache::shard(const std::string &key) {
+	return shards_[std::hash<std::string>()(key) % PATH_CACHE_SHARDS];
+}
+
+bool PathCache::lookup(const char *path, Entry &entry) {
+	std::string key = cache_key(path);
+	Shard &s = shard(key);
+	std::lock_guard<std::mutex> lk(s.mt_);
+	std::unordered_map<std::string, Shard::List::iterator>::iterator itr = s.index_.find(key);
+	if (itr == s.index_.end())
+		return false;
+	s.lru_.splice(s.lru_.begin(), s.lru_, itr->second);
+	entry = itr->second->second;
+	return true;
+}
+
+uint64_t PathCache::generation(const char *path) {
+	Shard &s = shard(cache_key(path));
+	std::lock_guard<std::mutex> lk(s.mt_);
+	return s.generation_;
+}
+
+void PathCache::insert(const char *path, const Entry &entry, uint64_t generation) {
+	std::string key = cache_key(path);
+	Shard &s = shard(key);
+	std::lock_guard<std::mutex> lk(s.mt_);
+	if (s.generation_ != generation)
+		return;
+	std::unordered_map<std::string, Shard::List::iterator>::iterator itr = s.index_.find(key);
+	if (itr != s.index_.end()) {
+		itr->second->second = entry;
+		s.lru_.splice(s.lru_.begin(), s.lru_, itr->second);
+		return;
+	}
+	if (s.lru_.size() >= PATH_CACHE_SHARD_ENTRIES) {
+		s.index_.erase(s.lru_.back().first);
+		s.lru_.pop_back();
+	}
+	s.lru_.emplace_front(key, entry);
+	s.index_.emplace(std::move(key), s.lru_.begin());
+}
+
+void PathCache::invalidate(const char *path) {
+	std::string key = cache_key(path);
+	Shard &s = shard(key);
+	std::lock_guard<std::mutex> lk(s.mt_);
+	++s.generation_;
+	std::unordered_map<std::string, Shard::List::iterator>::iterator itr = s.index_.find(key);
+	if (itr == s.index_.end())
+		return;
+	s.lru_.erase(itr->second);
+	s.index_.erase(itr);
+}
+
+void PathCache::forget_missing(void) {
+	std::vector<std::string> missing;
+	for (Shard &s : shards_) {
+		{
+			std::lock_guard<std::mutex> lk(s.mt_);
+			++s.generation_;
+			for (Shard::List::iterator itr = s.lru_.begin(); itr != s.lru_.end();) {
+				if (itr->second.tier_ == nullptr) {
+					s.index_.erase(itr->first);
+					missing.push_back(std::move(itr->first));
+					itr = s.lru_.erase(itr);
+				} else {
+					++itr;
+				}
+			}
+		}
+		// the kernel may hold a negative entry for the same path
+		for (const std::string &path : missing)
+			KernelCache::invalidate(path.c_str());
+		missing.clear();
+	}
+}
+
+void PathCache::invalidate_dir(const char *path) {
+	std::string dir = cache_key(path);
+	std::string prefix = dir + "/";
+	for (Shard &s : shards_) {
+		std::lock_guard<std::mutex> lk(s.mt_);
+		++s.generation_;
+		for (Shard::List::iterator itr = s.lru_.begin(); itr != s.lru_.end();) {
+			if (itr->first == dir || itr->first.compare(0, prefix.size(), prefix) == 0) {
+				s.index_.erase(itr->first);
+				itr = s.lru_.erase(itr);
+			} else {
+				++itr;
+			}
+		}
+	}
+}
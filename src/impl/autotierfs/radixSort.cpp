@@ -0,0 +1,207 @@
+/*
+ *    Copyright (C) 2019-2021 Joshua Boudreau <jboudreau@45drives.com>
+ *
+ *    This file is part of autotier.
+ *
+ *    autotier is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    autotier is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with autotier.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "radixSort.hpp"
+
+#include <array>
+#include <functional>
+#include <thread>
+
+#define RADIX_BITS           8
+#define RADIX_BUCKETS        (1 << RADIX_BITS)
+#define RADIX_DIGITS         16    ///< Bytes in SortKey::primary_ and SortKey::secondary_
+#define RADIX_MIN_PER_THREAD 65536 ///< Smaller chunks are not worth a thread
+
+typedef std::array<size_t, RADIX_BUCKETS> Histogram; ///< Count or offset of each bucket
+
+/**
+ * @brief Get digit of key, digits 0-7 are secondary_ and 8-15 are primary_,
+ * least significant first.
+ *
+ * @param key
+ * @param digit
+ * @return unsigned int
+ */
+static inline unsigned int get_digit(const SortKey &key, unsigned int digit) {
+	uint64_t word = digit < 8 ? key.secondary_ : key.primary_;
+	return (word >> ((digit % 8) * RADIX_BITS)) & (RADIX_BUCKETS - 1);
+}
+
+/**
+ * @brief Count every digit of keys in [begin, end) at once.
+ *
+ * @param src Keys
+ * @param begin First index
+ * @param end One past last index
+ * @param counts One histogram per digit
+ */
+static void count_all(const SortKey *src, size_t begin, size_t end, Histogram *counts) {
+	for (size_t i = begin; i < end; ++i) {
+		for (unsigned int digit = 0; digit < RADIX_DIGITS; ++digit)
+			++counts[digit][get_digit(src[i], digit)];
+	}
+}
+
+/**
+ * @brief Move keys in [begin, end) to their place in dst for digit, counting next_digit of
+ * each key in the histogram of the chunk of dst it lands in, so the next pass needs no
+ * counting pass over the keys of its own.
+ *
+ * @param src Keys
+ * @param dst Output
+ * @param begin First index
+ * @param end One past last index
+ * @param n Number of keys
+ * @param digit Digit to sort by
+ * @param offsets Next free index in dst for each bucket, advanced while scattering
+ * @param chunks Chunks dst is split into, one per thread
+ * @param next_digit Digit of the next pass, RADIX_DIGITS if there is none
+ * @param next_counts One histogram per chunk of dst
+ */
+static void scatter(const SortKey *src,
+					SortKey *dst,
+					size_t begin,
+					size_t end,
+					size_t n,
+					unsigned int digit,
+					Histogram &offsets,
+					size_t chunks,
+					unsigned int next_digit,
+					Histogram *next_counts) {
+	if (next_digit == RADIX_DIGITS) {
+		for (size_t i = begin; i < end; ++i)
+			dst[offsets[get_digit(src[i], digit)]++] = src[i];
+		return;
+	}
+	for (size_t i = begin; i < end; ++i) {
+		size_t index = offsets[get_digit(src[i], digit)]++;
+		dst[index] = src[i];
+		// inverse of n * t / chunks, the first index of chunk t
+		++next_counts[((index + 1) * chunks - 1) / n][get_digit(src[i], next_digit)];
+	}
+}
+
+void radix_sort(std::vector<SortKey> &keys, size_t threads) {
+	size_t n = keys.size();
+	if (n < 2)
+		return;
+	if (threads < 1)
+		threads = 1;
+	if (n / threads < RADIX_MIN_PER_THREAD)
+		threads = n / RADIX_MIN_PER_THREAD + 1;
+	std::vector<size_t> bounds(threads + 1);
+	for (size_t t = 0; t <= threads; ++t)
+		bounds[t] = n * t / threads;
+	std::vector<SortKey> buffer(n);
+	SortKey *src = keys.data();
+	SortKey *dst = buffer.data();
+
+	std::vector<std::vector<Histogram>> all_counts(threads,
+												   std::vector<Histogram>(RADIX_DIGITS));
+	{
+		std::vector<std::thread> workers;
+		for (size_t t = 1; t < threads; ++t)
+			workers.emplace_back(count_all, src, bounds[t], bounds[t + 1], all_counts[t].data());
+		count_all(src, bounds[0], bounds[1], all_counts[0].data());
+		for (std::thread &worker : workers)
+			worker.join();
+	}
+	// digits with one bucket holding every key would not reorder anything
+	std::vector<unsigned int> digits;
+	for (unsigned int digit = 0; digit < RADIX_DIGITS; ++digit) {
+		bool skip = false;
+		for (unsigned int b = 0; b < RADIX_BUCKETS && !skip; ++b) {
+			size_t total = 0;
+			for (size_t t = 0; t < threads; ++t)
+				total += all_counts[t][digit][b];
+			skip = total == n;
+		}
+		if (!skip)
+			digits.push_back(digit);
+	}
+	if (digits.empty())
+		return;
+
+	// counts of each thread's chunk, from count_all() for the first pass and from the
+	// scatter of the pass before for later ones
+	std::vector<Histogram> counts(threads);
+	for (size_t t = 0; t < threads; ++t)
+		counts[t] = all_counts[t][digits[0]];
+	std::vector<std::vector<Histogram>> next_counts(threads, std::vector<Histogram>(threads));
+	std::vector<Histogram> offsets(threads);
+	for (size_t pass = 0; pass < digits.size(); ++pass) {
+		unsigned int digit = digits[pass];
+		unsigned int next_digit = (pass + 1 < digits.size()) ? digits[pass + 1] : RADIX_DIGITS;
+		// one chunk holds every key, so its counts are those of count_all()
+		unsigned int counted_digit = (threads == 1) ? RADIX_DIGITS : next_digit;
+		// each thread writes its keys of a bucket after those of lower threads
+		size_t offset = 0;
+		for (unsigned int b = 0; b < RADIX_BUCKETS; ++b) {
+			for (size_t t = 0; t < threads; ++t) {
+				offsets[t][b] = offset;
+				offset += counts[t][b];
+			}
+		}
+		for (std::vector<Histogram> &chunk_counts : next_counts) {
+			for (Histogram &histogram : chunk_counts)
+				histogram.fill(0);
+		}
+		std::vector<std::thread> workers;
+		for (size_t t = 1; t < threads; ++t)
+			workers.emplace_back(scatter,
+								 src,
+								 dst,
+								 bounds[t],
+								 bounds[t + 1],
+								 n,
+								 digit,
+								 std::ref(offsets[t]),
+								 threads,
+								 counted_digit,
+								 next_counts[t].data());
+		scatter(src,
+				dst,
+				bounds[0],
+				bounds[1],
+				n,
+				digit,
+				offsets[0],
+				threads,
+				counted_digit,
+				next_counts[0].data());
+		for (std::thread &worker : workers)
+			worker.join();
+		std::swap(src, dst);
+		if (next_digit == RADIX_DIGITS)
+			break;
+		if (threads == 1) {
+			counts[0] = all_counts[0][next_digit];
+			continue;
+		}
+		for (size_t chunk = 0; chunk < threads; ++chunk) {
+			counts[chunk].fill(0);
+			for (size_t t = 0; t < threads; ++t) {
+				for (unsigned int b = 0; b < RADIX_BUCKETS; ++b)
+					counts[chunk][b] += next_counts[t][chunk][b];
+			}
+		}
+	}
+	if (src != keys.data())
+		keys.swap(buffer);
+}
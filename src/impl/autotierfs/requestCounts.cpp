@@ -0,0 +1,88 @@
+/*
+ *    Copyright (C) 2019-2021 Joshua Boudreau <jboudreau@45drives.com>
+ *
+ *    This file is part of autotier.
+ *
+ *    autotier is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    autotier is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with autotier.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "requestCounts.hpp"
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+
+namespace RequestCounts {
+	/**
+	 * @brief Count of one thread, reused once the thread exits.
+	 *
+	 */
+	struct Slot {
+		std::atomic<uint64_t> count_{0}; ///< Requests handled
+		bool in_use_ = false;            ///< Whether a running thread owns this slot
+	};
+
+	std::mutex slots_mt_;
+	std::deque<Slot> slots_; ///< Deque so slots stay put as more are added
+	uint64_t retired_ = 0;   ///< Requests handled by threads that exited
+
+	/**
+	 * @brief Slot of a thread, claimed at its first request and released at exit.
+	 *
+	 */
+	class ThreadSlot {
+	public:
+		~ThreadSlot(void) {
+			if (!slot_)
+				return;
+			std::lock_guard<std::mutex> lk(slots_mt_);
+			retired_ += slot_->count_.exchange(0);
+			slot_->in_use_ = false;
+		}
+		Slot *get(void) {
+			if (slot_)
+				return slot_;
+			std::lock_guard<std::mutex> lk(slots_mt_);
+			for (Slot &slot : slots_) {
+				if (!slot.in_use_) {
+					slot_ = &slot;
+					break;
+				}
+			}
+			if (!slot_) {
+				slots_.emplace_back();
+				slot_ = &slots_.back();
+			}
+			slot_->in_use_ = true;
+			return slot_;
+		}
+	private:
+		Slot *slot_ = nullptr;
+	};
+
+	thread_local ThreadSlot thread_slot_;
+} // namespace RequestCounts
+
+void RequestCounts::count(void) {
+	thread_slot_.get()->count_.fetch_add(1, std::memory_order_relaxed);
+}
+
+uint64_t RequestCounts::snapshot(std::vector<uint64_t> &counts) {
+	std::lock_guard<std::mutex> lk(slots_mt_);
+	counts.clear();
+	for (const Slot &slot : slots_)
+		if (slot.in_use_)
+			counts.push_back(slot.count_.load(std::memory_order_relaxed));
+	return retired_;
+}
@@ -19,12 +19,53 @@
 
 #include "rocksDbHelpers.hpp"
 
+#include <array>
+#include <cstdint>
+#include <utility>
+
 const l::PathSliceTransform *l::NewPathSliceTransform() {
 	return new PathSliceTransform();
 }
 
 namespace l {
 	namespace rocksdb {
-		std::mutex global_lock_;
-	}
+		static std::array<std::mutex, KEY_LOCK_STRIPES> key_locks_;
+
+		/**
+		 * @brief Pick stripe of key with FNV-1a, skipping leading slashes so "/a" and "a"
+		 * share a lock.
+		 *
+		 * @param key
+		 * @return size_t Index into key_locks_
+		 */
+		static size_t stripe(const char *key) {
+			while (*key == '/')
+				++key;
+			uint64_t hash = 14695981039346656037ULL;
+			for (; *key; ++key)
+				hash = (hash ^ static_cast<unsigned char>(*key)) * 1099511628211ULL;
+			return hash % KEY_LOCK_STRIPES;
+		}
+
+		KeyLock::KeyLock(const char *key, const char *other_key) : second_(nullptr) {
+			size_t first = stripe(key);
+			if (other_key) {
+				size_t second = stripe(other_key);
+				if (second < first)
+					std::swap(first, second);
+				if (second != first)
+					second_ = &key_locks_[second];
+			}
+			first_ = &key_locks_[first];
+			first_->lock();
+			if (second_)
+				second_->lock();
+		}
+
+		KeyLock::~KeyLock(void) {
+			if (second_)
+				second_->unlock();
+			first_->unlock();
+		}
+	} // namespace rocksdb
 } // namespace l
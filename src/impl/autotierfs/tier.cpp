@@ -21,16 +21,47 @@
 
 #include "alert.hpp"
 #include "conflicts.hpp"
+#include "extents.hpp"
 #include "file.hpp"
 #include "openFiles.hpp"
+#include "uringMover.hpp"
 
+#include <algorithm>
+#include <atomic>
 #include <cstdlib>
+#include <functional>
+#include <memory>
 #include <thread>
 
 extern "C" {
 #include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
 #include <sys/stat.h>
 #include <sys/statvfs.h>
+#include <unistd.h>
+}
+
+#define KERNEL_COPY_CHUNK            (1 << 30)          ///< Bytes per kernel copy call
+#define MOVE_PROBE_SIZE              4096               ///< Size of probe_move_method() file
+#define MOVE_PROBE_ATTEMPTS          16                 ///< Probe names tried before giving up
+#define PARALLEL_COPY_RANGE          (64 * 1024 * 1024) ///< Bytes per range of copy_parallel()
+
+const char *move_method_str(MoveMethod method) {
+	switch (method) {
+		case MoveMethod::RENAME:
+			return "rename";
+		case MoveMethod::REFLINK:
+			return "reflink";
+		case MoveMethod::COPY_FILE_RANGE:
+			return "copy_file_range";
+		case MoveMethod::SENDFILE:
+			return "sendfile";
+		case MoveMethod::BUFFERED:
+		default:
+			return "buffered";
+	}
 }
 
 void Tier::copy_ownership_and_perms(const fs::path &old_path, const fs::path &new_path) const {
@@ -53,7 +84,9 @@ Tier::Tier(std::string id, const fs::path &path, const ffd::Quota &quota)
 	, sim_usage_(0)
 	, id_(id)
 	, path_(path)
-	, incoming_files_()
+	, concurrent_moves_(1)
+	, parallel_copy_threshold_(0)
+	, parallel_copy_threads_(1)
 	, usage_mt_() {
 	quota_.set_rounding_method(ffd::Quota::RoundingMethod::DOWN); // round down to not surpass quota
 }
@@ -85,6 +118,11 @@ void Tier::quota_percent(double quota_percent) {
 	quota_.set_fraction(quota_percent / 100.0);
 }
 
+void Tier::parallel_copy(uint64_t threshold, int threads) {
+	parallel_copy_threshold_ = threshold;
+	parallel_copy_threads_ = threads;
+}
+
 double Tier::quota_percent(void) const {
 	return quota_.get_fraction() * 100.0;
 }
@@ -105,12 +143,92 @@ const std::string &Tier::id(void) const {
 	return id_;
 }
 
-void Tier::enqueue_file_ptr(File *fptr) {
-	incoming_files_.push_back(fptr);
+void Tier::concurrent_moves(int moves) {
+	concurrent_moves_ = moves;
+}
+
+int Tier::concurrent_moves(void) const {
+	return concurrent_moves_;
+}
+
+void Tier::probe_move_method(const Tier &source) {
+	fs::path source_probe;
+	fs::path dest_probe;
+	MoveMethod method = MoveMethod::BUFFERED;
+	char buff[MOVE_PROBE_SIZE] = { 0 };
+	int source_fd = -1;
+	bool dest_created = false;
+	// hidden like move temp files, and never an existing file in either tier
+	for (int attempt = 0; attempt < MOVE_PROBE_ATTEMPTS && source_fd == -1; ++attempt) {
+		std::string name = "." + std::to_string(getpid()) + "." + std::to_string(attempt)
+						 + ".probe.autotier.hide";
+		source_probe = source.path_ / name;
+		dest_probe = path_ / name;
+		struct stat st;
+		if (lstat(dest_probe.c_str(), &st) == 0 || errno != ENOENT)
+			continue;
+		source_fd = open(source_probe.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+		if (source_fd == -1 && errno != EEXIST)
+			break;
+	}
+	if (source_fd == -1 || write(source_fd, buff, sizeof(buff)) != sizeof(buff)) {
+		Logging::log.warning("Could not create probe file in " + source.path_.string() + ": "
+							 + strerror(errno));
+	} else if (rename(source_probe.c_str(), dest_probe.c_str()) == 0) {
+		dest_created = true;
+		method = MoveMethod::RENAME;
+	} else {
+		int dest_fd = open(dest_probe.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0600);
+		dest_created = (dest_fd != -1);
+		if (dest_fd != -1) {
+			off_t offset = 0;
+			if (ioctl(dest_fd, FICLONE, source_fd) == 0)
+				method = MoveMethod::REFLINK;
+			else if (lseek(source_fd, 0, SEEK_SET) == 0
+					 && copy_file_range(source_fd, NULL, dest_fd, NULL, sizeof(buff), 0)
+							== sizeof(buff))
+				method = MoveMethod::COPY_FILE_RANGE;
+			else if (ftruncate(dest_fd, 0) == 0 && lseek(dest_fd, 0, SEEK_SET) == 0
+					 && sendfile(dest_fd, source_fd, &offset, sizeof(buff)) == sizeof(buff))
+				method = MoveMethod::SENDFILE;
+			close(dest_fd);
+		}
+	}
+	if (source_fd != -1) {
+		close(source_fd);
+		if (method != MoveMethod::RENAME)
+			unlink(source_probe.c_str());
+	}
+	if (dest_created)
+		unlink(dest_probe.c_str());
+	move_methods_[&source] = method;
+	Logging::log.message("Moving files from " + source.id_ + " to " + id_ + " with "
+							 + move_method_str(method) + ".",
+						 Logger::log_level_t::DEBUG);
+}
+
+MoveMethod Tier::move_method(const Tier *source) const {
+	std::unordered_map<const Tier *, MoveMethod>::const_iterator itr = move_methods_.find(source);
+	if (itr == move_methods_.end())
+		return MoveMethod::BUFFERED;
+	return itr->second;
 }
 
-void Tier::transfer_files(int buff_sz, const fs::path &run_path, std::shared_ptr<rocksdb::DB> &db) {
-	for (File *fptr : incoming_files_) {
+void Tier::transfer_files(std::vector<File *>::iterator begin,
+						  std::vector<File *>::iterator end,
+						  int buff_sz,
+						  UringMover *mover,
+						  const fs::path &run_path,
+						  std::shared_ptr<rocksdb::DB> &db) {
+	if (begin == end)
+		return;
+	MoveMethod method = move_method((*begin)->tier_ptr());
+	if (mover && method == MoveMethod::BUFFERED) {
+		transfer_batch(*mover, begin, end, run_path, db);
+		return;
+	}
+	for (std::vector<File *>::iterator itr = begin; itr != end; ++itr) {
+		File *fptr = *itr;
 		fs::path old_path = fptr->full_path();
 		if (OpenFiles::is_open(old_path.string())) {
 			Logging::log.warning("File is open by another process: " + old_path.string());
@@ -119,100 +237,340 @@ void Tier::transfer_files(int buff_sz, const fs::path &run_path, std::shared_ptr
 		fs::path new_path = path_ / fptr->relative_path();
 		bool conflicted = false;
 		std::string orig_tier = fptr->tier_ptr()->id_;
-		bool copy_success = Tier::move_file(old_path, new_path, buff_sz, &conflicted, orig_tier);
-		if (copy_success) {
-			fptr->transfer_to_tier(this, db);
-			fptr->overwrite_times();
-			if (conflicted) {
-				fptr->change_path(
-					fptr->relative_path().string() + ".autotier_conflict." + orig_tier, db);
-				add_conflict(new_path.string(), run_path);
+		bool copy_success =
+			Tier::move_file(old_path, new_path, buff_sz, method, &conflicted, orig_tier);
+		if (copy_success)
+			file_moved(fptr, conflicted, new_path, orig_tier, run_path, db);
+	}
+}
+
+void Tier::transfer_batch(UringMover &mover,
+						  std::vector<File *>::iterator begin,
+						  std::vector<File *>::iterator end,
+						  const fs::path &run_path,
+						  std::shared_ptr<rocksdb::DB> &db) {
+	std::vector<File *> files;
+	std::vector<UringMover::Job> jobs;
+	for (std::vector<File *>::iterator itr = begin; itr != end; ++itr) {
+		File *fptr = *itr;
+		fs::path old_path = fptr->full_path();
+		if (OpenFiles::is_open(old_path.string())) {
+			Logging::log.warning("File is open by another process: " + old_path.string());
+			continue;
+		}
+		fs::path new_path = path_ / fptr->relative_path();
+		Logging::log.message("Copying " + old_path.string() + " to " + new_path.string(),
+							 Logger::log_level_t::DEBUG);
+		UringMover::Job job;
+		if (!open_move(old_path, temp_path(new_path), job.source_fd_, job.dest_fd_))
+			continue;
+		struct stat st;
+		if (fstat(job.source_fd_, &st) == -1) {
+			Logging::log.error(std::string("Copy failed: ") + strerror(errno));
+			close(job.source_fd_);
+			close(job.dest_fd_);
+			fs::remove(temp_path(new_path));
+			continue;
+		}
+		job.size_ = st.st_size;
+		data_extents(job.source_fd_, job.size_, job.extents_);
+		files.push_back(fptr);
+		jobs.push_back(job);
+	}
+	mover.copy(jobs);
+	for (size_t i = 0; i < jobs.size(); ++i) {
+		File *fptr = files[i];
+		UringMover::Job &job = jobs[i];
+		if (close(job.source_fd_) == -1 && job.error_ == 0)
+			job.error_ = errno;
+		if (close(job.dest_fd_) == -1 && job.error_ == 0)
+			job.error_ = errno;
+		fs::path old_path = fptr->full_path();
+		fs::path new_path = path_ / fptr->relative_path();
+		if (job.error_) {
+			Logging::log.error(std::string("Copy failed: ") + strerror(job.error_));
+			fs::remove(temp_path(new_path));
+			continue;
+		}
+		bool conflicted = false;
+		std::string orig_tier = fptr->tier_ptr()->id_;
+		finish_move(old_path, temp_path(new_path), new_path, &conflicted, orig_tier);
+		file_moved(fptr, conflicted, new_path, orig_tier, run_path, db);
+	}
+}
+
+void Tier::file_moved(File *fptr,
+					  bool conflicted,
+					  const fs::path &new_path,
+					  const std::string &orig_tier,
+					  const fs::path &run_path,
+					  std::shared_ptr<rocksdb::DB> &db) {
+	fptr->transfer_to_tier(this, db);
+	fptr->overwrite_times();
+	if (conflicted) {
+		fptr->change_path(fptr->relative_path().string() + ".autotier_conflict." + orig_tier, db);
+		add_conflict(new_path.string(), run_path);
+	}
+}
+
+fs::path Tier::temp_path(const fs::path &new_path) const {
+	return new_path.parent_path() / ("." + new_path.filename().string() + ".autotier.hide");
+}
+
+bool Tier::open_move(const fs::path &old_path,
+					 const fs::path &new_tmp_path,
+					 int &source_fd,
+					 int &dest_fd) const {
+	if (!is_directory(new_tmp_path.parent_path()))
+		create_directories(new_tmp_path.parent_path());
+	source_fd = open(old_path.c_str(), O_RDONLY, 0777);
+	if (source_fd == -1) {
+		Logging::log.error(std::string("Copy failed: ") + strerror(errno));
+		return false;
+	}
+	dest_fd = open(new_tmp_path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_TRUNC, 0777);
+	if (dest_fd == -1) {
+		Logging::log.error(std::string("Copy failed: ") + strerror(errno));
+		close(source_fd);
+		return false;
+	}
+	return true;
+}
+
+void Tier::finish_move(const fs::path &old_path,
+					   const fs::path &new_tmp_path,
+					   const fs::path &new_path,
+					   bool *conflicted,
+					   const std::string &orig_tier) const {
+	copy_ownership_and_perms(old_path, new_tmp_path);
+	fs::remove(old_path);
+	if (fs::exists(new_path)) {
+		if (conflicted)
+			*conflicted = true;
+		fs::rename(new_tmp_path, new_path.string() + ".autotier_conflict." + orig_tier);
+		Logging::log.error("Encountered conflict while moving file between tiers: "
+						   + new_path.string() + "(.autotier_conflict)");
+	} else {
+		fs::rename(new_tmp_path, new_path);
+		Logging::log.message("Copy succeeded.\n", Logger::log_level_t::DEBUG);
+	}
+}
+
+int Tier::rename_file(const fs::path &old_path,
+					  const fs::path &new_path,
+					  bool *conflicted,
+					  const std::string &orig_tier) const {
+	if (!is_directory(new_path.parent_path()))
+		create_directories(new_path.parent_path());
+	fs::path target = new_path;
+	bool exists = fs::exists(new_path);
+	if (exists)
+		target = new_path.string() + ".autotier_conflict." + orig_tier;
+	if (rename(old_path.c_str(), target.c_str()) == -1)
+		return errno;
+	if (exists) {
+		if (conflicted)
+			*conflicted = true;
+		Logging::log.error("Encountered conflict while moving file between tiers: "
+						   + new_path.string() + "(.autotier_conflict)");
+	}
+	return 0;
+}
+
+bool Tier::kernel_copy(
+	int source_fd, int dest_fd, MoveMethod method, off_t &offset, off_t end) const {
+	if (method == MoveMethod::SENDFILE && lseek(dest_fd, offset, SEEK_SET) == (off_t)-1)
+		return false;
+	while (offset < end) {
+		size_t count = std::min<off_t>(KERNEL_COPY_CHUNK, end - offset);
+		ssize_t res;
+		if (method == MoveMethod::COPY_FILE_RANGE) {
+			loff_t in = offset;
+			loff_t out = offset;
+			res = copy_file_range(source_fd, &in, dest_fd, &out, count, 0);
+		} else {
+			off_t in = offset;
+			res = sendfile(dest_fd, source_fd, &in, count);
+		}
+		if (res > 0) {
+			offset += res;
+			continue;
+		}
+		if (res == 0)
+			return true; // file shrank
+		if (errno == EINTR)
+			continue;
+		if (errno == ENOSPC) {
+			Logging::log.message("Tier ran out of space while moving files, trying again.",
+								 Logger::log_level_t::DEBUG);
+			std::this_thread::yield(); // let another thread run
+			continue;
+		}
+		Logging::log.message(std::string(move_method_str(method)) + " failed, copying instead: "
+								 + strerror(errno),
+							 Logger::log_level_t::DEBUG);
+		return false;
+	}
+	return true;
+}
+
+bool Tier::copy_range(
+	int source_fd, int dest_fd, off_t offset, off_t end, char *buff, int buff_sz) const {
+	while (offset < end) {
+		ssize_t bytes_read = pread(source_fd, buff, std::min<off_t>(buff_sz, end - offset), offset);
+		if (bytes_read == -1) {
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+		if (bytes_read == 0)
+			return true; // file shrank
+		ssize_t bytes_written = 0;
+		while (bytes_written < bytes_read) {
+			ssize_t res = pwrite(dest_fd,
+								 buff + bytes_written,
+								 bytes_read - bytes_written,
+								 offset + bytes_written);
+			if (res == -1 && errno == EINTR)
+				continue;
+			if (res == -1 && errno != ENOSPC)
+				return false;
+			if (res > 0)
+				bytes_written += res;
+			if (bytes_written < bytes_read) {
+				Logging::log.message("Tier ran out of space while moving files, trying again.",
+									 Logger::log_level_t::DEBUG);
+				std::this_thread::yield(); // let another thread run
 			}
 		}
+		offset += bytes_read;
 	}
-	incoming_files_.clear();
-	sim_usage_ = 0;
+	return true;
+}
+
+bool Tier::copy_parallel(int source_fd,
+						 int dest_fd,
+						 const std::vector<Extent> &extents,
+						 MoveMethod method,
+						 int buff_sz) const {
+	std::vector<Extent> ranges;
+	for (const Extent &extent : extents) {
+		for (off_t offset = extent.offset_; offset < extent.end_; offset += PARALLEL_COPY_RANGE)
+			ranges.push_back(
+				Extent{ offset, std::min<off_t>(offset + PARALLEL_COPY_RANGE, extent.end_) });
+	}
+	std::atomic<size_t> next(0);
+	std::atomic<int> error(0);
+	std::function<void(void)> worker = [&]() {
+		std::vector<char> buff;
+		size_t i;
+		while (error == 0 && (i = next++) < ranges.size()) {
+			off_t offset = ranges[i].offset_;
+			// sendfile() moves the shared file offset, only copy_file_range() is safe here
+			if (method == MoveMethod::COPY_FILE_RANGE
+				&& kernel_copy(source_fd, dest_fd, method, offset, ranges[i].end_))
+				continue;
+			buff.resize(buff_sz);
+			if (!copy_range(source_fd, dest_fd, offset, ranges[i].end_, buff.data(), buff_sz))
+				error = errno;
+		}
+	};
+	size_t n_threads = std::min<size_t>(parallel_copy_threads_, ranges.size());
+	std::vector<std::thread> threads;
+	for (size_t i = 1; i < n_threads; ++i)
+		threads.emplace_back(worker);
+	worker();
+	for (std::thread &thread : threads)
+		thread.join();
+	if (error != 0) {
+		errno = error;
+		return false;
+	}
+	return true;
 }
 
 bool Tier::move_file(const fs::path &old_path,
 					 const fs::path &new_path,
 					 int buff_sz,
+					 MoveMethod method,
 					 bool *conflicted,
 					 std::string orig_tier) const {
 	if (conflicted)
 		*conflicted = false;
-	fs::path new_tmp_path =
-		new_path.parent_path() / ("." + new_path.filename().string() + ".autotier.hide");
-	if (!is_directory(new_path.parent_path()))
-		create_directories(new_path.parent_path());
-	Logging::log.message("Copying " + old_path.string() + " to " + new_path.string(),
+	if (method == MoveMethod::RENAME) {
+		int error = rename_file(old_path, new_path, conflicted, orig_tier);
+		if (error == 0)
+			return true;
+		if (error != EXDEV) {
+			Logging::log.error(std::string("Move failed: ") + strerror(error));
+			return false;
+		}
+		method = MoveMethod::BUFFERED; // another filesystem is mounted below the tier
+	}
+	fs::path new_tmp_path = temp_path(new_path);
+	Logging::log.message("Copying " + old_path.string() + " to " + new_path.string() + " with "
+							 + move_method_str(method),
 						 Logger::log_level_t::DEBUG);
-	bool copy_success = true;
-	bool out_of_space = false;
-	char *buff = new char[buff_sz];
-	off_t offset = 0;
-	int res;
 	int source_fd;
 	int dest_fd;
-	source_fd = open(old_path.c_str(), O_RDONLY, 0777);
-	if (source_fd == -1)
+	if (!open_move(old_path, new_tmp_path, source_fd, dest_fd))
+		return false;
+	char *buff = nullptr;
+	struct stat st;
+	std::vector<Extent> extents;
+	int close_res;
+	if (fstat(source_fd, &st) == -1)
 		goto copy_error_out;
-	dest_fd = open(new_tmp_path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_TRUNC, 0777);
-	if (dest_fd == -1)
-		goto copy_error_out;
-	off_t bytes_read;
-	off_t bytes_written;
-	do {
-		while ((bytes_read = read(source_fd, buff, buff_sz)) > 0) {
-			out_of_space = false;
-			bytes_written = write(dest_fd, buff, bytes_read);
-			if ((bytes_written == (off_t)-1 && errno == ENOSPC) || bytes_written < bytes_read) {
-				if (bytes_written != (off_t)-1)
-					offset += bytes_written; // seek to latest written byte
-				out_of_space = true;
-				res = lseek(source_fd, offset, SEEK_SET);
-				if (res == (off_t)-1)
-					goto copy_error_out;
-				res = lseek(dest_fd, offset, SEEK_SET);
-				if (res == (off_t)-1)
-					goto copy_error_out;
-				Logging::log.message("Tier ran out of space while moving files, trying again.",
-									 Logger::log_level_t::DEBUG);
-				std::this_thread::yield(); // let another thread run
-			} else if (bytes_written != bytes_read)
-				goto copy_error_out;
-			else // copy okay
-				offset += bytes_written;
-		}
-		if (bytes_read == -1)
+	if (method == MoveMethod::REFLINK) {
+		if (ioctl(dest_fd, FICLONE, source_fd) == 0)
+			goto copy_done;
+		Logging::log.message(std::string("Reflink failed, copying instead: ") + strerror(errno),
+							 Logger::log_level_t::DEBUG);
+		method = MoveMethod::COPY_FILE_RANGE;
+	}
+	// only data is copied, holes are left by truncating to full size at the end
+	data_extents(source_fd, st.st_size, extents);
+	if (parallel_copy_threads_ > 1 && uint64_t(st.st_size) >= parallel_copy_threshold_) {
+		if (!copy_parallel(source_fd, dest_fd, extents, method, buff_sz))
+			goto copy_error_out;
+		extents.clear();
+	}
+	for (const Extent &extent : extents) {
+		off_t offset = extent.offset_;
+		if (method != MoveMethod::BUFFERED
+			&& kernel_copy(source_fd, dest_fd, method, offset, extent.end_))
+			continue;
+		method = MoveMethod::BUFFERED; // finish with the buffer from where the kernel stopped
+		if (buff == nullptr)
+			buff = new char[buff_sz];
+		if (!copy_range(source_fd, dest_fd, offset, extent.end_, buff, buff_sz))
 			goto copy_error_out;
-	} while (out_of_space);
-	if (close(source_fd) == -1)
+	}
+	if (ftruncate(dest_fd, st.st_size) == -1)
 		goto copy_error_out;
-	if (close(dest_fd) == -1)
+copy_done:
+	close_res = close(source_fd);
+	source_fd = -1;
+	if (close_res == -1)
 		goto copy_error_out;
-	if (copy_success) {
-		copy_ownership_and_perms(old_path, new_tmp_path);
-		fs::remove(old_path);
-		if (fs::exists(new_path)) {
-			if (conflicted)
-				*conflicted = true;
-			fs::rename(new_tmp_path, new_path.string() + ".autotier_conflict." + orig_tier);
-			Logging::log.error("Encountered conflict while moving file between tiers: "
-							   + new_path.string() + "(.autotier_conflict)");
-		} else {
-			fs::rename(new_tmp_path, new_path);
-			Logging::log.message("Copy succeeded.\n", Logger::log_level_t::DEBUG);
-		}
-	}
+	close_res = close(dest_fd);
+	dest_fd = -1;
+	if (close_res == -1)
+		goto copy_error_out;
+	finish_move(old_path, new_tmp_path, new_path, conflicted, orig_tier);
 
 	delete[] buff;
-	return copy_success;
+	return true;
 
 copy_error_out:
-	char *why = strerror(errno);
+	int error = errno;
 	delete[] buff;
-	Logging::log.error(std::string("Copy failed: ") + why);
+	if (source_fd >= 0)
+		close(source_fd);
+	if (dest_fd >= 0)
+		close(dest_fd);
+	fs::remove(new_tmp_path);
+	Logging::log.error(std::string("Copy failed: ") + strerror(error));
 	return false;
 }
 
@@ -0,0 +1,204 @@
+/*
+ *    Copyright (C) 2019-2021 Joshua Boudreau <jboudreau@45drives.com>
+ *
+ *    This file is part of autotier.
+ *
+ *    autotier is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    autotier is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with autotier.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "uringMover.hpp"
+
+#include "alert.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <thread>
+
+extern "C" {
+#include <sys/uio.h>
+#include <unistd.h>
+}
+
+UringMover::UringMover(unsigned int queue_depth, size_t buff_sz)
+	: ok_(false), registered_(false), buff_sz_(buff_sz) {
+	if (queue_depth == 0)
+		queue_depth = 1;
+	int res = io_uring_queue_init(queue_depth, &ring_, 0);
+	if (res < 0) {
+		Logging::log.warning(std::string("io_uring is not available, copying with read()/write(): ")
+							 + strerror(-res));
+		return;
+	}
+	ok_ = true;
+	pool_.resize(queue_depth * buff_sz_);
+	slots_.resize(queue_depth);
+	std::vector<struct iovec> iovecs(queue_depth);
+	for (unsigned int i = 0; i < queue_depth; ++i) {
+		slots_[i].index_ = i;
+		slots_[i].buff_ = &pool_[i * buff_sz_];
+		iovecs[i].iov_base = slots_[i].buff_;
+		iovecs[i].iov_len = buff_sz_;
+	}
+	res = io_uring_register_buffers(&ring_, iovecs.data(), queue_depth);
+	registered_ = (res == 0);
+	if (!registered_)
+		Logging::log.message(std::string("Could not register io_uring buffers: ") + strerror(-res),
+							 Logger::log_level_t::DEBUG);
+}
+
+UringMover::~UringMover(void) {
+	if (!ok_)
+		return;
+	if (registered_)
+		io_uring_unregister_buffers(&ring_);
+	io_uring_queue_exit(&ring_);
+}
+
+bool UringMover::ok(void) const {
+	return ok_;
+}
+
+void UringMover::copy(std::vector<Job> &jobs) {
+	std::vector<size_t> extent(jobs.size(), 0); // extent being read of each job
+	std::vector<off_t> next(jobs.size(), 0);     // next offset to read of each job
+	std::vector<Slot *> free_slots;
+	for (Slot &slot : slots_)
+		free_slots.push_back(&slot);
+	for (Job &job : jobs)
+		job.error_ = ok_ ? 0 : EIO;
+	size_t job = 0;
+	size_t in_flight = 0;
+	while (ok_) {
+		// hand free buffers to the next unread ranges, across as many files as it takes
+		while (!free_slots.empty() && job < jobs.size()) {
+			if (jobs[job].error_ || extent[job] >= jobs[job].extents_.size()) {
+				++job;
+				continue;
+			}
+			const Extent &e = jobs[job].extents_[extent[job]];
+			next[job] = std::max(next[job], e.offset_);
+			if (next[job] >= e.end_) {
+				++extent[job];
+				continue;
+			}
+			Slot *slot = free_slots.back();
+			free_slots.pop_back();
+			slot->job_ = job;
+			slot->offset_ = next[job];
+			slot->len_ = std::min<off_t>(buff_sz_, e.end_ - next[job]);
+			slot->got_ = 0;
+			slot->put_ = 0;
+			slot->writing_ = false;
+			next[job] += slot->len_;
+			submit_read(jobs, slot);
+			++in_flight;
+		}
+		if (in_flight == 0)
+			break;
+		io_uring_submit(&ring_);
+		struct io_uring_cqe *cqe;
+		int res = io_uring_wait_cqe(&ring_, &cqe);
+		if (res == -EINTR)
+			continue;
+		if (res < 0) {
+			// files of this batch are tried again next cycle
+			Logging::log.error("io_uring failed, batch of " + std::to_string(jobs.size())
+							   + " moves failed, later moves copy with read()/write(): "
+							   + strerror(-res));
+			for (Job &j : jobs) {
+				if (j.error_ == 0)
+					j.error_ = -res;
+			}
+			io_uring_queue_exit(&ring_);
+			ok_ = false;
+			return;
+		}
+		Slot *slot = static_cast<Slot *>(io_uring_cqe_get_data(cqe));
+		res = cqe->res;
+		io_uring_cqe_seen(&ring_, cqe);
+		Job &j = jobs[slot->job_];
+		if (res == -EINTR || res == -EAGAIN) {
+			if (slot->writing_)
+				submit_write(jobs, slot);
+			else
+				submit_read(jobs, slot);
+			continue;
+		}
+		if (!slot->writing_) {
+			if (res > 0)
+				slot->got_ += res;
+			if (res < 0) {
+				j.error_ = -res;
+			} else if (res > 0 && slot->got_ < slot->len_) {
+				submit_read(jobs, slot); // short read
+				continue;
+			} else if (slot->got_ > 0) {
+				slot->writing_ = true; // done reading or file shrank, write what was read
+				submit_write(jobs, slot);
+				continue;
+			}
+		} else {
+			if (res > 0)
+				slot->put_ += res;
+			if ((res < 0 && res != -ENOSPC) || j.error_) {
+				if (res < 0)
+					j.error_ = -res;
+			} else if (slot->put_ < slot->got_) {
+				Logging::log.message("Tier ran out of space while moving files, trying again.",
+									 Logger::log_level_t::DEBUG);
+				std::this_thread::yield(); // let another thread run
+				submit_write(jobs, slot);
+				continue;
+			}
+		}
+		free_slots.push_back(slot);
+		--in_flight;
+	}
+	for (Job &j : jobs) {
+		// leave holes after the last extent
+		if (j.error_ == 0 && ftruncate(j.dest_fd_, j.size_) == -1)
+			j.error_ = errno;
+	}
+}
+
+void UringMover::submit_read(const std::vector<Job> &jobs, Slot *slot) {
+	struct io_uring_sqe *sqe;
+	while ((sqe = io_uring_get_sqe(&ring_)) == NULL)
+		io_uring_submit(&ring_);
+	int fd = jobs[slot->job_].source_fd_;
+	char *buff = slot->buff_ + slot->got_;
+	unsigned int len = slot->len_ - slot->got_;
+	off_t offset = slot->offset_ + slot->got_;
+	if (registered_)
+		io_uring_prep_read_fixed(sqe, fd, buff, len, offset, slot->index_);
+	else
+		io_uring_prep_read(sqe, fd, buff, len, offset);
+	io_uring_sqe_set_data(sqe, slot);
+}
+
+void UringMover::submit_write(const std::vector<Job> &jobs, Slot *slot) {
+	struct io_uring_sqe *sqe;
+	while ((sqe = io_uring_get_sqe(&ring_)) == NULL)
+		io_uring_submit(&ring_);
+	int fd = jobs[slot->job_].dest_fd_;
+	const char *buff = slot->buff_ + slot->put_;
+	unsigned int len = slot->got_ - slot->put_;
+	off_t offset = slot->offset_ + slot->put_;
+	if (registered_)
+		io_uring_prep_write_fixed(sqe, fd, buff, len, offset, slot->index_);
+	else
+		io_uring_prep_write(sqe, fd, buff, len, offset);
+	io_uring_sqe_set_data(sqe, slot);
+}
@@ -45,7 +45,9 @@ int get_command_index(const std::string &cmd) {
 											  std::regex("^[Hh]elp|HELP$"),
 											  std::regex("^[Ll]ist-[Pp]ins?|LIST-PINS?$"),
 											  std::regex("^[Ll]ist-[Pp]opularity|LIST-POPULARITY$"),
-											  std::regex("^[Ww]hich-[Tt]ier|WHICH-TIER$") };
+											  std::regex("^[Ww]hich-[Tt]ier|WHICH-TIER$"),
+											  std::regex("^[Rr]escan|RESCAN$"),
+											  std::regex("^[Ll]ist-[Tt]ier|LIST-TIER$") };
 	for (int itr = 0; itr < NUM_COMMANDS; itr++) {
 		if (regex_match(cmd, command_list[itr]))
 			return itr;
@@ -97,11 +99,16 @@ void cli_usage() {
 		"  config      - display current configuration values\n"
 		"  help        - display this message\n"
 		"  list-pins   - show all pinned files\n"
-		"  list-popularity\n"
-		"              - print list of all tier files sorted by frequency of use\n"
+		"  list-popularity [top <N> | bottom <N> | range <min> <max>]\n"
+		"              - print list of all tier files sorted by frequency of use, or only\n"
+		"                the N most or least used, or those used min to max times per hour\n"
+		"  list-tier <\"tier name\"> [size | popularity]\n"
+		"              - print files in tier with their size and popularity, sorted by\n"
+		"                path or largest or most popular first, and the tier's usage\n"
 		"  oneshot     - execute tiering only once\n"
 		"  pin <\"tier name\"> <\"path/to/file\" \"path/to/file\" ...>\n"
 		"              - pin file(s) to tier using tier name in config file\n"
+		"  rescan      - crawl every tier instead of using the change journal, then tier\n"
 		"  status      - list info about defined tiers\n"
 		"  unpin <\"path/to/file\" \"path/to/file\" ...>\n"
 		"              - remove pin from file(s)\n"
@@ -58,7 +58,7 @@ public:
 	 */
 	void process_adhoc_requests(void);
 	/**
-	 * @brief Enqueue oneshot AdHoc command into adhoc_work_.
+	 * @brief Enqueue oneshot or rescan AdHoc command into adhoc_work_.
 	 *
 	 * @param work The command to be processed, containing needed args_.
 	 */
@@ -82,14 +82,24 @@ public:
 	void process_config(void);
 	/**
 	 * @brief Send all pinned files with the corresponding tier they are pinned to.
+	 * Read from the index of pinned files instead of every record.
 	 *
 	 */
 	void process_list_pins(void);
 	/**
-	 * @brief Send all file paths in filesystem along with popularity.
+	 * @brief Send file paths in filesystem along with popularity, most popular first.
+	 * Arguments can limit the list to the top or bottom N files or to a popularity range.
 	 *
+	 * @param work Work object containing arguments
 	 */
-	void process_list_popularity(void);
+	void process_list_popularity(const AdHoc &work);
+	/**
+	 * @brief Send files in one tier with their size and popularity, and the tier's usage,
+	 * read from the tier index without touching other tiers' entries.
+	 *
+	 * @param work Work object containing tier name and optional sort order
+	 */
+	void process_list_tier(const AdHoc &work);
 	/**
 	 * @brief Send table of each argument file along with its corresponding tier name
 	 * and full backend path.
@@ -19,8 +19,11 @@
 
 #pragma once
 
+#include "accessCache.hpp"
 #include "concurrentQueue.hpp"
 #include "config.hpp"
+#include "journal.hpp"
+#include "pathCache.hpp"
 #include "tier.hpp"
 #include "tools.hpp"
 
@@ -81,6 +84,33 @@ public:
 	 * @param mount_point Path to filesystem mount point
 	 */
 	void mount_point(const fs::path &mount_point);
+	/**
+	 * @brief Get reference to the change journal. Used in fuseOps to record
+	 * changed paths for incremental tiering.
+	 *
+	 * @return ChangeJournal& Reference to journal_.
+	 */
+	ChangeJournal &get_journal(void);
+	/**
+	 * @brief Get reference to the access count cache. Used in fuseOps to count opens
+	 * without rewriting metadata each time.
+	 *
+	 * @return AccessCache& Reference to access_cache_.
+	 */
+	AccessCache &get_access_cache(void);
+	/**
+	 * @brief Get reference to the path cache. Used in fuseOps to find files without
+	 * a database lookup.
+	 *
+	 * @return PathCache& Reference to path_cache_.
+	 */
+	PathCache &get_path_cache(void);
+	/**
+	 * @brief Get the loaded configuration. Used in fuseOps init to set FUSE options.
+	 *
+	 * @return const Config& Reference to config_.
+	 */
+	const Config &get_config(void) const;
 	/**
 	 * @brief Virtual tier function to allow other components to call TierEngineTiering::tier().
 	 *
@@ -115,6 +145,10 @@ protected:
 	 */
 	std::condition_variable sleep_cv_;
 	std::shared_ptr<rocksdb::DB> db_; ///< Nosql database holding file metadata.
+	ChangeJournal journal_;    ///< Paths changed since last tiering, opened if incremental tiering.
+	bool rescan_requested_;    ///< Set by the rescan ad hoc command to force a full crawl.
+	AccessCache access_cache_; ///< Access counts not yet written to db_.
+	PathCache path_cache_;     ///< Tier of recently used paths, invalidated when files move.
 	/**
 	 * @brief Virtual exit function that can be overridden by other components for cleanup
 	 *
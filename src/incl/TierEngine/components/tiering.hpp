@@ -22,9 +22,48 @@
 #include "adhoc.hpp"
 #include "database.hpp"
 #include "mutex.hpp"
+#include "file.hpp"
+#include "fileTable.hpp"
+#include "moverPool.hpp"
 #include "sleep.hpp"
+#include "workStealingQueue.hpp"
 
 #include <chrono>
+#include <memory>
+#include <unordered_map>
+
+/**
+ * @brief Directory waiting to be crawled, along with the tier it belongs to.
+ *
+ */
+struct CrawlItem {
+	fs::path dir_; ///< Backend path of directory to iterate
+	Tier *tptr_;   ///< Tier containing dir_
+};
+
+/**
+ * @brief Per-thread output of a crawler worker, merged into TierEngineTiering::files_
+ * after every worker has joined so workers never contend on a shared vector.
+ *
+ */
+struct CrawlBuffer {
+	FileTable files_; ///< Files found by this worker
+	/**
+	 * @brief Bytes found by this worker in each tier, for reporting tier usage.
+	 *
+	 */
+	std::unordered_map<Tier *, ffd::Bytes::bytes_type> usage_;
+};
+
+class TierEngineTiering;
+
+/**
+ * @brief Function executed by crawlers for each file found.
+ *
+ */
+typedef void (TierEngineTiering::*CrawlFunction)(fs::directory_entry &entry,
+												 Tier *tptr,
+												 CrawlBuffer &buffer);
 
 /**
  * @brief TierEngine component to deal with tiering, inherits all other components
@@ -67,43 +106,75 @@ public:
 	 */
 	bool tier(void);
 	/**
-	 * @brief Call crawl() for each tier in tiers.
+	 * @brief Fill files_ for this cycle. With incremental tiering and a valid file table,
+	 * only the files recorded in journal_ since the last cycle are re-read with
+	 * apply_journal(). Otherwise, or when a rescan was requested or journal records
+	 * were lost, every tier is crawled with launch_crawlers().
+	 *
+	 */
+	void gather_files(void);
+	/**
+	 * @brief Bring files_ up to date with journaled changes. Applies directory renames to
+	 * every directory in the table, drops each changed path, then reloads the ones still
+	 * in the database.
+	 *
+	 * @param entries Journal records from ChangeJournal::drain()
+	 */
+	void apply_journal(const std::vector<ChangeJournal::Entry> &entries);
+	/**
+	 * @brief Write files_ and each tier's usage to run_path_/file_table so the first
+	 * incremental cycle after the next mount can skip the full crawl. Called from
+	 * fuse_ops::destroy() after the tiering thread has joined.
+	 *
+	 */
+	void save_file_table(void);
+	/**
+	 * @brief Load the file table saved by save_file_table(), then remove it so a crash
+	 * forces a full crawl. Rejected unless it was saved with the same tiers in the same order.
+	 *
+	 * @return true Loaded, files_ and tier usage are valid
+	 * @return false No usable table, next cycle does a full crawl
+	 */
+	bool load_file_table(void);
+	/**
+	 * @brief Crawl every tier at once with Config::crawler_threads() workers sharing a
+	 * work-stealing queue of directories, then merge each worker's CrawlBuffer into files_
+	 * and set each tier's usage.
 	 *
-	 * @param function Function to execute for each tier
+	 * @param function Function to execute for each file
 	 */
-	void launch_crawlers(void (TierEngineTiering::*function)(
-		fs::directory_entry &itr, Tier *tptr, std::atomic<ffd::Bytes::bytes_type> &usage));
+	void launch_crawlers(CrawlFunction function);
 	/**
-	 * @brief Recurse into tier directory, executing function on each file.
+	 * @brief Crawler worker. Pops directories from queue, pushing subdirectories back
+	 * onto it and executing function on each file, until all tiers are crawled.
 	 * Function can be emplace_file(), print_file_pins(), or print_file_popularity().
 	 *
-	 * @param dir Current directory path during recursion
-	 * @param tptr Pointer to tier it is running for
+	 * @param worker Index of this worker in queue
+	 * @param queue Directories left to crawl across all tiers
 	 * @param function Function to execute on each file
-	 * @param usage Keeps track of recursive file size for reporting tier usage
+	 * @param buffer This worker's output buffer
 	 */
-	void crawl(fs::path dir,
-			   Tier *tptr,
-			   void (TierEngineTiering::*function)(fs::directory_entry &itr,
-												   Tier *tptr,
-												   std::atomic<ffd::Bytes::bytes_type> &usage),
-			   std::atomic<ffd::Bytes::bytes_type> &usage);
+	void crawl(size_t worker,
+			   WorkStealingQueue<CrawlItem> &queue,
+			   CrawlFunction function,
+			   CrawlBuffer &buffer);
 	/**
-	 * @brief Place file into files_, constructing with fs::path, Tier*, and db_.
+	 * @brief Append row for file to buffer with its lstat() and metadata from db_.
 	 *
 	 * @param file Directory entry for file, containing path
 	 * @param tptr Tier the file was found in
-	 * @param usage Keeps track of recursive file size for reporting tier usage
+	 * @param buffer Crawler worker's output buffer, also tracks tier usage
 	 */
-	void
-	emplace_file(fs::directory_entry &file, Tier *tptr, std::atomic<ffd::Bytes::bytes_type> &usage);
+	void emplace_file(fs::directory_entry &file, Tier *tptr, CrawlBuffer &buffer);
 	/**
-	 * @brief Call File::calc_popularity() for each file in files_.
+	 * @brief Call FileTable::calc_popularity() on files_.
 	 *
 	 */
 	void calc_popularity(void);
 	/**
-	 * @brief Sorts list of files based on popularity, if pop1 == pop2, sort by atime.
+	 * @brief Sorts rows of files_ based on popularity, if pop1 == pop2, sort by atime.
+	 * Packs both into a SortKey per row, orders the keys with radix_sort() (one thread in
+	 * the no-par-sort build), then applies the order with FileTable::permute().
 	 *
 	 */
 	void sort(void);
@@ -119,21 +190,41 @@ public:
 	 *        tier = next tier
 	 *        tier_usage = 0
 	 *    END IF
-	 *    file belongs to tier (push file into tier.incoming_files_)
+	 *    file belongs to tier (queue file in mover_pool_)
 	 *    tier_usage += size of file
 	 *    file = next file
 	 * END DO
 	 *
+	 * Files to move are copied out of files_ into moving_files_ as File objects.
+	 * With Minimal Movement set, plan_minimal_movement() is used instead of the above.
+	 * The bytes and number of files planned to move between each pair of tiers are logged.
+	 *
 	 */
 	void simulate_tier(void);
 	/**
-	 * @brief Launch one thread for each tier to move incoming files into their new
-	 * backend paths based on results of simulate_tier().
+	 * @brief Place every unpinned row in the first tier with room for it, in sorted order.
+	 *
+	 * @param targets Index of tier each row should end up in, by row
+	 */
+	void plan_greedy(std::vector<uint8_t> &targets);
+	/**
+	 * @brief Keep unpinned rows in their current tier unless they are more than the
+	 * hysteresis band past the tier boundary found by plan_greedy(), then demote the least
+	 * popular rows of any tier still over quota into the next tier.
+	 *
+	 * @param targets Index of tier each row should end up in, by row
+	 */
+	void plan_minimal_movement(std::vector<uint8_t> &targets);
+	/**
+	 * @brief Let mover_pool_ move the files queued by simulate_tier() into their new
+	 * backend paths and wait for it, then write each file's new tier and path back to
+	 * files_.
 	 *
 	 */
 	void move_files(void);
 	/**
-	 * @brief Iterate over file list and call File::update_db().
+	 * @brief Iterate over unpinned rows of files_ and merge their tier and popularity
+	 * into db_, then reset their access counts. Every row goes into the popularity index.
 	 * 
 	 */
 	void update_db(void);
@@ -164,8 +255,34 @@ public:
 	 * @param status Exit status of process
 	 */
 	void exit(int status);
+	/**
+	 * @brief Find index of tier in tier_ptrs_, as stored in FileTable rows.
+	 *
+	 * @param tptr Tier to find
+	 * @return uint8_t Index of tier, NO_TIER_INDEX if it is not in tier_ptrs_
+	 */
+	uint8_t tier_index(const Tier *tptr) const;
+	/**
+	 * @brief Get size of row used while placing files, allocated size if Place By
+	 * Allocated Size is set, else apparent size.
+	 *
+	 * @param row
+	 * @return uint64_t
+	 */
+	uint64_t placed_size(FileTable::row_type row) const;
 private:
 	bool currently_tiering_; ///< Whether or not tiering is happening. Set and cleared in tier()
 	std::chrono::steady_clock::time_point last_tier_time_; ///< For determining tier period.
-	std::vector<File> files_; ///< Vector to contain every file across all tiers for sorting.
+	FileTable files_; ///< Table of every file across all tiers for sorting.
+	std::vector<Tier *> tier_ptrs_; ///< tiers_ by index, for FileTable::tier()
+	std::vector<File> moving_files_; ///< Files queued in mover_pool_ by simulate_tier()
+	std::vector<FileTable::row_type> moving_rows_; ///< Row in files_ of each of moving_files_
+	/**
+	 * @brief Set when files_ is kept between cycles for incremental tiering and matches
+	 * the tiers as of the last drain of journal_.
+	 *
+	 */
+	bool file_table_valid_;
+	bool crawled_; ///< Set when this cycle crawled every tier, so every row is written back
+	std::unique_ptr<MoverPool> mover_pool_; ///< Threads moving files between tiers
 };
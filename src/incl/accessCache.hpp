@@ -0,0 +1,141 @@
+/*
+ *    Copyright (C) 2019-2021 Joshua Boudreau <jboudreau@45drives.com>
+ *
+ *    This file is part of autotier.
+ *
+ *    autotier is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    autotier is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with autotier.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <rocksdb/db.h>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+#define ACCESS_CACHE_SHARDS       64     ///< Independent maps, picked by hash of path
+#define ACCESS_CACHE_MAX_PATHS    100000 ///< Paths held before waking the flusher early
+#define ACCESS_CACHE_FLUSH_PERIOD std::chrono::seconds(5) ///< Time between flushes
+
+/**
+ * @brief Write-back cache of file access counts. open() adds to an in-memory counter
+ * instead of reading, incrementing and rewriting the file's metadata in the database, and a
+ * background thread merges the summed counts into the database periodically with
+ * Metadata::add_accesses(), which does not read the record first. Counts are
+ * split into shards by hash of the path so concurrent opens of different files rarely
+ * share a lock, and no database or disk access happens while one is held.
+ *
+ */
+class AccessCache {
+public:
+	/**
+	 * @brief Construct a new Access Cache object with no flusher running
+	 *
+	 */
+	AccessCache(void);
+	/**
+	 * @brief Destroy the Access Cache object, stopping the flusher.
+	 *
+	 */
+	~AccessCache(void);
+	/**
+	 * @brief Start background thread flushing counts into db.
+	 *
+	 * @param db RocksDB database holding file metadata
+	 */
+	void start(std::shared_ptr<rocksdb::DB> db);
+	/**
+	 * @brief Stop background thread and flush what is left.
+	 *
+	 */
+	void stop(void);
+	/**
+	 * @brief Count one access of path.
+	 *
+	 * @param path Path relative to the filesystem root, leading slashes are stripped
+	 */
+	void touch(const char *path);
+	/**
+	 * @brief Move held count of from to to, so it is flushed under the new name instead
+	 * of creating a record for the old one.
+	 *
+	 * @param from Old path relative to the filesystem root
+	 * @param to New path relative to the filesystem root
+	 * @param directory Also move counts of every path below from
+	 */
+	void rename(const char *from, const char *to, bool directory);
+	/**
+	 * @brief Drop held count of an unlinked path.
+	 *
+	 * @param path Path relative to the filesystem root
+	 */
+	void forget(const char *path);
+	/**
+	 * @brief Merge every held count into the access count in the database and empty the
+	 * cache. Called before tiering reads access counts.
+	 *
+	 */
+	void flush(void);
+private:
+	/**
+	 * @brief One lock and map of the cache.
+	 *
+	 */
+	struct Shard {
+		std::mutex mt_;                                       ///< Lock for counts_ and flushing_
+		std::unordered_map<std::string, uintmax_t> counts_;   ///< Accesses since last flush
+		std::unordered_map<std::string, uintmax_t> flushing_; ///< Swapped out, not merged yet
+	};
+	/**
+	 * @brief Flusher thread, flushes every ACCESS_CACHE_FLUSH_PERIOD until stopped.
+	 *
+	 */
+	void flush_loop(void);
+	/**
+	 * @brief Get shard holding key.
+	 *
+	 * @param key Path with leading slashes stripped
+	 * @return Shard&
+	 */
+	Shard &shard_of(const std::string &key);
+	/**
+	 * @brief Remove key from its shard, including a count flush() has not merged yet.
+	 *
+	 * @param key Path with leading slashes stripped
+	 * @return uintmax_t Count held for key, 0 if none
+	 */
+	uintmax_t take(const std::string &key);
+	/**
+	 * @brief Add count to key.
+	 *
+	 * @param key Path with leading slashes stripped
+	 * @param count Accesses to add
+	 */
+	void add(std::string key, uintmax_t count);
+	std::array<Shard, ACCESS_CACHE_SHARDS> shards_; ///< Counts split by hash of path
+	std::atomic<size_t> paths_;        ///< Paths held in every shard, to bound memory
+	std::shared_ptr<rocksdb::DB> db_;  ///< Database to flush to, null until started
+	std::mutex flush_mt_;              ///< Serializes flush()
+	std::mutex sleep_mt_;              ///< Lock for stop_flag_ and sleep_cv_
+	std::condition_variable sleep_cv_; ///< Wakes flusher early or to stop
+	bool stop_flag_;                   ///< Set to make flusher exit
+	std::thread flusher_;              ///< Thread running flush_loop()
+};
@@ -26,9 +26,10 @@
 #include <chrono>
 namespace fs = boost::filesystem;
 
-#define DEFAULT_CONFIG_PATH "/etc/autotier.conf"
-#define TIER_PERIOD_DISBLED -1
-#define LOG_LEVEL_NOT_SET   -1
+#define DEFAULT_CONFIG_PATH  "/etc/autotier.conf"
+#define TIER_PERIOD_DISBLED  -1
+#define LOG_LEVEL_NOT_SET    -1
+#define DEFAULT_FUSE_THREADS 10 ///< FUSE Threads and FUSE Idle Threads when not set
 
 template<class T>
 /* ConfigOverride is used with command line flags
@@ -90,12 +91,72 @@ public:
 	size_t copy_buff_sz(void) const;
 	/* Get copy_buff_sz_.
 	 */
+	unsigned int copy_queue_depth(void) const;
+	/* Get copy_queue_depth_ if io_uring_copy_, else 0.
+	 */
+	uint64_t parallel_copy_threshold(void) const;
+	/* Get parallel_copy_threshold_.
+	 */
+	int parallel_copy_threads(void) const;
+	/* Get parallel_copy_threads_.
+	 */
+	int mover_threads(void) const;
+	/* Get mover_threads_.
+	 */
 	std::chrono::seconds tier_period_s(void) const;
 	/* Get tier_period_s_.
 	 */
 	bool strict_period(void) const;
 	/* Return true if strict_period_ == 1, else 0.
 	 */
+	int crawler_threads(void) const;
+	/* Get crawler_threads_.
+	 */
+	bool incremental_tiering(void) const;
+	/* Get incremental_tiering_.
+	 */
+	bool minimal_movement(void) const;
+	/* Get minimal_movement_.
+	 */
+	int hysteresis(void) const;
+	/* Get hysteresis_.
+	 */
+	bool place_by_allocated_size(void) const;
+	/* Get place_by_allocated_size_.
+	 */
+	int negative_timeout(void) const;
+	/* Get negative_timeout_.
+	 */
+	int kernel_cache_timeout(void) const;
+	/* Get kernel_cache_timeout_.
+	 */
+	bool directory_keys(void) const;
+	/* Get directory_keys_.
+	 */
+	bool lowlevel_fuse(void) const;
+	/* Get lowlevel_fuse_.
+	 */
+	int fuse_threads(void) const;
+	/* Get fuse_threads_.
+	 */
+	int fuse_idle_threads(void) const;
+	/* Get fuse_idle_threads_.
+	 */
+	bool fuse_clone_fd(void) const;
+	/* Get fuse_clone_fd_.
+	 */
+	bool passthrough(void) const;
+	/* Get passthrough_.
+	 */
+	int keep_cache_popularity(void) const;
+	/* Get keep_cache_popularity_.
+	 */
+	uint64_t direct_io_size(void) const;
+	/* Get direct_io_size_.
+	 */
+	int direct_io_popularity(void) const;
+	/* Get direct_io_popularity_.
+	 */
 	fs::path run_path(void) const;
 	/* Get run_path_.
 	 */
@@ -115,6 +176,32 @@ private:
 	 *
 	 */
 	size_t copy_buff_sz_;
+	/**
+	 * @brief If true, files are moved between tiers with io_uring instead of a
+	 * read()/write() loop.
+	 *
+	 */
+	bool io_uring_copy_;
+	/**
+	 * @brief Number of copy buffers, and so reads and writes in flight, with io_uring.
+	 *
+	 */
+	int copy_queue_depth_;
+	/**
+	 * @brief Files of at least this many bytes are copied in ranges by many threads.
+	 *
+	 */
+	uint64_t parallel_copy_threshold_;
+	/**
+	 * @brief Number of threads copying ranges of one large file, 1 to disable.
+	 *
+	 */
+	int parallel_copy_threads_;
+	/**
+	 * @brief Number of threads moving files between tiers.
+	 *
+	 */
+	int mover_threads_;
 	/**
 	 * @brief Polling period to check whether to send new files in seconds.
 	 *
@@ -131,6 +218,92 @@ private:
 	 * 
 	 */
 	int crawler_threads_;
+	/**
+	 * @brief If true, only files recorded in the change journal are re-read each period
+	 * instead of crawling every tier.
+	 *
+	 */
+	bool incremental_tiering_;
+	/**
+	 * @brief If true, files only change tiers to get tiers under quota or when they
+	 * are clearly past a tier boundary, instead of re-packing every file each period.
+	 *
+	 */
+	bool minimal_movement_;
+	/**
+	 * @brief Percent of a tier's capacity that a file must be past a tier boundary
+	 * before minimal movement moves it.
+	 *
+	 */
+	int hysteresis_;
+	/**
+	 * @brief If true, files are placed by bytes allocated on disk instead of apparent
+	 * size, so sparse files take up only their data in each tier's quota.
+	 *
+	 */
+	bool place_by_allocated_size_;
+	/**
+	 * @brief Seconds the kernel may cache that a path does not exist, 0 to always ask.
+	 *
+	 */
+	int negative_timeout_;
+	/**
+	 * @brief Seconds the kernel may cache attributes and directory entries, 0 to always ask.
+	 *
+	 */
+	int kernel_cache_timeout_;
+	/**
+	 * @brief If true, metadata is keyed by parent directory id and file name instead of
+	 * by path, so renaming a directory only rewrites the directory's own entry.
+	 *
+	 */
+	bool directory_keys_;
+	/**
+	 * @brief If true, the filesystem is served through the low-level FUSE API with an
+	 * inode table instead of resolving every request by path.
+	 *
+	 */
+	bool lowlevel_fuse_;
+	/**
+	 * @brief Most threads handling FUSE requests at once. Only honoured when built against
+	 * libfuse 3.12 or newer with FUSE_USE_VERSION=312.
+	 *
+	 */
+	int fuse_threads_;
+	/**
+	 * @brief Most FUSE threads kept waiting for requests, extra idle threads exit.
+	 *
+	 */
+	int fuse_idle_threads_;
+	/**
+	 * @brief If true, each FUSE thread reads requests from its own clone of the /dev/fuse
+	 * descriptor instead of all threads sharing one.
+	 *
+	 */
+	bool fuse_clone_fd_;
+	/**
+	 * @brief If true, files opened read-only through the low-level API are bound to their
+	 * backend file in the kernel, so reads never reach autotier.
+	 *
+	 */
+	bool passthrough_;
+	/**
+	 * @brief Popularity in accesses per hour from which the kernel keeps cached pages of an
+	 * unchanged file across opens, 0 to never keep them.
+	 *
+	 */
+	int keep_cache_popularity_;
+	/**
+	 * @brief Size from which files below direct_io_popularity_ outside the highest tier are
+	 * opened without the page cache, 0 to always use it.
+	 *
+	 */
+	uint64_t direct_io_size_;
+	/**
+	 * @brief Popularity in accesses per hour below which large files bypass the page cache.
+	 *
+	 */
+	int direct_io_popularity_;
 	/**
 	 * @brief Path to database and FIFOs. Default location: /var/lib/autotier
 	 *
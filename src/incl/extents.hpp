@@ -0,0 +1,46 @@
+/*
+ *    Copyright (C) 2019-2021 Joshua Boudreau <jboudreau@45drives.com>
+ *
+ *    This file is part of autotier.
+ *
+ *    autotier is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    autotier is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with autotier.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <vector>
+
+extern "C" {
+#include <sys/types.h>
+}
+
+/**
+ * @brief Range of a file holding data, [offset_, end_).
+ *
+ */
+struct Extent {
+	off_t offset_; ///< First byte
+	off_t end_;    ///< One past last byte
+};
+
+/**
+ * @brief Find the data extents of a file with SEEK_DATA and SEEK_HOLE, so holes of sparse
+ * files can be skipped while copying. If the filesystem does not support them, the whole
+ * file is one extent. Leaves the file offset of fd at 0.
+ *
+ * @param fd Open file
+ * @param size Size of file
+ * @param extents Filled with data extents in order
+ */
+void data_extents(int fd, off_t size, std::vector<Extent> &extents);
@@ -33,6 +33,7 @@ class Tier;
  *
  */
 class File {
+	friend class FileTable;
 public:
 	/**
 	 * @brief Construct a new empty File object
@@ -86,14 +87,6 @@ public:
 	 * @param db Rocksdb database pointer
 	 */
 	void update_db(std::shared_ptr<rocksdb::DB> &db);
-	/**
-	 * @brief Calculate new popularity value of file.
-	 * y[n] = MULTIPLIER * x / DAMPING + (1.0 - 1.0 / DAMPING) * y[n-1]
-	 * where x is file usage frequency
-	 *
-	 * @param period_seconds Period over which to calculate
-	 */
-	void calc_popularity(double period_seconds);
 	/**
 	 * @brief Return full backend path to file via tier.
 	 *
@@ -0,0 +1,413 @@
+/*
+ *    Copyright (C) 2019-2021 Joshua Boudreau <jboudreau@45drives.com>
+ *
+ *    This file is part of autotier.
+ *
+ *    autotier is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    autotier is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with autotier.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "file.hpp"
+#include "metadata.hpp"
+
+#include <boost/serialization/string.hpp>
+#include <boost/serialization/vector.hpp>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+extern "C" {
+#include <sys/stat.h>
+}
+
+#define FILE_TABLE_MAX_TIERS       255  ///< Tier indices are stored in one byte
+#define NO_TIER_INDEX              255  ///< Index of a tier not being tiered, never valid
+#define POPULARITY_WRITE_TOLERANCE 0.05 ///< Relative popularity drift before a rewrite
+
+class Tier;
+
+/**
+ * @brief Structure-of-arrays table of every file being tiered. Each column is a contiguous
+ * vector indexed by row so popularity calculation, sorting and tier simulation only touch
+ * the fields they need. Directories are interned once and file names are packed into a
+ * single character arena, so a row costs 78 bytes of columns (one uint32_t, two uint8_t and
+ * nine 8-byte fields) plus its name.
+ *
+ */
+class FileTable {
+	friend class boost::serialization::access;
+public:
+	typedef uint32_t row_type; ///< Row index, also used for sort orderings
+	/**
+	 * @brief Bits of the flags column.
+	 *
+	 */
+	enum Flag : uint8_t {
+		PINNED = 0x01, ///< File stays in its current tier
+		DIRTY = 0x02   ///< Tier, path or record changed since last written to the database
+	};
+	/**
+	 * @brief Construct a new empty File Table object
+	 *
+	 */
+	FileTable(void);
+	/**
+	 * @brief Destroy the File Table object
+	 *
+	 */
+	~FileTable(void) = default;
+	/**
+	 * @brief Number of rows.
+	 *
+	 * @return size_t
+	 */
+	size_t size(void) const {
+		return dir_.size();
+	}
+	/**
+	 * @brief Check if table has no rows.
+	 *
+	 * @return true Empty
+	 * @return false Not empty
+	 */
+	bool empty(void) const {
+		return dir_.empty();
+	}
+	/**
+	 * @brief Remove every row, directory and name.
+	 *
+	 */
+	void clear(void);
+	/**
+	 * @brief Reserve space in every column.
+	 *
+	 * @param rows Number of rows
+	 */
+	void reserve(size_t rows);
+	/**
+	 * @brief Append a row.
+	 *
+	 * @param relative_path Path of file relative to the tier root
+	 * @param tier Index of tier holding the file
+	 * @param st lstat() of the file
+	 * @param metadata Metadata of the file from the database
+	 */
+	void emplace_back(const std::string &relative_path,
+					  uint8_t tier,
+					  const struct stat &st,
+					  const Metadata &metadata);
+	/**
+	 * @brief Move every row of other to the end of this table, re-interning its directories.
+	 *
+	 * @param other Table to empty into this one
+	 */
+	void append(FileTable &&other);
+	/**
+	 * @brief Remove every row for which pred(row) returns true, keeping order.
+	 *
+	 * @tparam Pred bool(row_type)
+	 * @param pred Predicate
+	 */
+	template<class Pred>
+	void erase_if(Pred pred) {
+		row_type out = 0;
+		for (row_type row = 0; row < size(); ++row) {
+			if (pred(row)) {
+				dead_name_bytes_ += strlen(name(row)) + 1;
+				continue;
+			}
+			if (out != row)
+				move_row(row, out);
+			++out;
+		}
+		resize(out);
+		compact_names();
+	}
+	/**
+	 * @brief Reorder rows so row i becomes old row order[i].
+	 *
+	 * @param order Permutation of [0, size())
+	 */
+	void permute(const std::vector<row_type> &order);
+	/**
+	 * @brief Rename every interned directory equal to or under old_dir.
+	 *
+	 * @param old_dir Old directory path relative to the tier root
+	 * @param new_dir New directory path relative to the tier root
+	 */
+	void rename_dirs(const std::string &old_dir, const std::string &new_dir);
+	/**
+	 * @brief Give a row a new relative path.
+	 *
+	 * @param row Row to change
+	 * @param relative_path New path relative to the tier root
+	 */
+	void rename(row_type row, const std::string &relative_path);
+	/**
+	 * @brief Calculate new popularity of every unpinned row.
+	 * y[n] = MULTIPLIER * x / DAMPING + (1.0 - 1.0 / DAMPING) * y[n-1]
+	 * where x is file usage frequency
+	 *
+	 * @param period_seconds Period over which to calculate
+	 */
+	void calc_popularity(double period_seconds);
+	/**
+	 * @brief Zero access count of every row, once the counts used for popularity have
+	 * been taken off the database.
+	 *
+	 */
+	void reset_access_counts(void);
+	/**
+	 * @brief Build path of row relative to the tier root.
+	 *
+	 * @param row
+	 * @return std::string
+	 */
+	std::string relative_path(row_type row) const;
+	/**
+	 * @brief Get interned directory of row, relative to the tier root. Empty for the root.
+	 *
+	 * @param row
+	 * @return const std::string&
+	 */
+	const std::string &dir(row_type row) const {
+		return dirs_[dir_[row]];
+	}
+	/**
+	 * @brief Get file name of row.
+	 *
+	 * @param row
+	 * @return const char*
+	 */
+	const char *name(row_type row) const {
+		return &names_[name_[row]];
+	}
+	/**
+	 * @brief Get index of tier holding row.
+	 *
+	 * @param row
+	 * @return uint8_t
+	 */
+	uint8_t tier(row_type row) const {
+		return tier_[row];
+	}
+	/**
+	 * @brief Set index of tier holding row.
+	 *
+	 * @param row
+	 * @param tier
+	 */
+	void tier(row_type row, uint8_t tier) {
+		if (tier_[row] != tier)
+			flags_[row] |= DIRTY;
+		tier_[row] = tier;
+	}
+	/**
+	 * @brief Get size of file in bytes.
+	 *
+	 * @param row
+	 * @return uint64_t
+	 */
+	uint64_t file_size(row_type row) const {
+		return size_[row];
+	}
+	/**
+	 * @brief Get bytes allocated to file on disk, less than file_size() for sparse files.
+	 *
+	 * @param row
+	 * @return uint64_t
+	 */
+	uint64_t alloc_size(row_type row) const {
+		return alloc_size_[row];
+	}
+	/**
+	 * @brief Get last access time in microseconds since the epoch.
+	 *
+	 * @param row
+	 * @return int64_t
+	 */
+	int64_t atime(row_type row) const {
+		return atime_[row];
+	}
+	/**
+	 * @brief Get popularity in accesses per hour.
+	 *
+	 * @param row
+	 * @return double
+	 */
+	double popularity(row_type row) const {
+		return popularity_[row];
+	}
+	/**
+	 * @brief Get number of accesses counted since last tiering.
+	 *
+	 * @param row
+	 * @return uint64_t
+	 */
+	uint64_t access_count(row_type row) const {
+		return access_count_[row];
+	}
+	/**
+	 * @brief Check if row is pinned.
+	 *
+	 * @param row
+	 * @return true Pinned
+	 * @return false Not pinned
+	 */
+	bool pinned(row_type row) const {
+		return flags_[row] & PINNED;
+	}
+	/**
+	 * @brief Check if row's tier, path or record changed since it was last written.
+	 *
+	 * @param row
+	 * @return true Changed
+	 * @return false Unchanged
+	 */
+	bool dirty(row_type row) const {
+		return flags_[row] & DIRTY;
+	}
+	/**
+	 * @brief Get popularity last written to the database and popularity index.
+	 *
+	 * @param row
+	 * @return double
+	 */
+	double written_popularity(row_type row) const {
+		return written_popularity_[row];
+	}
+	/**
+	 * @brief Check if row has to be written back to the database: it is new, moved,
+	 * renamed or was accessed, or its popularity drifted more than
+	 * POPULARITY_WRITE_TOLERANCE from the value last written.
+	 *
+	 * @param row
+	 * @return true Needs writing
+	 * @return false Database is up to date
+	 */
+	bool needs_write(row_type row) const;
+	/**
+	 * @brief Mark row as written back to the database with its current popularity.
+	 *
+	 * @param row
+	 */
+	void written(row_type row) {
+		flags_[row] &= ~DIRTY;
+		written_popularity_[row] = popularity_[row];
+	}
+	/**
+	 * @brief Build Metadata of row for writing back to the database.
+	 *
+	 * @param row
+	 * @param tier_path Backend path of tier holding row
+	 * @return Metadata
+	 */
+	Metadata metadata(row_type row, const std::string &tier_path) const;
+	/**
+	 * @brief Build File object for row, used for the few files being moved.
+	 *
+	 * @param row
+	 * @param tptr Tier holding row
+	 * @return File
+	 */
+	File file(row_type row, Tier *tptr) const;
+private:
+	/**
+	 * @brief Find or add interned directory. Consecutive lookups of the same directory,
+	 * as while crawling, skip the hash lookup.
+	 *
+	 * @param relative_dir Directory relative to tier root
+	 * @return uint32_t Directory id
+	 */
+	uint32_t intern_dir(const std::string &relative_dir);
+	/**
+	 * @brief Append name to names_.
+	 *
+	 * @param name
+	 * @param len
+	 * @return uint64_t Offset of name in names_
+	 */
+	uint64_t intern_name(const char *name, size_t len);
+	/**
+	 * @brief Copy row from into row to in every column.
+	 *
+	 * @param from
+	 * @param to
+	 */
+	void move_row(row_type from, row_type to);
+	/**
+	 * @brief Resize every column.
+	 *
+	 * @param rows
+	 */
+	void resize(size_t rows);
+	/**
+	 * @brief Rebuild names_ without names of erased rows once they outweigh live names.
+	 *
+	 */
+	void compact_names(void);
+	/**
+	 * @brief Rebuild dir_ids_ from dirs_.
+	 *
+	 */
+	void index_dirs(void);
+	std::vector<std::string> dirs_;                     ///< Interned directories
+	std::unordered_map<std::string, uint32_t> dir_ids_; ///< Directory to index in dirs_
+	uint32_t last_dir_;                                 ///< Last result of intern_dir()
+	std::vector<char> names_;                           ///< NUL-terminated file names
+	uint64_t dead_name_bytes_;                          ///< Bytes of names_ of erased rows
+	std::vector<uint32_t> dir_;                         ///< Column: directory id
+	std::vector<uint64_t> name_;                        ///< Column: offset of name in names_
+	std::vector<uint8_t> tier_;                         ///< Column: index of tier
+	std::vector<uint8_t> flags_;                        ///< Column: Flag bits
+	std::vector<uint64_t> size_;                        ///< Column: size in bytes
+	std::vector<uint64_t> alloc_size_;                  ///< Column: allocated bytes
+	std::vector<int64_t> atime_;                        ///< Column: atime in microseconds
+	std::vector<int64_t> mtime_;                        ///< Column: mtime in microseconds
+	std::vector<int64_t> ctime_;                        ///< Column: ctime in seconds
+	std::vector<double> popularity_;                    ///< Column: accesses per hour
+	std::vector<double> written_popularity_;            ///< Column: popularity in database
+	std::vector<uint64_t> access_count_;                ///< Column: accesses since last tiering
+	/**
+	 * @brief Serialize method for boost::serialize, used to keep the table between mounts.
+	 *
+	 * @tparam Archive Template type
+	 * @param ar Internal boost::serialize object
+	 * @param version boost::serialize version (unused)
+	 */
+	template<class Archive>
+	void serialize(Archive &ar, const unsigned int version) {
+		(void)version;
+		ar &dirs_;
+		ar &names_;
+		ar &dead_name_bytes_;
+		ar &dir_;
+		ar &name_;
+		ar &tier_;
+		ar &flags_;
+		ar &size_;
+		ar &alloc_size_;
+		ar &atime_;
+		ar &mtime_;
+		ar &ctime_;
+		ar &popularity_;
+		ar &written_popularity_;
+		ar &access_count_;
+		if (Archive::is_loading::value)
+			index_dirs();
+	}
+};
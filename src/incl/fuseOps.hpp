@@ -19,23 +19,37 @@
 
 #pragma once
 
-#define FUSE_USE_VERSION 30
+#ifndef FUSE_USE_VERSION
+/* 32 for fuse_loop_config, the makefile sets 312 when libfuse is 3.12 or newer to also limit
+ * the number of FUSE threads.
+ */
+#	define FUSE_USE_VERSION 32
+#endif
 
 #include <boost/filesystem.hpp>
+#include <list>
 #include <mutex>
 #include <rocksdb/db.h>
 #include <thread>
+#include <unordered_map>
 namespace fs = boost::filesystem;
 
 extern "C" {
 #include <fuse.h>
+#include <fuse_lowlevel.h>
 }
 
+class AccessCache;
+class ChangeJournal;
+class InodeTable;
+class PathCache;
 class Tier;
 class TierEngine;
 
+#define MTIME_AT_RELEASE_ENTRIES 65536 ///< Paths remembered by FusePriv::insert_mtime_at_release()
+
 /**
- * @brief Fuse Private data class grabbed from fuse_get_context()->private_data (void*)
+ * @brief Fuse Private data class grabbed from l::get_context()->private_data (void*)
  * in fuse filesystem functions
  *
  */
@@ -45,6 +59,10 @@ public:
 	fs::path mount_point_;      ///< Path to autotierfs mount point
 	TierEngine *autotier_;      ///< Pointer to TierEngine
 	std::shared_ptr<rocksdb::DB> db_;           ///< RocksDB database holding file metadata
+	ChangeJournal *journal_;    ///< Journal of changed paths for incremental tiering
+	AccessCache *access_cache_; ///< Access counts written back to db_ in the background
+	PathCache *path_cache_;     ///< Tier holding each recently used path
+	InodeTable *inodes_ = nullptr; ///< Node ids given to the kernel, low-level API only
 	std::vector<Tier *> tiers_; ///< List of pointers to tiers from TierEngine
 	std::thread tier_worker_;   ///< Thread running TierEngineTiering::begin()
 	std::thread adhoc_server_;  ///< Thread running TierEngineAdhoc::process_adhoc_requests()
@@ -129,6 +147,45 @@ public:
 	uintmax_t size_at_open(int fd) const {
 		return size_at_open_.at(fd);
 	}
+	/**
+	 * @brief Remember mtime of path when released, as the kernel last saw it
+	 *
+	 * @param path Path relative to the filesystem root
+	 * @param mtime Modification time at release
+	 */
+	void insert_mtime_at_release(const std::string &path, const struct timespec &mtime) {
+		std::lock_guard<std::mutex> lk(mtime_at_release_mt_);
+		auto itr = mtime_at_release_index_.find(path);
+		if (itr != mtime_at_release_index_.end()) {
+			itr->second->second = mtime;
+			mtime_at_release_.splice(mtime_at_release_.begin(), mtime_at_release_, itr->second);
+			return;
+		}
+		if (mtime_at_release_.size() >= MTIME_AT_RELEASE_ENTRIES) {
+			mtime_at_release_index_.erase(mtime_at_release_.back().first);
+			mtime_at_release_.pop_back();
+		}
+		mtime_at_release_.emplace_front(path, mtime);
+		mtime_at_release_index_.emplace(path, mtime_at_release_.begin());
+	}
+	/**
+	 * @brief Test whether path is unchanged since it was last released, so pages the
+	 * kernel cached from it are still valid
+	 *
+	 * @param path Path relative to the filesystem root
+	 * @param mtime Current modification time
+	 * @return true mtime matches mtime at last release
+	 * @return false Changed, or not released since it was last forgotten
+	 */
+	bool mtime_unchanged(const std::string &path, const struct timespec &mtime) {
+		std::lock_guard<std::mutex> lk(mtime_at_release_mt_);
+		auto itr = mtime_at_release_index_.find(path);
+		if (itr == mtime_at_release_index_.end())
+			return false;
+		mtime_at_release_.splice(mtime_at_release_.begin(), mtime_at_release_, itr->second);
+		return itr->second->second.tv_sec == mtime.tv_sec
+			   && itr->second->second.tv_nsec == mtime.tv_nsec;
+	}
 private:
 	/**
 	 * @brief Mutex to synchronize insertion and deletion from fd_to_path_ map
@@ -150,6 +207,23 @@ private:
 	 *
 	 */
 	std::unordered_map<int, uintmax_t> size_at_open_;
+	/**
+	 * @brief Mutex to synchronize insertion and lookup in mtime_at_release_ list
+	 *
+	 */
+	std::mutex mtime_at_release_mt_;
+	/**
+	 * @brief Paths with mtime at last release, most recently used first, the last one
+	 * dropped when full
+	 *
+	 */
+	std::list<std::pair<std::string, struct timespec>> mtime_at_release_;
+	/**
+	 * @brief Map relating path to its place in mtime_at_release_
+	 *
+	 */
+	std::unordered_map<std::string, std::list<std::pair<std::string, struct timespec>>::iterator>
+		mtime_at_release_index_;
 };
 
 // definitions in helpers.cpp:
@@ -158,6 +232,20 @@ private:
  *
  */
 namespace l {
+	/**
+	 * @brief Get context of the request being handled. From fuse_get_context() with the
+	 * high-level API, else as set by set_context() for the low-level front end.
+	 *
+	 * @return fuse_context* Context, with private_data pointing to FusePriv
+	 */
+	fuse_context *get_context(void);
+	/**
+	 * @brief Set context returned by get_context() on this thread, for path based
+	 * operations called by the low-level front end.
+	 *
+	 * @param ctx Context of the request, nullptr once it is handled
+	 */
+	void set_context(fuse_context *ctx);
 	/**
 	 * @brief Test if path is a directory
 	 *
@@ -165,6 +253,15 @@ namespace l {
 	 * @return int 0 (false) if not a directory, 1 (true) if a directory, -1 if error
 	 */
 	int is_directory(const fs::path &relative_path);
+	/**
+	 * @brief Find which tier holds path, from the path cache if possible, else with
+	 * is_directory() and a database lookup whose result, found or not, is then cached.
+	 *
+	 * @param path Path relative to mount point
+	 * @param tier_path Set to backend path of tier holding path, highest tier for directories
+	 * @return int 0 if a file, 1 if a directory, -1 if error with errno set
+	 */
+	int find_path(const char *path, fs::path &tier_path);
 	/**
 	 * @brief Find tier containing full path
 	 *
@@ -187,17 +284,16 @@ namespace l {
 	 */
 	intmax_t file_size(const fs::path &path);
 	/**
-	 * @brief Iterate through RocksDB database, updating all
-	 * paths after old_directory to new_directory for when a directory
-	 * is moved
+	 * @brief Decide whether the kernel keeps cached pages of a file being opened or
+	 * bypasses the page cache, from its popularity, tier and whether it changed since it
+	 * was last released. Thresholds come from the config file.
 	 *
-	 * @param old_directory Old path name
-	 * @param new_directory New path name
-	 * @param db RocksDB database to modify
+	 * @param path Path relative to the filesystem root
+	 * @param fd Opened backend file
+	 * @param tptr Tier holding the file
+	 * @param fi File info to set keep_cache or direct_io of
 	 */
-	void update_keys_in_directory(std::string old_directory,
-								  std::string new_directory,
-								  std::shared_ptr<::rocksdb::DB> db);
+	void set_cache_policy(const char *path, int fd, const Tier *tptr, struct fuse_file_info *fi);
 } // namespace l
 
 /**
@@ -309,3 +405,13 @@ namespace fuse_ops {
 
 	off_t lseek(const char *path, off_t off, int whence, struct fuse_file_info *fi);
 } // namespace fuse_ops
+
+/**
+ * @brief Low-level FUSE front end. Lookups, attributes, opens and directory listings are
+ * served relative to the parent's descriptor from FusePriv::inodes_, everything else builds
+ * the path of the node and calls the matching fuse_ops function.
+ *
+ */
+namespace fuse_ll_ops {
+	extern const struct fuse_lowlevel_ops operations; ///< Passed to fuse_session_new()
+} // namespace fuse_ll_ops
@@ -57,11 +57,12 @@ public:
 	~FusePassthrough(void) = default;
 	/**
 	 * @brief Mount the fuse filesystem.
-	 * Creates struct of FUSE function pointers and calls fuse_main().
+	 * Creates struct of FUSE function pointers and runs a high-level or low-level FUSE
+	 * session, per the FUSE API config option, with worker threads set up from the config.
 	 *
 	 * @param mountpoint Path to mountpoint
-	 * @param fuse_opts Comma separated options to pass to fuse_main()
-	 * @return int Return value of fuse_main()
+	 * @param fuse_opts Comma separated options to pass to libfuse
+	 * @return int 0 if the session ended cleanly, else 1
 	 */
 	int mount_fs(fs::path mountpoint, char *fuse_opts);
 };
@@ -0,0 +1,224 @@
+/*
+ *    Copyright (C) 2019-2021 Joshua Boudreau <jboudreau@45drives.com>
+ *
+ *    This file is part of autotier.
+ *
+ *    autotier is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    autotier is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with autotier.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#define ROOT_INODE              1 ///< Node id of the filesystem root, same as FUSE_ROOT_ID
+#define INODE_TABLE_DIR_FD_SHARE 4 ///< Directory descriptors kept open, RLIMIT_NOFILE / this
+
+class Tier;
+
+/**
+ * @brief Node ids handed to the kernel by the low-level FUSE front end, each mapped to its
+ * parent and name, the tier holding it, and for directories an O_PATH descriptor in each
+ * tier. Operations on a node then work relative to its parent's descriptor instead of
+ * rebuilding and walking the full backend path. Ids are never reused, so no generation
+ * number is needed. Nodes stay until the kernel forgets every lookup of them, but only the
+ * most recently used directory descriptors stay open, others are reopened from their
+ * parent's when needed again.
+ *
+ */
+class InodeTable {
+public:
+	/**
+	 * @brief O_PATH descriptor of a directory in a tier, opened relative to its parent's
+	 * descriptor if it is not open. It is not closed to make room for others while this
+	 * object lives.
+	 *
+	 */
+	class DirFd {
+	public:
+		/**
+		 * @brief Get descriptor of directory ino in tier.
+		 *
+		 * @param table Table holding ino
+		 * @param ino Node id of directory
+		 * @param tier Tier number
+		 */
+		DirFd(InodeTable &table, uint64_t ino, size_t tier);
+		/**
+		 * @brief Let the table close the descriptor again.
+		 *
+		 */
+		~DirFd(void);
+		DirFd(const DirFd &) = delete;
+		DirFd &operator=(const DirFd &) = delete;
+		/**
+		 * @brief Get the descriptor.
+		 *
+		 * @return int Descriptor, -1 with errno set if the directory is not in tier
+		 */
+		int fd(void) const {
+			return fd_;
+		}
+	private:
+		InodeTable &table_; ///< Table holding ino_
+		uint64_t ino_;      ///< Node id of directory
+		int fd_;            ///< Descriptor or -1
+	};
+	/**
+	 * @brief Construct a new Inode Table object holding the root, with a descriptor of
+	 * each tier's root. Other directory descriptors are limited to a share of
+	 * RLIMIT_NOFILE.
+	 *
+	 * @param tiers Tiers in order, indexes into this are the tier numbers used below
+	 */
+	InodeTable(const std::vector<Tier *> &tiers);
+	/**
+	 * @brief Destroy the Inode Table object, closing every descriptor.
+	 *
+	 */
+	~InodeTable(void);
+	/**
+	 * @brief Find node of name in parent without counting a lookup.
+	 *
+	 * @param parent Node id of parent directory
+	 * @param name Name in parent
+	 * @param tier Set to tier holding the file, -1 for directories
+	 * @return uint64_t Node id, 0 if not known
+	 */
+	uint64_t find(uint64_t parent, const std::string &name, int &tier);
+	/**
+	 * @brief Count a lookup of name in parent, adding a node if it is new.
+	 *
+	 * @param parent Node id of parent directory
+	 * @param name Name in parent
+	 * @param tier Tier holding the file, -1 for directories
+	 * @return uint64_t Node id
+	 */
+	uint64_t add(uint64_t parent, const std::string &name, int tier);
+	/**
+	 * @brief Drop nlookup lookups of ino, removing it once none are left.
+	 *
+	 * @param ino Node id
+	 * @param nlookup Lookups the kernel forgot
+	 */
+	void forget(uint64_t ino, uint64_t nlookup);
+	/**
+	 * @brief Get parent, name and tier of ino.
+	 *
+	 * @param ino Node id
+	 * @param parent Node id of parent directory, 0 for the root
+	 * @param name Name in parent
+	 * @param tier Tier holding the file, -1 for directories
+	 * @return true Found
+	 * @return false Not a known node
+	 */
+	bool entry(uint64_t ino, uint64_t &parent, std::string &name, int &tier);
+	/**
+	 * @brief Build path of ino relative to the filesystem root, with a leading slash as
+	 * given to path based operations.
+	 *
+	 * @param ino Node id
+	 * @param path Set to path
+	 * @return true Built
+	 * @return false A node on the way to the root is not known
+	 */
+	bool path(uint64_t ino, std::string &path);
+	/**
+	 * @brief Find the node of a path and of its parent directory, without counting a
+	 * lookup.
+	 *
+	 * @param path Path relative to the filesystem root
+	 * @param parent Set to node id of parent directory, 0 if not known
+	 * @return uint64_t Node id, 0 if not known
+	 */
+	uint64_t resolve(const std::string &path, uint64_t &parent);
+	/**
+	 * @brief Record the tier a file was found in after it moved.
+	 *
+	 * @param ino Node id
+	 * @param tier Tier holding the file
+	 */
+	void set_tier(uint64_t ino, int tier);
+	/**
+	 * @brief Move the node of name in parent to new_name in new_parent, replacing any
+	 * node already there.
+	 *
+	 * @param parent Old parent node id
+	 * @param name Old name
+	 * @param new_parent New parent node id
+	 * @param new_name New name
+	 */
+	void rename(uint64_t parent,
+				const std::string &name,
+				uint64_t new_parent,
+				const std::string &new_name);
+	/**
+	 * @brief Unlink the node of name in parent, so later lookups of the name get a new
+	 * node. The node itself stays until forgotten.
+	 *
+	 * @param parent Node id of parent directory
+	 * @param name Name in parent
+	 */
+	void remove(uint64_t parent, const std::string &name);
+private:
+	typedef std::list<std::pair<uint64_t, size_t>> List; ///< Node ids and tiers of open fds
+	/**
+	 * @brief Everything known about a node id.
+	 *
+	 */
+	struct Node {
+		uint64_t parent_;                  ///< Node id of parent directory, 0 for the root
+		std::string name_;                 ///< Name in parent, empty once unlinked
+		int tier_;                         ///< Tier holding the file, -1 for directories
+		std::vector<int> fds_;             ///< O_PATH descriptor in each tier, -1 if not open
+		std::vector<List::iterator> used_; ///< Place of each open descriptor in lru_
+		unsigned int pins_;                ///< DirFd objects using a descriptor
+		uint64_t nlookup_;                 ///< Lookups the kernel has not forgotten
+	};
+	/**
+	 * @brief Get descriptor of directory ino in tier with mt_ held, opening it relative to
+	 * its parent's descriptor if it is not open.
+	 *
+	 * @param ino Node id of directory
+	 * @param tier Tier number
+	 * @return int Descriptor, -1 with errno set if the directory is not in tier
+	 */
+	int open_dir(uint64_t ino, size_t tier);
+	/**
+	 * @brief Close least recently used descriptors of unpinned nodes until no more than
+	 * max_fds_ are open.
+	 *
+	 * @param keep Descriptor just opened, not closed
+	 */
+	void close_unused(List::iterator keep);
+	/**
+	 * @brief Build key of children_.
+	 *
+	 * @param parent Node id of parent directory
+	 * @param name Name in parent
+	 * @return std::string
+	 */
+	static std::string child_key(uint64_t parent, const std::string &name);
+	std::mutex mt_;                                      ///< Lock for everything below
+	std::vector<std::string> tier_paths_;                ///< Root of each tier
+	std::unordered_map<uint64_t, Node> nodes_;           ///< Node of each id
+	std::unordered_map<std::string, uint64_t> children_; ///< Node id of each parent and name
+	List lru_;                                           ///< Open descriptors, most recent first
+	size_t max_fds_;                                     ///< Open descriptors kept in lru_
+	uint64_t next_ino_;                                  ///< Id of the next new node
+};
@@ -0,0 +1,154 @@
+/*
+ *    Copyright (C) 2019-2021 Joshua Boudreau <jboudreau@45drives.com>
+ *
+ *    This file is part of autotier.
+ *
+ *    autotier is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    autotier is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with autotier.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <boost/filesystem.hpp>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+namespace fs = boost::filesystem;
+
+#define JOURNAL_BUFFER_SIZE (64 * 1024) ///< Bytes of records held in memory before write()
+#define JOURNAL_SHARDS      16          ///< Record buffers, picked by calling thread
+
+/**
+ * @brief Append-only log of paths changed through the filesystem between tiering
+ * cycles. Lets incremental tiering re-read only the files that changed instead of
+ * crawling every tier. Records are an op character, a sequence number and
+ * NUL-terminated relative paths. Each thread appends to one of several buffers so
+ * filesystem calls on different threads rarely share a lock, and drain() puts records
+ * back in sequence order. Does nothing until open() succeeds.
+ *
+ */
+class ChangeJournal {
+public:
+	/**
+	 * @brief Type of change recorded.
+	 *
+	 */
+	enum Op : char {
+		MODIFIED = 'M', ///< File created, opened, resized, pinned, or unpinned
+		REMOVED = 'D',  ///< File removed or renamed away
+		RENAMED = 'R'   ///< Directory renamed, new_path_ holds destination
+	};
+	/**
+	 * @brief Single journal record.
+	 *
+	 */
+	struct Entry {
+		Op op_;                ///< Type of change
+		std::string path_;     ///< Path relative to the tier root
+		std::string new_path_; ///< Destination path for RENAMED, else empty
+	};
+	/**
+	 * @brief Construct a new closed Change Journal object
+	 *
+	 */
+	ChangeJournal(void);
+	/**
+	 * @brief Destroy the Change Journal object, flushing and closing the file.
+	 *
+	 */
+	~ChangeJournal(void);
+	/**
+	 * @brief Open or create journal at path. Existing records are kept so changes
+	 * made before a restart are picked up by the next cycle.
+	 *
+	 * @param path Path to journal file
+	 * @return true Opened
+	 * @return false Failed to open, journal stays disabled
+	 */
+	bool open(const fs::path &path);
+	/**
+	 * @brief Check if journal is recording.
+	 *
+	 * @return true Open
+	 * @return false Disabled
+	 */
+	bool is_open(void) const;
+	/**
+	 * @brief Append a record. Leading slashes are stripped from paths.
+	 *
+	 * @param op Type of change
+	 * @param path Path of changed file or directory
+	 * @param new_path Destination of renamed directory
+	 */
+	void record(Op op, const char *path, const char *new_path = nullptr);
+	/**
+	 * @brief Write out buffered records.
+	 *
+	 */
+	void flush(void);
+	/**
+	 * @brief Move every record into entries and empty the journal. The journal file is
+	 * swapped out under the lock so filesystem calls are only blocked for a rename.
+	 *
+	 * @param entries Filled with records in the order they were made
+	 * @return true All records since the last clear() were returned
+	 * @return false Records were lost, caller must fall back to a full crawl
+	 */
+	bool drain(std::vector<Entry> &entries);
+	/**
+	 * @brief Discard every record, called right before a full crawl.
+	 *
+	 */
+	void clear(void);
+private:
+	/**
+	 * @brief Buffer of records made by some of the threads.
+	 *
+	 */
+	struct Shard {
+		std::mutex mt_;      ///< Lock for buffer_, taken before fd_mt_
+		std::string buffer_; ///< Records not yet written
+	};
+	/**
+	 * @brief Get shard of calling thread.
+	 *
+	 * @return Shard&
+	 */
+	Shard &shard(void);
+	/**
+	 * @brief write() buffer to fd_ and empty it, must hold fd_mt_.
+	 *
+	 * @param buffer Records to write
+	 */
+	void write_locked(std::string &buffer);
+	/**
+	 * @brief Parse records.
+	 *
+	 * @param data Contents of journal file
+	 * @param entries Filled with sequence numbers and records in file order
+	 * @return true Every record was whole
+	 * @return false Data ends in a truncated record
+	 */
+	static bool parse(const std::string &data,
+					  std::vector<std::pair<uint64_t, Entry>> &entries);
+	std::array<Shard, JOURNAL_SHARDS> shards_; ///< Records not yet written, by thread
+	std::atomic<uint64_t> sequence_;           ///< Next sequence number
+	std::mutex fd_mt_;                         ///< Lock for changing fd_, and for lost_
+	fs::path path_;                            ///< Path to journal file
+	std::atomic<int> fd_;                      ///< File descriptor of journal, -1 if disabled
+	bool lost_;                                ///< Set if a write failed since the last clear()
+};
@@ -0,0 +1,57 @@
+/*
+ *    Copyright (C) 2019-2021 Joshua Boudreau <jboudreau@45drives.com>
+ *
+ *    This file is part of autotier.
+ *
+ *    autotier is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    autotier is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with autotier.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+struct fuse;
+struct fuse_session;
+class InodeTable;
+
+/**
+ * @brief Dropping what the kernel caches about paths that autotier changes in the tiers
+ * itself, such as files moved between tiers, so caching can be left on when the tiers
+ * are only changed through autotier. Does nothing until a session is set.
+ *
+ */
+namespace KernelCache {
+	/**
+	 * @brief Send invalidations through a high-level FUSE session.
+	 *
+	 * @param fuse Session from fuse_new()
+	 */
+	void set_fuse(struct fuse *fuse);
+	/**
+	 * @brief Send invalidations through a low-level FUSE session.
+	 *
+	 * @param se Session from fuse_session_new()
+	 * @param inodes Node ids given to the kernel
+	 */
+	void set_session(struct fuse_session *se, InodeTable *inodes);
+	/**
+	 * @brief Stop sending invalidations, waiting for any in progress to finish.
+	 *
+	 */
+	void clear(void);
+	/**
+	 * @brief Make the kernel forget the attributes and directory entry of path.
+	 *
+	 * @param path Path relative to the filesystem root
+	 */
+	void invalidate(const char *path);
+} // namespace KernelCache
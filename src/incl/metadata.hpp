@@ -24,6 +24,21 @@
 #include <boost/archive/text_iarchive.hpp>
 #include <boost/archive/text_oarchive.hpp>
 #include <rocksdb/db.h>
+#include <functional>
+#include <rocksdb/merge_operator.h>
+#include <rocksdb/write_batch.h>
+#include <vector>
+
+#define METADATA_FORMAT_VERSION  2            ///< First byte of binary records, never a digit
+#define METADATA_BINARY_SIZE     4            ///< Bytes in a binary placement record
+#define METADATA_V1_SIZE         20           ///< Bytes in a version 1 record, with statistics
+#define METADATA_STATS_SIZE      16           ///< Bytes in a statistics record
+#define STATS_COLUMN_FAMILY      "stats"      ///< Column family of access statistics
+#define POPULARITY_COLUMN_FAMILY "popularity" ///< Column family indexing files by popularity
+#define PINS_COLUMN_FAMILY       "pins"       ///< Column family indexing pinned files
+#define TIERS_COLUMN_FAMILY      "tiers"      ///< Column family indexing files by tier
+#define NO_TIER_ID               UINT16_MAX   ///< tier_id_ of records without a binary tier id
+#define DIR_KEY_PREFIX           '/'          ///< First byte of directory keys, not of paths
 
 class Tier;
 
@@ -35,7 +50,10 @@ class Tier;
 class Metadata {
 	friend class boost::serialization::access;
 	friend class File;
+	friend class FileTable;
 	friend class MetadataViewer;
+	friend class MetadataMergeOperator;
+	friend class PopularityIndexWriter;
 public:
 	/**
 	 * @brief Construct a new empty Metadata object
@@ -48,6 +66,12 @@ public:
 	 * @param serialized Serialized string representing Metadata object
 	 */
 	Metadata(const std::string &serialized);
+	/**
+	 * @brief Construct a new Metadata object from a database value, binary or text.
+	 *
+	 * @param serialized Serialized record
+	 */
+	Metadata(const rocksdb::Slice &serialized);
 	/**
 	 * @brief Copy construct a new Metadata object
 	 *
@@ -79,32 +103,277 @@ public:
 	 *
 	 */
 	~Metadata(void) = default;
+	/**
+	 * @brief Serialize placement for storing in the database. Uses the fixed binary layout
+	 * when the tier has an id, else a boost text archive as written by older versions.
+	 *
+	 * @return std::string
+	 */
+	std::string serialized(void);
+	/**
+	 * @brief Serialize access count and popularity for the statistics column family.
+	 *
+	 * @return std::string
+	 */
+	std::string serialized_stats(void) const;
+	/**
+	 * @brief Load the tier id table from db, giving ids to any of tier_paths without one.
+	 * Must be called after opening the database and before reading binary records.
+	 * Ids are never reused, so records of removed tiers keep their path.
+	 *
+	 * @param db Pointer to RocksDB database
+	 * @param tier_paths Paths of configured tiers, may be empty to only read the table
+	 */
+	static void load_tier_ids(std::shared_ptr<rocksdb::DB> &db,
+							  const std::vector<std::string> &tier_paths);
+	/**
+	 * @brief Check if key is reserved for autotier's own records instead of a file.
+	 * Reserved keys start with a NUL, which can't appear in a path.
+	 *
+	 * @param key Database key
+	 * @return true Reserved
+	 * @return false File record
+	 */
+	static bool reserved_key(const rocksdb::Slice &key) {
+		return !key.empty() && key[0] == '\0';
+	}
+	/**
+	 * @brief Build descriptors of every column family for opening the database.
+	 * Placement records (tier and pin) stay in the default column family, which has a
+	 * bloom filter and block cache for the point lookups of every FUSE call. Access counts
+	 * and popularity go in their own column family tuned for merges, so their churn never
+	 * compacts placement data. The popularity and pins column families are indexes for
+	 * list-popularity and list-pins, holding keys only. The tiers column family indexes
+	 * files under the id of their tier, holding their size.
+	 *
+	 * @param options Options the database is opened with
+	 * @return std::vector<rocksdb::ColumnFamilyDescriptor>
+	 */
+	static std::vector<rocksdb::ColumnFamilyDescriptor> column_families(
+		const rocksdb::Options &options);
+	/**
+	 * @brief Keep handles opened from column_families(), in the same order.
+	 *
+	 * @param handles
+	 */
+	static void open_column_families(const std::vector<rocksdb::ColumnFamilyHandle *> &handles);
+	/**
+	 * @brief Destroy handles kept by open_column_families(), before closing db.
+	 *
+	 * @param db
+	 */
+	static void close_column_families(rocksdb::DB *db);
+	/**
+	 * @brief Read access count and popularity of a database key from the statistics
+	 * column family. Files with no statistics yet keep the defaults.
+	 *
+	 * @param key Database key, as returned by an iterator
+	 * @param db Pointer to RocksDB database
+	 */
+	void load_stats(const rocksdb::Slice &key, std::shared_ptr<rocksdb::DB> &db);
+	/**
+	 * @brief Get path of the file a database key belongs to, looking up its directories
+	 * if stored with directory keys.
+	 *
+	 * @param key Database key
+	 * @param db Pointer to RocksDB database
+	 * @param path Path relative to the tier root
+	 * @return true key is a file record
+	 * @return false key is reserved, part of the directory table, or in a removed directory
+	 */
+	static bool file_path(const rocksdb::Slice &key,
+						  std::shared_ptr<rocksdb::DB> &db,
+						  std::string &path);
 #ifndef BAREBONES_METADATA
 	/**
 	 * @brief Construct a new Metadata object.
 	 * Try to retrieve data from db. If not found and tptr != nullptr,
 	 * new metadata object is initialized and put into the database.
 	 * If not found and tptr == nullptr, metadata is left undefined and
-	 * not_found_ is set to true.
+	 * not_found_ is set to true. Records with no tier path, left by merges
+	 * into removed files, count as not found.
 	 *
 	 * @param path
 	 * @param db
 	 * @param tptr
+	 * @param stats Also read access count and popularity, only needed for tiering
 	 */
-	Metadata(std::string path, std::shared_ptr<rocksdb::DB> &db, Tier *tptr = nullptr);
+	Metadata(std::string path,
+			 std::shared_ptr<rocksdb::DB> &db,
+			 Tier *tptr = nullptr,
+			 bool stats = false);
 	/**
-	 * @brief Put metadata into database with relative_path as the key.
+	 * @brief Put metadata into database with relative_path as the key. Statistics are
+	 * only changed by merges, so they are left alone unless moved from old_key.
 	 *
 	 * @param relative_path Database key
 	 * @param db Pointer to RocksDB database
 	 * @param old_key string pointer to old key to remove if not nullptr
+	 * @param size Size for the tier index, ignored if old_key has an entry to move
+	 */
+	void update(std::string relative_path,
+				std::shared_ptr<rocksdb::DB> &db,
+				std::string *old_key = nullptr,
+				uint64_t size = 0);
+	/**
+	 * @brief Read popularity of a file from the statistics column family alone, without
+	 * its placement record.
+	 *
+	 * @param relative_path Path of file
+	 * @param db Pointer to RocksDB database
+	 * @return double Popularity, the starting popularity if the file has no statistics
 	 */
-	void update(std::string relative_path, std::shared_ptr<rocksdb::DB> &db, std::string *old_key = nullptr);
+	static double read_popularity(std::string relative_path, std::shared_ptr<rocksdb::DB> &db);
+	/**
+	 * @brief Move access count and popularity out of records written before they had
+	 * their own column family. Each batch is atomic and moved records are skipped, so an
+	 * interrupted split carries on at the next mount.
+	 *
+	 * @param db Pointer to RocksDB database
+	 */
+	static void split_stats(std::shared_ptr<rocksdb::DB> &db);
+	/**
+	 * @brief Choose how records are keyed and convert any records stored the other way.
+	 * Path keys are the relative path of the file. Directory keys are the id of the parent
+	 * directory and the file name, with a directory table mapping ids to names, so renaming
+	 * a directory rewrites one entry instead of every record under it. Each batch of the
+	 * conversion is atomic, so an interrupted conversion carries on at the next mount.
+	 *
+	 * @param db Pointer to RocksDB database
+	 * @param enable true for directory keys, false for path keys
+	 */
+	static void use_directory_keys(std::shared_ptr<rocksdb::DB> &db, bool enable);
+	/**
+	 * @brief Fill the index of pinned files from records written before it existed.
+	 * Does nothing once the index has been filled.
+	 *
+	 * @param db Pointer to RocksDB database
+	 */
+	static void index_pins(std::shared_ptr<rocksdb::DB> &db);
+	/**
+	 * @brief Call visit with the path and metadata of every pinned file, reading only
+	 * the records of pinned files.
+	 *
+	 * @param db Pointer to RocksDB database
+	 * @param visit Called once per pinned file
+	 */
+	static void scan_pins(std::shared_ptr<rocksdb::DB> &db,
+						  const std::function<void(const std::string &, const Metadata &)> &visit);
+	/**
+	 * @brief Call visit with the path and popularity of files in the popularity index,
+	 * which holds popularity as of the last tiering cycle. Files removed or renamed
+	 * since then are skipped.
+	 *
+	 * @param db Pointer to RocksDB database
+	 * @param ascending Least popular first instead of most popular first
+	 * @param min Lowest popularity to visit
+	 * @param max Highest popularity to visit
+	 * @param limit Most files to visit, 0 for no limit
+	 * @param visit Called once per file
+	 */
+	static void scan_popularity(std::shared_ptr<rocksdb::DB> &db,
+								bool ascending,
+								double min,
+								double max,
+								size_t limit,
+								const std::function<void(const std::string &, double)> &visit);
+	/**
+	 * @brief Call visit with the path, metadata and indexed size of every file in the tier
+	 * at tier_path, reading only the index entries of that tier. Metadata includes
+	 * access count and popularity. Files moved or removed since indexed are skipped.
+	 *
+	 * @param db Pointer to RocksDB database
+	 * @param tier_path Path to tier root
+	 * @param visit Called once per file
+	 */
+	static void scan_tier(
+		std::shared_ptr<rocksdb::DB> &db,
+		const std::string &tier_path,
+		const std::function<void(const std::string &, const Metadata &, uint64_t)> &visit);
+	/**
+	 * @brief Delete record of relative_path.
+	 *
+	 * @param relative_path Path of file
+	 * @param db Pointer to RocksDB database
+	 * @return true Deleted or there was no record
+	 * @return false Write failed
+	 */
+	static bool remove(std::string relative_path, std::shared_ptr<rocksdb::DB> &db);
+	/**
+	 * @brief Move records of every file under old_directory to new_directory. With path
+	 * keys every record is rewritten in one batch, with directory keys only the entry of
+	 * the directory itself.
+	 *
+	 * @param old_directory Old path of directory
+	 * @param new_directory New path of directory
+	 * @param db Pointer to RocksDB database
+	 */
+	static void rename_directory(std::string old_directory,
+								 std::string new_directory,
+								 std::shared_ptr<rocksdb::DB> &db);
+	/**
+	 * @brief Drop directory from the directory table once removed. Nothing to do with
+	 * path keys.
+	 *
+	 * @param directory Path of removed directory
+	 * @param db Pointer to RocksDB database
+	 */
+	static void remove_directory(std::string directory, std::shared_ptr<rocksdb::DB> &db);
 	/**
 	 * @brief Increment access_count_.
 	 *
+	 * @param count Number of accesses to add
+	 */
+	void touch(uintmax_t count = 1);
+	/**
+	 * @brief Add to access count of relative_path in the database without reading it.
+	 *
+	 * @param relative_path Database key
+	 * @param db Pointer to RocksDB database
+	 * @param count Number of accesses to add
+	 */
+	static void add_accesses(std::string relative_path,
+							 std::shared_ptr<rocksdb::DB> &db,
+							 uintmax_t count);
+	/**
+	 * @brief Set tier path of relative_path in the database without reading it, and index
+	 * the file under its tier.
+	 *
+	 * @param relative_path Database key
+	 * @param db Pointer to RocksDB database
+	 * @param tier_path Path to tier root
+	 * @param size Size of file
+	 * @param old_tier_path Tier to drop the index entry from, if moved
 	 */
-	void touch(void);
+	static void set_tier_path(std::string relative_path,
+							  std::shared_ptr<rocksdb::DB> &db,
+							  const std::string &tier_path,
+							  uint64_t size,
+							  const std::string &old_tier_path = std::string());
+	/**
+	 * @brief Set pinned flag of relative_path in the database without reading it,
+	 * along with its entry in the index of pinned files.
+	 *
+	 * @param relative_path Database key
+	 * @param db Pointer to RocksDB database
+	 * @param pinned
+	 */
+	static void set_pinned(std::string relative_path,
+						   std::shared_ptr<rocksdb::DB> &db,
+						   bool pinned);
+	/**
+	 * @brief Store popularity calculated by tiering and take the accesses it was
+	 * calculated from off the access count, keeping accesses counted since.
+	 *
+	 * @param relative_path Database key
+	 * @param db Pointer to RocksDB database
+	 * @param popularity New popularity
+	 * @param accesses_used Access count the popularity was calculated from
+	 */
+	static void set_popularity(std::string relative_path,
+							   std::shared_ptr<rocksdb::DB> &db,
+							   double popularity,
+							   uintmax_t accesses_used);
 	/**
 	 * @brief Get path to tier root.
 	 *
@@ -151,6 +420,69 @@ public:
 	std::string dump_stats(void) const;
 #endif
 private:
+	/**
+	 * @brief Type of merge operand, stored as its first byte.
+	 *
+	 */
+	enum MergeOp : char {
+		ADD_ACCESSES = 'A',  ///< uint64_t added to access_count_
+		SET_TIER = 'T',      ///< New tier_path_
+		SET_PINNED = 'P',    ///< One byte, nonzero if pinned
+		SET_POPULARITY = 'Y' ///< double popularity_ then uint64_t subtracted from access_count_
+	};
+#ifndef BAREBONES_METADATA
+	/**
+	 * @brief Get database key of relative_path. Every access to a file record goes
+	 * through here, so the key form can change in one place.
+	 *
+	 * @param relative_path Path of file
+	 * @param db Pointer to RocksDB database
+	 * @param create Add missing directories to the directory table
+	 * @param key Database key
+	 * @return true Key found
+	 * @return false A directory is missing from the directory table and create is false
+	 */
+	static bool db_key(std::string relative_path,
+					   std::shared_ptr<rocksdb::DB> &db,
+					   bool create,
+					   std::string &key);
+	/**
+	 * @brief Merge operand into record of relative_path.
+	 *
+	 * @param relative_path Database key
+	 * @param db Pointer to RocksDB database
+	 * @param operand Encoded operand
+	 * @param create Passed to db_key()
+	 */
+	static void merge(std::string relative_path,
+					  std::shared_ptr<rocksdb::DB> &db,
+					  const std::string &operand,
+					  bool create);
+#endif
+	/**
+	 * @brief Read binary record or text archive.
+	 *
+	 * @param data
+	 * @param len
+	 */
+	void parse(const char *data, size_t len);
+	/**
+	 * @brief Read statistics record.
+	 *
+	 * @param data
+	 * @param len
+	 * @return true Read
+	 * @return false Record is malformed
+	 */
+	bool parse_stats(const char *data, size_t len);
+	/**
+	 * @brief Apply merge operand.
+	 *
+	 * @param operand Encoded operand
+	 * @return true Applied
+	 * @return false Operand is malformed
+	 */
+	bool apply(const rocksdb::Slice &operand);
 	/**
 	 * @brief Number of times the file was accessed since last tiering.
 	 * Resets to 0 after each popularity calculation.
@@ -183,7 +515,13 @@ private:
 	 */
 	std::string tier_path_;
 	/**
-	 * @brief Serialize method for boost::serialize
+	 * @brief Id of tier_path_ read from a binary record, kept so records merged before
+	 * the id table is loaded are written back unchanged.
+	 *
+	 */
+	uint16_t tier_id_ = NO_TIER_ID;
+	/**
+	 * @brief Serialize method for boost::serialize, used for records from older versions
 	 *
 	 * @tparam Archive Template type
 	 * @param ar Internal boost::serialize object
@@ -198,3 +536,106 @@ private:
 		ar &pinned_;
 	}
 };
+
+/**
+ * @brief RocksDB merge operator for Metadata records. Lets single fields be changed with
+ * Merge() instead of reading, changing and rewriting the whole record, so concurrent
+ * changes to one file no longer overwrite each other. Operands are combined on read and
+ * during compaction. One instance serves each column family, as placement and statistics
+ * records are laid out differently.
+ *
+ */
+class MetadataMergeOperator : public rocksdb::MergeOperator {
+public:
+	/**
+	 * @brief Construct a new Metadata Merge Operator object
+	 *
+	 * @param stats Merge into statistics records instead of placement records
+	 */
+	MetadataMergeOperator(bool stats = false) : stats_(stats) {}
+	/**
+	 * @brief Apply operands in order to the existing record, or to an empty one.
+	 *
+	 * @param merge_in
+	 * @param merge_out
+	 * @return true Merged
+	 * @return false Record or operand is corrupt
+	 */
+	bool FullMergeV2(const MergeOperationInput &merge_in,
+					 MergeOperationOutput *merge_out) const override;
+	/**
+	 * @brief Combine two operands of the same type into one.
+	 *
+	 * @param key
+	 * @param left_operand
+	 * @param right_operand
+	 * @param new_value Combined operand
+	 * @param logger
+	 * @return true Combined
+	 * @return false Operands can't be combined
+	 */
+	bool PartialMerge(const rocksdb::Slice &key,
+					  const rocksdb::Slice &left_operand,
+					  const rocksdb::Slice &right_operand,
+					  std::string *new_value,
+					  rocksdb::Logger *logger) const override;
+	const char *Name(void) const override {
+		return stats_ ? "MetadataStatsMergeOperator" : "MetadataMergeOperator";
+	}
+private:
+	bool stats_; ///< Column family holds statistics records
+};
+
+#ifndef BAREBONES_METADATA
+/**
+ * @brief Rewrites the popularity index once per tiering cycle. Entries are written under
+ * a new generation, ordered by popularity, and commit() publishes the generation and drops
+ * the previous one with a single range delete, so stale entries never have to be looked up.
+ * Incremental writers instead update entries of changed files in the current generation.
+ *
+ */
+class PopularityIndexWriter {
+public:
+	/**
+	 * @brief Construct a new Popularity Index Writer object, starting the next generation
+	 * unless incremental and a generation already exists.
+	 *
+	 * @param db Pointer to RocksDB database
+	 * @param incremental Update the current generation instead of writing a new one
+	 */
+	PopularityIndexWriter(std::shared_ptr<rocksdb::DB> &db, bool incremental = false);
+	/**
+	 * @brief Check if the current generation is being updated, else every file has to be
+	 * added.
+	 *
+	 * @return true Updating current generation
+	 * @return false Writing new generation
+	 */
+	bool incremental(void) const;
+	/**
+	 * @brief Add a file to the new generation.
+	 *
+	 * @param relative_path Path of file
+	 * @param popularity Popularity of file
+	 */
+	void add(const std::string &relative_path, double popularity);
+	/**
+	 * @brief Replace the entry of a file in the current generation, for incremental writers.
+	 *
+	 * @param relative_path Path of file
+	 * @param old_popularity Popularity the entry was written with
+	 * @param popularity New popularity of file
+	 */
+	void update(const std::string &relative_path, double old_popularity, double popularity);
+	/**
+	 * @brief Write remaining entries, make the new generation current and drop the old one.
+	 *
+	 */
+	void commit(void);
+private:
+	std::shared_ptr<rocksdb::DB> &db_; ///< Pointer to RocksDB database
+	uint64_t generation_;              ///< Generation being written
+	bool incremental_;                 ///< Updating generation_ in place
+	rocksdb::WriteBatch batch_;        ///< Entries not yet written
+};
+#endif
@@ -0,0 +1,118 @@
+/*
+ *    Copyright (C) 2019-2021 Joshua Boudreau <jboudreau@45drives.com>
+ *
+ *    This file is part of autotier.
+ *
+ *    autotier is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    autotier is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with autotier.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <boost/filesystem.hpp>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <rocksdb/db.h>
+#include <thread>
+#include <vector>
+namespace fs = boost::filesystem;
+
+class File;
+class PathCache;
+class Tier;
+
+/**
+ * @brief Persistent pool of threads moving files between tiers. Each move waits in the
+ * queue of its (source, destination) tier pair, and is started once neither tier is
+ * already moving its limit of files (see Tier::concurrent_moves()). With io_uring, a
+ * thread takes a chunk of files from the queue at once so they share one batch of
+ * the ring, and a chunk counts as one move against the limit. Demotions are started
+ * before promotions, and promotions into a tier wait for every demotion out of that tier
+ * to finish so the space they need has been freed. Queued moves only start once wait() is
+ * called, so every demotion is known before any promotion starts.
+ *
+ */
+class MoverPool {
+public:
+	/**
+	 * @brief Construct a new Mover Pool object and start its threads.
+	 *
+	 * @param tiers Tiers by index, highest tier first
+	 * @param threads Number of mover threads
+	 * @param buff_sz Size of copy buffer
+	 * @param queue_depth io_uring queue depth of each thread, 0 to not use io_uring
+	 * @param run_path Path to run directory, for conflicts
+	 * @param db Database to update with new tiers of files
+	 * @param path_cache Cache to drop moved files from
+	 */
+	MoverPool(const std::vector<Tier *> &tiers,
+			  int threads,
+			  int buff_sz,
+			  unsigned int queue_depth,
+			  const fs::path &run_path,
+			  std::shared_ptr<rocksdb::DB> &db,
+			  PathCache &path_cache);
+	/**
+	 * @brief Destroy the Mover Pool object, waiting for moves in progress and dropping
+	 * the rest.
+	 *
+	 */
+	~MoverPool(void);
+	/**
+	 * @brief Queue a file to be moved.
+	 *
+	 * @param fptr File to move, must stay valid until wait() returns
+	 * @param source Index of tier holding file
+	 * @param dest Index of tier to move file into
+	 */
+	void enqueue(File *fptr, size_t source, size_t dest);
+	/**
+	 * @brief Start moving queued files and block until every one has been moved.
+	 *
+	 */
+	void wait(void);
+private:
+	/**
+	 * @brief Loop of each mover thread.
+	 *
+	 */
+	void worker(void);
+	/**
+	 * @brief Find the queue to take the next move from, called with mt_ held.
+	 *
+	 * @param pair Set to index of queue in queues_
+	 * @return true A move can start
+	 * @return false Nothing can start until a move finishes or more are queued
+	 */
+	bool next_move(size_t &pair) const;
+	std::vector<Tier *> tiers_;              ///< Tiers by index
+	size_t thread_count_;                    ///< Number of mover threads
+	int buff_sz_;                            ///< Size of copy buffer
+	unsigned int queue_depth_;               ///< io_uring queue depth, 0 for none
+	fs::path run_path_;                      ///< Path to run directory
+	std::shared_ptr<rocksdb::DB> &db_;       ///< Database
+	PathCache &path_cache_;                  ///< Cache of tiers of paths
+	std::vector<std::deque<File *>> queues_; ///< Waiting moves, by source * tiers + dest
+	std::vector<int> active_;                ///< Moves in progress into or out of each tier
+	std::vector<size_t> demotions_out_;      ///< Demotions queued or in progress, by source
+	size_t queued_;                          ///< Moves not started yet
+	size_t pending_;                         ///< Moves queued or in progress
+	bool running_;                           ///< Set while wait() is moving queued files
+	bool stop_;                              ///< Set to end mover threads
+	std::mutex mt_;                          ///< Guards everything above
+	std::condition_variable work_cv_;        ///< Signalled when a move may be able to start
+	std::condition_variable done_cv_;        ///< Signalled when pending_ reaches zero
+	std::vector<std::thread> threads_;       ///< Mover threads
+};
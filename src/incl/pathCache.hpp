@@ -0,0 +1,127 @@
+/*
+ *    Copyright (C) 2019-2021 Joshua Boudreau <jboudreau@45drives.com>
+ *
+ *    This file is part of autotier.
+ *
+ *    autotier is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    autotier is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with autotier.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#define PATH_CACHE_SHARDS  64    ///< Independent LRU lists, picked by hash of path
+#define PATH_CACHE_ENTRIES 65536 ///< Paths held across all shards
+
+class Tier;
+
+/**
+ * @brief Bounded LRU cache of which tier holds each path, so FUSE calls can skip the lstat()
+ * and database lookup normally needed to find a file. Paths found not to exist are cached
+ * too, so repeated probes for missing files return ENOENT right away. Split into shards by
+ * hash of the path, each with its own lock and LRU list. Entries are dropped when a path is
+ * created, renamed, removed or moved to another tier.
+ *
+ */
+class PathCache {
+public:
+	/**
+	 * @brief Cached location of a path.
+	 *
+	 */
+	struct Entry {
+		Tier *tier_;     ///< Tier holding file, highest tier for directories, nullptr if missing
+		bool directory_; ///< Path is a directory
+	};
+	/**
+	 * @brief Construct a new empty Path Cache object
+	 *
+	 */
+	PathCache(void);
+	/**
+	 * @brief Destroy the Path Cache object
+	 *
+	 */
+	~PathCache(void) = default;
+	/**
+	 * @brief Look up path, marking it most recently used.
+	 *
+	 * @param path Path relative to the filesystem root, leading slashes are ignored
+	 * @param entry Set to cached entry if found
+	 * @return true Found
+	 * @return false Not cached
+	 */
+	bool lookup(const char *path, Entry &entry);
+	/**
+	 * @brief Get generation of the shard holding path, taken before looking path up
+	 * elsewhere and passed to insert().
+	 *
+	 * @param path Path relative to the filesystem root
+	 * @return uint64_t
+	 */
+	uint64_t generation(const char *path);
+	/**
+	 * @brief Add path, evicting the least recently used path of its shard if full. Skipped
+	 * if any path of the shard was invalidated since generation() was called, as the result
+	 * being inserted may already be stale.
+	 *
+	 * @param path Path relative to the filesystem root
+	 * @param entry Location of path
+	 * @param generation Result of generation() before path was looked up
+	 */
+	void insert(const char *path, const Entry &entry, uint64_t generation);
+	/**
+	 * @brief Drop path.
+	 *
+	 * @param path Path relative to the filesystem root
+	 */
+	void invalidate(const char *path);
+	/**
+	 * @brief Drop directory and every path under it.
+	 *
+	 * @param path Directory relative to the filesystem root
+	 */
+	void invalidate_dir(const char *path);
+	/**
+	 * @brief Drop every path cached as missing, and the kernel's entry of each, called
+	 * after tiering adds records for files that were not created through the filesystem.
+	 *
+	 */
+	void forget_missing(void);
+private:
+	/**
+	 * @brief One lock, LRU list and index of the cache.
+	 *
+	 */
+	struct Shard {
+		typedef std::list<std::pair<std::string, Entry>> List;
+		std::mutex mt_;                                         ///< Lock for everything below
+		List lru_;                                              ///< Most recently used first
+		std::unordered_map<std::string, List::iterator> index_; ///< Path to node in lru_
+		uint64_t generation_ = 0;                               ///< Bumped by every invalidation
+	};
+	/**
+	 * @brief Find shard of path.
+	 *
+	 * @param key Path without leading slashes
+	 * @return Shard&
+	 */
+	Shard &shard(const std::string &key);
+	std::array<Shard, PATH_CACHE_SHARDS> shards_; ///< Paths split by hash
+};
@@ -0,0 +1,70 @@
+/*
+ *    Copyright (C) 2019-2021 Joshua Boudreau <jboudreau@45drives.com>
+ *
+ *    This file is part of autotier.
+ *
+ *    autotier is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    autotier is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with autotier.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+/**
+ * @brief Fixed-width sort key for ordering files. Sorted ascending by primary_, then
+ * secondary_, with row_ carried along to apply the ordering afterwards.
+ *
+ */
+struct SortKey {
+	uint64_t primary_;   ///< Most significant part of key
+	uint64_t secondary_; ///< Tie breaker
+	uint32_t row_;       ///< Row of file being sorted
+};
+
+/**
+ * @brief Map a double to an unsigned integer with the same ordering.
+ *
+ * @param val
+ * @return uint64_t
+ */
+inline uint64_t double_key(double val) {
+	uint64_t bits;
+	memcpy(&bits, &val, sizeof(bits));
+	// negative: flip everything so larger magnitude sorts lower, positive: set sign bit
+	return (bits & (uint64_t(1) << 63)) ? ~bits : bits | (uint64_t(1) << 63);
+}
+
+/**
+ * @brief Map a signed integer to an unsigned integer with the same ordering.
+ *
+ * @param val
+ * @return uint64_t
+ */
+inline uint64_t int64_key(int64_t val) {
+	return uint64_t(val) ^ (uint64_t(1) << 63);
+}
+
+/**
+ * @brief Stable LSD radix sort of keys by (primary_, secondary_), one byte per pass.
+ * Digits that are the same for every key are skipped, so keys that only differ in their
+ * low bytes take few passes. Each pass is split across threads by giving every thread a
+ * contiguous chunk and its own histogram. Keys are only read to count digits once, each
+ * pass counts the digit of the next one while moving keys.
+ *
+ * @param keys Keys to sort
+ * @param threads Number of threads to use, 1 to sort on the calling thread
+ */
+void radix_sort(std::vector<SortKey> &keys, size_t threads);
@@ -0,0 +1,63 @@
+/*
+ *    Copyright (C) 2019-2021 Joshua Boudreau <jboudreau@45drives.com>
+ *
+ *    This file is part of autotier.
+ *
+ *    autotier is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    autotier is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with autotier.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief Counting requests handled by each FUSE worker thread
+ *
+ */
+namespace RequestCounts {
+	/**
+	 * @brief Count a request handled by the calling thread. The thread's count is
+	 * retired when it exits.
+	 *
+	 */
+	void count(void);
+	/**
+	 * @brief Get requests handled so far by each running FUSE thread, and by all threads
+	 * that have exited.
+	 *
+	 * @param counts Set to count of each running thread
+	 * @return uint64_t Requests handled by exited threads
+	 */
+	uint64_t snapshot(std::vector<uint64_t> &counts);
+
+	template<typename T, T F>
+	struct Counted;
+	/**
+	 * @brief FUSE operation F, counting each call. Use through COUNTED().
+	 *
+	 * @tparam R Return type of F
+	 * @tparam Args Parameter types of F
+	 * @tparam F Operation
+	 */
+	template<typename R, typename... Args, R (*F)(Args...)>
+	struct Counted<R (*)(Args...), F> {
+		static R call(Args... args) {
+			count();
+			return F(args...);
+		}
+	};
+} // namespace RequestCounts
+
+#define COUNTED(f) RequestCounts::Counted<decltype(&f), &f>::call ///< Counting wrapper of f
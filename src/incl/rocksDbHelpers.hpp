@@ -19,11 +19,14 @@
 
 #pragma once
 
+#include <cstddef>
 #include <mutex>
 #include <rocksdb/db.h>
 #include <rocksdb/slice_transform.h>
 #include <string>
 
+#define KEY_LOCK_STRIPES 256 ///< Mutexes shared by all database keys
+
 /**
  * @brief Local namespace
  *
@@ -39,8 +42,11 @@ namespace l {
 			return "Path Slice Transform";
 		}
 		::rocksdb::Slice Transform(const ::rocksdb::Slice &key) const {
-			std::string key_str = key.ToString();
-			return ::rocksdb::Slice(key_str.substr(0, key_str.find('/')));
+			// must point into key, a Slice of a local string would dangle
+			size_t len = 0;
+			while (len < key.size() && key[len] != '/')
+				++len;
+			return ::rocksdb::Slice(key.data(), len);
 		}
 		bool InDomain(const ::rocksdb::Slice &key) const {
 			return key.ToString().find('/') != std::string::npos;
@@ -64,14 +70,35 @@ namespace l {
 	extern const PathSliceTransform *NewPathSliceTransform();
 
 	/**
-	 * @brief rocksdb namespace inside l:: namespace to hold mutex
+	 * @brief rocksdb namespace inside l:: namespace to hold key locks
 	 *
 	 */
 	namespace rocksdb {
 		/**
-		 * @brief Mutex lock to synchronize updating of RocksDB database
+		 * @brief Lock held over a read-modify-write of one or two database keys. Keys hash
+		 * to one of KEY_LOCK_STRIPES mutexes, so sequences on unrelated keys rarely wait on
+		 * each other. RocksDB writes are thread-safe, so blind writes and merges need no lock.
 		 *
 		 */
-		extern std::mutex global_lock_;
+		class KeyLock {
+		public:
+			/**
+			 * @brief Lock stripes of key and other_key, lowest stripe first.
+			 *
+			 * @param key Database key, leading slashes are ignored
+			 * @param other_key Second key for renames, or nullptr
+			 */
+			KeyLock(const char *key, const char *other_key = nullptr);
+			/**
+			 * @brief Unlock stripes.
+			 *
+			 */
+			~KeyLock(void);
+			KeyLock(const KeyLock &) = delete;
+			KeyLock &operator=(const KeyLock &) = delete;
+		private:
+			std::mutex *first_;  ///< Lower stripe
+			std::mutex *second_; ///< Higher stripe, nullptr if only one
+		};
 	} // namespace rocksdb
 } // namespace l
@@ -24,9 +24,33 @@
 #include <mutex>
 #include <queue>
 #include <rocksdb/db.h>
+#include <unordered_map>
 namespace fs = boost::filesystem;
 
 class File;
+class UringMover;
+struct Extent;
+
+/**
+ * @brief How files are moved into a tier from another tier, cheapest first. Found for
+ * each pair of tiers by Tier::probe_move_method() at startup.
+ *
+ */
+enum class MoveMethod {
+	RENAME,          ///< Tiers are on the same filesystem, rename(2)
+	REFLINK,         ///< Share extents with ioctl(FICLONE)
+	COPY_FILE_RANGE, ///< In-kernel copy with copy_file_range(2)
+	SENDFILE,        ///< In-kernel copy with sendfile(2)
+	BUFFERED         ///< read()/write() loop through a buffer
+};
+
+/**
+ * @brief Get name of method for printing.
+ *
+ * @param method
+ * @return const char*
+ */
+const char *move_method_str(MoveMethod method);
 
 /**
  * @brief Class to represent each tier in the filesystem.
@@ -48,12 +72,13 @@ private:
 	 */
 	std::string id_;
 	fs::path path_; ///< Backend path to tier.
+	int concurrent_moves_; ///< Files moved into or out of tier at once by MoverPool
 	/**
-	 * @brief Queue of files to be placed into the tier, filled
-	 * during the simulation of tiering and used while actually
-	 * tiering.
+	 * @brief How to move files into this tier from each other tier.
 	 */
-	std::vector<File *> incoming_files_;
+	std::unordered_map<const Tier *, MoveMethod> move_methods_;
+	uint64_t parallel_copy_threshold_; ///< Files at least this big are copied by many threads
+	int parallel_copy_threads_;        ///< Threads copying ranges of one file, 1 to disable
 	/**
 	 * @brief Copy ownership and permissions from old_path to new_path,
 	 * called after copying a file to a different tier.
@@ -62,6 +87,132 @@ private:
 	 * @param new_path Path to file after moving
 	 */
 	void copy_ownership_and_perms(const fs::path &old_path, const fs::path &new_path) const;
+	/**
+	 * @brief Move a batch of files into the tier at once with mover.
+	 *
+	 * @param mover io_uring copy engine
+	 * @param begin First file of batch
+	 * @param end One past last file of batch
+	 * @param run_path
+	 * @param db
+	 */
+	void transfer_batch(UringMover &mover,
+						std::vector<File *>::iterator begin,
+						std::vector<File *>::iterator end,
+						const fs::path &run_path,
+						std::shared_ptr<rocksdb::DB> &db);
+	/**
+	 * @brief Point file at this tier in the database after it was moved here,
+	 * recording a conflict if one happened.
+	 *
+	 * @param fptr File that was moved
+	 * @param conflicted Whether file was renamed due to a conflict
+	 * @param new_path Backend path the file was moved to
+	 * @param orig_tier ID of tier the file was moved from
+	 * @param run_path
+	 * @param db
+	 */
+	void file_moved(File *fptr,
+					bool conflicted,
+					const fs::path &new_path,
+					const std::string &orig_tier,
+					const fs::path &run_path,
+					std::shared_ptr<rocksdb::DB> &db);
+	/**
+	 * @brief Get hidden path a file is copied to before being renamed to new_path.
+	 *
+	 * @param new_path
+	 * @return fs::path
+	 */
+	fs::path temp_path(const fs::path &new_path) const;
+	/**
+	 * @brief Create parent directories of new_tmp_path, then open old_path for reading
+	 * and create new_tmp_path for writing. Logs and closes everything on failure.
+	 *
+	 * @param old_path Path to file before moving
+	 * @param new_tmp_path Temporary path to copy to
+	 * @param source_fd Set to fd of old_path
+	 * @param dest_fd Set to fd of new_tmp_path
+	 * @return true Both opened
+	 * @return false Failed to open
+	 */
+	bool open_move(const fs::path &old_path,
+				   const fs::path &new_tmp_path,
+				   int &source_fd,
+				   int &dest_fd) const;
+	/**
+	 * @brief Called after copying a file to copy ownership and permissions, remove the
+	 * original, and rename the copy into place or beside a conflicting file.
+	 *
+	 * @param old_path Path to file before moving
+	 * @param new_tmp_path Temporary path copied to
+	 * @param new_path Final path of file
+	 * @param conflicted Set to true if new_path already existed
+	 * @param orig_tier ID of tier the file was moved from
+	 */
+	void finish_move(const fs::path &old_path,
+					 const fs::path &new_tmp_path,
+					 const fs::path &new_path,
+					 bool *conflicted,
+					 const std::string &orig_tier) const;
+	/**
+	 * @brief Move a file with rename(2), or beside a conflicting file.
+	 *
+	 * @param old_path Path to file before moving
+	 * @param new_path Path to file after moving
+	 * @param conflicted Set to true if new_path already existed
+	 * @param orig_tier ID of tier the file was moved from
+	 * @return int 0 on success, else errno
+	 */
+	int rename_file(const fs::path &old_path,
+					const fs::path &new_path,
+					bool *conflicted,
+					const std::string &orig_tier) const;
+	/**
+	 * @brief Copy [offset, end) from source_fd to dest_fd without going through user space.
+	 *
+	 * @param source_fd
+	 * @param dest_fd
+	 * @param method COPY_FILE_RANGE or SENDFILE
+	 * @param offset Advanced by the number of bytes copied
+	 * @param end One past last byte to copy
+	 * @return true Range was copied
+	 * @return false Method failed, copy the rest from offset with copy_range()
+	 */
+	bool kernel_copy(
+		int source_fd, int dest_fd, MoveMethod method, off_t &offset, off_t end) const;
+	/**
+	 * @brief Copy [offset, end) from source_fd to dest_fd through buff, retrying short
+	 * writes and ENOSPC until space frees up.
+	 *
+	 * @param source_fd
+	 * @param dest_fd
+	 * @param offset First byte to copy
+	 * @param end One past last byte to copy
+	 * @param buff Buffer
+	 * @param buff_sz Size of buff
+	 * @return true Range was copied
+	 * @return false Read or write failed, errno is set
+	 */
+	bool copy_range(
+		int source_fd, int dest_fd, off_t offset, off_t end, char *buff, int buff_sz) const;
+	/**
+	 * @brief Split extents into ranges and copy them with parallel_copy_threads_ threads
+	 * at once, each with its own buffer and independent offsets.
+	 *
+	 * @param source_fd
+	 * @param dest_fd
+	 * @param extents Data extents of source
+	 * @param method COPY_FILE_RANGE to copy in the kernel, otherwise copy_range() is used
+	 * @param buff_sz Size of buffer of each thread
+	 * @return true Every range was copied
+	 * @return false A range failed, errno is set
+	 */
+	bool copy_parallel(int source_fd,
+					   int dest_fd,
+					   const std::vector<Extent> &extents,
+					   MoveMethod method,
+					   int buff_sz) const;
 	std::mutex usage_mt_; ///< Mutex to be used in {add,subtract}_file_size() for FUSE threads.
 public:
 	/**
@@ -82,7 +233,10 @@ public:
 		, sim_usage_(std::move(other.sim_usage_))
 		, id_(std::move(other.id_))
 		, path_(std::move(other.path_))
-		, incoming_files_(std::move(other.incoming_files_))
+		, concurrent_moves_(other.concurrent_moves_)
+		, move_methods_(std::move(other.move_methods_))
+		, parallel_copy_threshold_(other.parallel_copy_threshold_)
+		, parallel_copy_threads_(other.parallel_copy_threads_)
 		, usage_mt_() {}
 	/**
 	 * @brief Destroy the Tier object
@@ -121,6 +275,13 @@ public:
 	 * @param size
 	 */
 	void subtract_file_size_sim(ffd::Bytes size);
+	/**
+	 * @brief Copy files of at least threshold bytes with threads threads at once.
+	 *
+	 * @param threshold Size in bytes
+	 * @param threads Number of threads, 1 to copy every file with one thread
+	 */
+	void parallel_copy(uint64_t threshold, int threads);
 	/**
 	 * @brief Set quota percentage
 	 *
@@ -161,20 +322,49 @@ public:
 	 */
 	const std::string &id(void) const;
 	/**
-	 * @brief Push file pointer into incoming_files_.
+	 * @brief Set limit of files moved into or out of tier at once.
+	 *
+	 * @param moves
+	 */
+	void concurrent_moves(int moves);
+	/**
+	 * @brief Get limit of files moved into or out of tier at once.
+	 *
+	 * @return int
+	 */
+	int concurrent_moves(void) const;
+	/**
+	 * @brief Find the cheapest way to move files from source into this tier by trying
+	 * each MoveMethod on a small probe file, and remember it for move_method().
+	 *
+	 * @param source Tier files will come from
+	 */
+	void probe_move_method(const Tier &source);
+	/**
+	 * @brief Get how files are moved into this tier from source.
 	 *
-	 * @param fptr
+	 * @param source
+	 * @return MoveMethod BUFFERED if source was not probed
 	 */
-	void enqueue_file_ptr(File *fptr);
+	MoveMethod move_method(const Tier *source) const;
 	/**
-	 * @brief Iterate through incoming_files_ and move each file into
-	 * the tier.
+	 * @brief Move a chunk of files from one tier into this tier, called by MoverPool
+	 * threads. Files moved with MoveMethod::BUFFERED go through mover together if
+	 * given, else move_file() is used for each.
 	 *
+	 * @param begin First file to move
+	 * @param end One past last file to move
 	 * @param buff_sz
+	 * @param mover io_uring copy engine of calling thread, or nullptr
 	 * @param run_path
 	 * @param db
 	 */
-	void transfer_files(int buff_sz, const fs::path &run_path, std::shared_ptr<rocksdb::DB> &db);
+	void transfer_files(std::vector<File *>::iterator begin,
+						std::vector<File *>::iterator end,
+						int buff_sz,
+						UringMover *mover,
+						const fs::path &run_path,
+						std::shared_ptr<rocksdb::DB> &db);
 	/**
 	 * @brief Called in transfer_files() to actually copy the file and
 	 * remove the old one.
@@ -182,6 +372,7 @@ public:
 	 * @param old_path
 	 * @param new_path
 	 * @param buff_sz
+	 * @param method How to move the file, see move_method()
 	 * @param conflicted
 	 * @param orig_tier
 	 * @return true
@@ -190,6 +381,7 @@ public:
 	bool move_file(const fs::path &old_path,
 				   const fs::path &new_path,
 				   int buff_sz,
+				   MoveMethod method,
 				   bool *conflicted = nullptr,
 				   std::string orig_tier = "") const;
 	/**
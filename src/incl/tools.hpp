@@ -39,6 +39,8 @@ enum command_enum {
 	LPIN,
 	LPOP,
 	WHICHTIER,
+	RESCAN,
+	LTIER,
 	NUM_COMMANDS
 };
 
@@ -0,0 +1,115 @@
+/*
+ *    Copyright (C) 2019-2021 Joshua Boudreau <jboudreau@45drives.com>
+ *
+ *    This file is part of autotier.
+ *
+ *    autotier is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    autotier is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with autotier.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "extents.hpp"
+
+#include <cstddef>
+#include <vector>
+
+extern "C" {
+#include <liburing.h>
+#include <sys/types.h>
+}
+
+/**
+ * @brief Copies many files at once with io_uring, keeping up to queue depth reads and
+ * writes in flight using a pool of registered buffers. One UringMover is used by one
+ * thread at a time.
+ *
+ */
+class UringMover {
+public:
+	/**
+	 * @brief One file to copy.
+	 *
+	 */
+	struct Job {
+		int source_fd_;               ///< Open for reading
+		int dest_fd_;                 ///< Open for writing
+		off_t size_;                  ///< Size of source, dest is truncated to it after copying
+		std::vector<Extent> extents_; ///< Data extents of source, holes are not copied
+		int error_;                   ///< errno of first failure, 0 when copied
+	};
+	/**
+	 * @brief Construct a new Uring Mover object. Check ok() before use.
+	 *
+	 * @param queue_depth Number of buffers, and so reads and writes in flight
+	 * @param buff_sz Size of each buffer
+	 */
+	UringMover(unsigned int queue_depth, size_t buff_sz);
+	/**
+	 * @brief Destroy the Uring Mover object, tearing down the ring and buffers.
+	 *
+	 */
+	~UringMover(void);
+	UringMover(const UringMover &) = delete;
+	UringMover &operator=(const UringMover &) = delete;
+	/**
+	 * @brief Check if the ring was set up.
+	 *
+	 * @return true io_uring is usable
+	 * @return false io_uring is not supported, copy with read()/write() instead
+	 */
+	bool ok(void) const;
+	/**
+	 * @brief Copy the extents of every job, interleaving their reads and writes. Short
+	 * writes are resubmitted for the rest of the range, and ENOSPC is retried until space
+	 * frees up. Sets error_ of each job.
+	 *
+	 * @param jobs Files to copy
+	 */
+	void copy(std::vector<Job> &jobs);
+private:
+	/**
+	 * @brief One buffer of the pool and the range of a job it is moving.
+	 *
+	 */
+	struct Slot {
+		int index_;    ///< Index of buffer in the registered buffer table
+		char *buff_;   ///< Buffer
+		size_t job_;   ///< Index of job in jobs passed to copy()
+		off_t offset_; ///< Offset of range in file
+		size_t len_;   ///< Length of range
+		size_t got_;   ///< Bytes of range read so far
+		size_t put_;   ///< Bytes of range written so far
+		bool writing_; ///< Range is being written
+	};
+	/**
+	 * @brief Queue read of the unread part of slot's range.
+	 *
+	 * @param jobs
+	 * @param slot
+	 */
+	void submit_read(const std::vector<Job> &jobs, Slot *slot);
+	/**
+	 * @brief Queue write of the unwritten part of slot's range.
+	 *
+	 * @param jobs
+	 * @param slot
+	 */
+	void submit_write(const std::vector<Job> &jobs, Slot *slot);
+	struct io_uring ring_;    ///< Submission and completion queues
+	bool ok_;                 ///< Ring was set up
+	bool registered_;         ///< Buffers are registered with the ring
+	size_t buff_sz_;          ///< Size of each buffer
+	std::vector<char> pool_;  ///< Memory of every buffer
+	std::vector<Slot> slots_; ///< One per buffer
+};
@@ -0,0 +1,153 @@
+/*
+ *    Copyright (C) 2019-2021 Joshua Boudreau <jboudreau@45drives.com>
+ *
+ *    This file is part of autotier.
+ *
+ *    autotier is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    autotier is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with autotier.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* Work-stealing queue for a fixed pool of workers. Each worker pushes and pops from the back of
+ * its own deque and steals from the front of other workers' deques when its own runs dry.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Multiple-producer multiple-consumer work-stealing queue for a fixed number of workers.
+ * Work items may push more work while being processed. pop() returns false once every pushed
+ * item has been popped and marked finished with task_done().
+ *
+ * @tparam T Type to store.
+ */
+template<class T>
+class WorkStealingQueue {
+public:
+	/**
+	 * @brief Construct a new Work Stealing Queue object
+	 *
+	 * @param workers Number of worker threads that will call pop()
+	 */
+	explicit WorkStealingQueue(size_t workers)
+		: lanes_(workers), pending_(0), queued_(0), sleepers_(0) {}
+	/**
+	 * @brief Destroy the Work Stealing Queue object
+	 *
+	 */
+	~WorkStealingQueue() = default;
+	/**
+	 * @brief Number of worker lanes.
+	 *
+	 * @return size_t
+	 */
+	size_t workers(void) const {
+		return lanes_.size();
+	}
+	/**
+	 * @brief Push work onto the back of worker's own lane.
+	 *
+	 * @param worker Index of calling worker
+	 * @param val Work item
+	 */
+	void push(size_t worker, T &&val) {
+		Lane &lane = lanes_[worker % lanes_.size()];
+		pending_.fetch_add(1, std::memory_order_relaxed);
+		{
+			std::lock_guard<std::mutex> lk(lane.mt_);
+			lane.deque_.emplace_back(std::move(val));
+			++queued_; // before the item can be popped
+		}
+		if (sleepers_ != 0) {
+			std::lock_guard<std::mutex> lk(idle_mt_);
+			idle_cv_.notify_one();
+		}
+	}
+	/**
+	 * @brief Get next work item, first from the back of worker's own lane, then by stealing
+	 * from the front of the other lanes. Sleeps while nothing is queued but other workers may
+	 * still produce more work.
+	 *
+	 * @param worker Index of calling worker
+	 * @param val Filled with work item
+	 * @return true Got work, call task_done() when finished with it
+	 * @return false All work is finished, worker should exit
+	 */
+	bool pop(size_t worker, T &val) {
+		size_t n = lanes_.size();
+		while (true) {
+			{
+				Lane &own = lanes_[worker % n];
+				std::lock_guard<std::mutex> lk(own.mt_);
+				if (!own.deque_.empty()) {
+					val = std::move(own.deque_.back());
+					own.deque_.pop_back();
+					--queued_;
+					return true;
+				}
+			}
+			for (size_t i = 1; i < n; ++i) {
+				Lane &victim = lanes_[(worker + i) % n];
+				std::unique_lock<std::mutex> lk(victim.mt_, std::try_to_lock);
+				if (lk.owns_lock() && !victim.deque_.empty()) {
+					val = std::move(victim.deque_.front());
+					victim.deque_.pop_front();
+					--queued_;
+					return true;
+				}
+			}
+			if (pending_.load(std::memory_order_acquire) == 0)
+				return false;
+			if (queued_ != 0) {
+				std::this_thread::yield(); // a lane was locked while stealing, retry
+				continue;
+			}
+			std::unique_lock<std::mutex> lk(idle_mt_);
+			++sleepers_;
+			idle_cv_.wait(lk, [this]() { return queued_ != 0 || pending_ == 0; });
+			--sleepers_;
+		}
+	}
+	/**
+	 * @brief Mark a popped work item as finished. Must be called after any push()es
+	 * that processing the item caused.
+	 *
+	 */
+	void task_done(void) {
+		if (pending_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+			std::lock_guard<std::mutex> lk(idle_mt_);
+			idle_cv_.notify_all();
+		}
+	}
+private:
+	/**
+	 * @brief Per-worker deque and its lock.
+	 *
+	 */
+	struct Lane {
+		std::mutex mt_;       ///< Mutex for synchronization
+		std::deque<T> deque_; ///< Work owned by this lane
+	};
+	std::vector<Lane> lanes_;          ///< One lane per worker
+	std::atomic<size_t> pending_;      ///< Items pushed but not yet marked done
+	std::atomic<size_t> queued_;       ///< Items pushed but not yet popped
+	std::atomic<size_t> sleepers_;     ///< Workers waiting on idle_cv_
+	std::mutex idle_mt_;               ///< Lock for idle_cv_
+	std::condition_variable idle_cv_;  ///< Wakes idle workers on push() or when all work is done
+};
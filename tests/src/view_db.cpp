@@ -28,9 +28,24 @@ public:
 
 int main(int argc, char *argv[]){
 	std::string db_path = "/var/lib/autotier/" + std::to_string(std::hash<std::string>{}("/etc/autotier.conf")) + "/db";
-	rocksdb::DB *db;
-	rocksdb::Status status = rocksdb::DB::OpenForReadOnly(rocksdb::Options(), db_path, &db);
+	rocksdb::DB *db_ptr;
+	rocksdb::Options options;
+	std::vector<rocksdb::ColumnFamilyDescriptor> families = Metadata::column_families(options);
+	std::vector<std::string> existing;
+	rocksdb::DB::ListColumnFamilies(options, db_path, &existing);
+	// leave out families added since the database was last mounted
+	families.erase(std::remove_if(families.begin(), families.end(), [&](const rocksdb::ColumnFamilyDescriptor &family){
+		return std::find(existing.begin(), existing.end(), family.name) == existing.end();
+	}), families.end());
+	std::vector<rocksdb::ColumnFamilyHandle *> handles;
+	rocksdb::Status status = rocksdb::DB::OpenForReadOnly(options, db_path, families, &handles, &db_ptr);
 	assert(status.ok());
+	Metadata::open_column_families(handles);
+	std::shared_ptr<rocksdb::DB> db(db_ptr, [](rocksdb::DB *db){
+		Metadata::close_column_families(db);
+		delete db;
+	});
+	Metadata::load_tier_ids(db, std::vector<std::string>());
 	
 	MetadataViewer viewer;
 	
@@ -49,14 +64,18 @@ int main(int argc, char *argv[]){
 	
 	rocksdb::Iterator *it = db->NewIterator(rocksdb::ReadOptions());
 	
+	std::string path;
 	for(it->SeekToFirst(); it->Valid(); it->Next()){
-		size_t key_len = it->key().ToString().length();
+		if(!Metadata::file_path(it->key(), db, path))
+			continue;
+		size_t key_len = path.length();
 		if(key_len > key_len_)
 			key_len_ = key_len;
 		
-		Metadata f(it->value().ToString());
+		Metadata f(it->value());
+		f.load_stats(it->key(), db);
 		
-		Row row = viewer.get_row(f, it->key().ToString());
+		Row row = viewer.get_row(f, path);
 		
 		size_t tpath_len = row.tier_path.length();
 		if(tpath_len > tpath_len_)
@@ -95,6 +114,6 @@ int main(int argc, char *argv[]){
 		std::cout << std::endl;
 	}
 	
-	delete db;
+	delete it;
 	return 0;
 }